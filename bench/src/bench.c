@@ -0,0 +1,491 @@
+/*
+ALMiSHELL - A POSIX conformant shell prototype.
+Copyright (C) 2017  Henrique C. S. M. Aranha; Lucas E. C. Mello; Lucas H. F. Leal
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* End-to-end benchmarks of the shell binary and of libruncmd. Each
+   scenario is repeated and reported as the median and 99th percentile. */
+
+#include <runcmd/runcmd.h>
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <errno.h>
+#include <signal.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct options {
+    const char *shell;
+    int iterations;             /* for the latency scenarios */
+    int runs;                   /* for the throughput scenarios */
+    int jobs;
+    int stages;
+    int mebibytes;
+    int lines;                  /* for the read scenarios */
+};
+
+static double now(void)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *) a, y = *(const double *) b;
+
+    return x < y ? -1 : x > y;
+}
+
+/* Sorts the samples and returns the requested percentile */
+static double percentile(double *samples, int n, int p)
+{
+    qsort(samples, n, sizeof(double), compare_doubles);
+
+    return samples[(n - 1) * p / 100];
+}
+
+/* Prints the durations as latencies in ms, or as a throughput if bytes is
+   not 0, where the 99th percentile is the slow tail */
+static void report(const char *scenario, double *samples, int n, double bytes)
+{
+    double p50 = percentile(samples, n, 50), p99 = percentile(samples, n, 99);
+
+    if(bytes)
+        printf("%-40s %6d %10.3f %10.3f  GB/s\n", scenario, n, bytes / p50 / 1e9, bytes / p99 / 1e9);
+    else
+        printf("%-40s %6d %10.3f %10.3f  ms\n", scenario, n, p50 * 1e3, p99 * 1e3);
+
+    fflush(stdout);
+}
+
+/* Runs the shell with the arguments and input as stdin, and returns how
+   long it took. The input is never a terminal, so the shell is never
+   interactive. */
+static double run_shell_input(const struct options *o, const char *arg1, const char *arg2,
+                              int input)
+{
+    double start = now();
+    int status;
+    pid_t pid = fork();
+
+    if(pid == 0) {
+        dup2(input, STDIN_FILENO);
+        if(input != STDIN_FILENO)
+            close(input);
+
+        execl(o->shell, o->shell, arg1, arg2, (char *) NULL);
+        perror(o->shell);
+        _exit(127);
+    } else if(pid < 0) {
+        perror("bench: fork");
+        exit(EXIT_FAILURE);
+    }
+
+    while(waitpid(pid, &status, 0) < 0 && errno == EINTR);
+
+    if(!WIFEXITED(status) || WEXITSTATUS(status)) {
+        fprintf(stderr, "bench: %s %s %s: failed\n", o->shell, arg1, arg2 ? arg2 : "");
+        exit(EXIT_FAILURE);
+    }
+
+    return now() - start;
+}
+
+/* run_shell_input with /dev/null */
+static double run_shell(const struct options *o, const char *arg1, const char *arg2)
+{
+    int null_fd = open("/dev/null", O_RDONLY);
+    double duration = run_shell_input(o, arg1, arg2, null_fd);
+
+    close(null_fd);
+
+    return duration;
+}
+
+static void bench_startup(const struct options *o)
+{
+    double *samples = (double *) malloc(o->iterations * sizeof(double));
+    int i;
+
+    for(i = 0; i < o->iterations; ++i)
+        samples[i] = run_shell(o, "-c", "true");
+
+    report("startup+exit (-c true)", samples, o->iterations, 0);
+    free(samples);
+}
+
+static void bench_pipeline(const struct options *o)
+{
+    double *samples = (double *) malloc(o->runs * sizeof(double));
+    char *command = (char *) malloc(128 + o->stages * 8), scenario[64];
+    int i;
+
+    sprintf(command, "dd if=/dev/zero bs=1M count=%d status=none", o->mebibytes);
+    for(i = 0; i < o->stages; ++i)
+        strcat(command, " | cat");
+    strcat(command, " > /dev/null");
+
+    for(i = 0; i < o->runs; ++i)
+        samples[i] = run_shell(o, "-c", command);
+
+    sprintf(scenario, "pipeline %d x cat, %d MiB", o->stages, o->mebibytes);
+    report(scenario, samples, o->runs, o->mebibytes * 1048576.0);
+
+    free(command);
+    free(samples);
+}
+
+static void bench_background_jobs(const struct options *o)
+{
+    double *samples = (double *) malloc(o->runs * sizeof(double));
+    char path[] = "/tmp/almishell-bench-XXXXXX", scenario[64];
+    int i, fd = mkstemp(path);
+    FILE *script;
+
+    if(fd < 0 || !(script = fdopen(fd, "w"))) {
+        perror("bench: mkstemp");
+        exit(EXIT_FAILURE);
+    }
+
+    for(i = 0; i < o->jobs; ++i)
+        fprintf(script, "true &\n");
+    fprintf(script, "wait\n");
+    fclose(script);
+
+    for(i = 0; i < o->runs; ++i)
+        samples[i] = run_shell(o, path, NULL);
+
+    unlink(path);
+
+    sprintf(scenario, "launch+reap %d background jobs", o->jobs);
+    report(scenario, samples, o->runs, 0);
+    free(samples);
+}
+
+static void bench_runcmd(const struct options *o, int nonblocking)
+{
+    double *samples = (double *) malloc(o->iterations * sizeof(double)), start, total = 0;
+    const char *command = nonblocking ? "true &" : "true";
+    char scenario[64];
+    int i, result, status, pid;
+
+    for(i = 0; i < o->iterations; ++i) {
+        start = now();
+        pid = runcmd(command, &result, NULL);
+        samples[i] = now() - start;
+        total += samples[i];
+
+        if(pid <= 0) {
+            fprintf(stderr, "bench: runcmd: %s: failed\n", command);
+            exit(EXIT_FAILURE);
+        }
+
+        /* The intermediate process of a non-blocking call is reaped out
+           of the timed region */
+        if(nonblocking)
+            while(waitpid(pid, &status, 0) < 0 && errno == EINTR);
+    }
+
+    sprintf(scenario, "runcmd %s, %.0f calls/s", nonblocking ? "non-blocking" : "blocking",
+            o->iterations / total);
+    report(scenario, samples, o->iterations, 0);
+    free(samples);
+}
+
+static void bench_runcmd_prepared(const struct options *o)
+{
+    double *samples = (double *) malloc(o->iterations * sizeof(double)), start, total = 0;
+    runcmd_handle *handle = runcmd_prepare("true x");
+    const char *overrides[2] = {NULL, NULL};
+    char scenario[64], arg[16];
+    int i, result;
+
+    if(!handle) {
+        perror("bench: runcmd_prepare");
+        exit(EXIT_FAILURE);
+    }
+
+    for(i = 0; i < o->iterations; ++i) {
+        /* Only the argument changes between the calls */
+        sprintf(arg, "%d", i);
+        overrides[1] = arg;
+
+        start = now();
+        if(runcmd_exec(handle, overrides, NULL, &result) <= 0) {
+            perror("bench: runcmd_exec");
+            exit(EXIT_FAILURE);
+        }
+        samples[i] = now() - start;
+        total += samples[i];
+    }
+
+    runcmd_free(handle);
+
+    sprintf(scenario, "runcmd_exec prepared, %.0f calls/s", o->iterations / total);
+    report(scenario, samples, o->iterations, 0);
+    free(samples);
+}
+
+/* Writes a temporary file from the lines text, count times, and returns
+   its path, to be freed */
+static char *write_temporary(const char *text, int count)
+{
+    char *path = (char *) malloc(32);
+    FILE *file;
+    int fd, i;
+
+    strcpy(path, "/tmp/almishell-bench-XXXXXX");
+
+    if((fd = mkstemp(path)) < 0 || !(file = fdopen(fd, "w"))) {
+        perror("bench: mkstemp");
+        exit(EXIT_FAILURE);
+    }
+
+    for(i = 0; i < count; ++i)
+        fputs(text, file);
+    fclose(file);
+
+    return path;
+}
+
+/* Feeds the file to a pipe from a child, and returns the read end */
+static int feed_pipe(const char *path, pid_t *feeder)
+{
+    int fds[2], fd;
+    char buffer[65536];
+    ssize_t n;
+
+    if(pipe(fds) < 0 || (*feeder = fork()) < 0) {
+        perror("bench: pipe");
+        exit(EXIT_FAILURE);
+    }
+
+    if(*feeder == 0) {
+        close(fds[0]);
+        fd = open(path, O_RDONLY);
+        while((n = read(fd, buffer, sizeof(buffer))) > 0)
+            if(write(fds[1], buffer, n) != n)
+                break;
+        _exit(0);
+    }
+
+    close(fds[1]);
+
+    return fds[0];
+}
+
+/* A script of read builtins over a regular file, read by blocks, and over
+   a pipe, read byte by byte */
+static void bench_read(const struct options *o, int from_pipe)
+{
+    double *samples = (double *) malloc(o->runs * sizeof(double));
+    char *data = write_temporary("the quick brown fox jumps over the lazy dog 0123456789\n",
+                                 o->lines);
+    char *script = write_temporary("read a b c\n", o->lines), scenario[64];
+    int i, input, status;
+    pid_t feeder = 0;
+
+    for(i = 0; i < o->runs; ++i) {
+        input = from_pipe ? feed_pipe(data, &feeder) : open(data, O_RDONLY);
+
+        samples[i] = run_shell_input(o, script, NULL, input);
+        close(input);
+
+        if(from_pipe)
+            while(waitpid(feeder, &status, 0) < 0 && errno == EINTR);
+    }
+
+    unlink(data);
+    unlink(script);
+    free(data);
+    free(script);
+
+    sprintf(scenario, "read %s %d lines, %.0f lines/s", from_pipe ? "pipe" : "file",
+            o->lines, o->lines / percentile(samples, o->runs, 50));
+    report(scenario, samples, o->runs, 0);
+    free(samples);
+}
+
+/* One request to a shell server, with /dev/null as its descriptors.
+   Returns -1 if the server is not there. */
+static int serve_request(const char *path, const char *command, int null_fd)
+{
+    union {
+        struct cmsghdr header;
+        char buffer[CMSG_SPACE(sizeof(int) * 3)];
+    } control;
+    int fds[3], conn, status;
+    struct sockaddr_un addr;
+    struct cmsghdr *c;
+    struct msghdr msg;
+    struct iovec iov;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    if((conn = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+        return -1;
+    if(connect(conn, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        close(conn);
+        return -1;
+    }
+
+    fds[0] = fds[1] = fds[2] = null_fd;
+
+    memset(&msg, 0, sizeof(msg));
+    iov.iov_base = (void *) command;
+    iov.iov_len = strlen(command);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buffer;
+    msg.msg_controllen = sizeof(control.buffer);
+
+    c = CMSG_FIRSTHDR(&msg);
+    c->cmsg_level = SOL_SOCKET;
+    c->cmsg_type = SCM_RIGHTS;
+    c->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(c), fds, sizeof(fds));
+
+    if(sendmsg(conn, &msg, 0) < 0 || shutdown(conn, SHUT_WR) < 0
+       || read(conn, &status, sizeof(status)) != sizeof(status))
+        status = -1;
+
+    close(conn);
+
+    return status;
+}
+
+/* Command lines run by a warm shell server, against the -c startup */
+static void bench_serve(const struct options *o)
+{
+    double *samples = (double *) malloc(o->iterations * sizeof(double)), start, total = 0;
+    char path[64], scenario[64];
+    int i, status, null_fd = open("/dev/null", O_RDWR);
+    struct timespec pause;
+    pid_t server;
+
+    pause.tv_sec = 0;
+    pause.tv_nsec = 1000000;
+
+    sprintf(path, "/tmp/almishell-bench-%ld.sock", (long) getpid());
+
+    if((server = fork()) == 0) {
+        dup2(null_fd, STDIN_FILENO);
+        execl(o->shell, o->shell, "--serve", path, (char *) NULL);
+        perror(o->shell);
+        _exit(127);
+    } else if(server < 0) {
+        perror("bench: fork");
+        exit(EXIT_FAILURE);
+    }
+
+    /* Until the server listens */
+    for(i = 0; serve_request(path, "true", null_fd) < 0; ++i) {
+        if(i == 1000) {
+            fprintf(stderr, "bench: %s --serve: no server\n", o->shell);
+            exit(EXIT_FAILURE);
+        }
+        nanosleep(&pause, NULL);
+    }
+
+    for(i = 0; i < o->iterations; ++i) {
+        start = now();
+        if(serve_request(path, "true", null_fd) != 0) {
+            fprintf(stderr, "bench: %s --serve: request failed\n", o->shell);
+            exit(EXIT_FAILURE);
+        }
+        samples[i] = now() - start;
+        total += samples[i];
+    }
+
+    kill(server, SIGTERM);
+    while(waitpid(server, &status, 0) < 0 && errno == EINTR);
+    unlink(path);
+    close(null_fd);
+
+    sprintf(scenario, "serve request (true), %.0f calls/s", o->iterations / total);
+    report(scenario, samples, o->iterations, 0);
+    free(samples);
+}
+
+int main(int argc, char *argv[])
+{
+    struct options o;
+    int option;
+
+    o.shell = "../shell/bin/main";
+    o.iterations = 500;
+    o.runs = 5;
+    o.jobs = 10000;
+    o.stages = 4;
+    o.mebibytes = 256;
+    o.lines = 100000;
+
+    while( (option = getopt(argc, argv, "s:n:r:j:p:m:l:")) != -1 ) {
+        switch(option) {
+        case 's': o.shell = optarg; break;
+        case 'n': o.iterations = atoi(optarg); break;
+        case 'r': o.runs = atoi(optarg); break;
+        case 'j': o.jobs = atoi(optarg); break;
+        case 'p': o.stages = atoi(optarg); break;
+        case 'm': o.mebibytes = atoi(optarg); break;
+        case 'l': o.lines = atoi(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [-s shell] [-n iterations] [-r runs] [-j jobs] "
+                    "[-p stages] [-m MiB] [-l lines]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if(o.iterations < 1 || o.runs < 1 || o.jobs < 1 || o.stages < 0 || o.mebibytes < 1
+       || o.lines < 1) {
+        fprintf(stderr, "%s: counts must be positive\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if(access(o.shell, X_OK) < 0) {
+        perror(o.shell);
+        return EXIT_FAILURE;
+    }
+
+    printf("%-40s %6s %10s %10s\n", "scenario", "n", "p50", "p99");
+
+    bench_startup(&o);
+    bench_pipeline(&o);
+    bench_background_jobs(&o);
+    bench_runcmd(&o, 0);
+    bench_runcmd(&o, 1);
+    bench_runcmd_prepared(&o);
+    bench_read(&o, 0);
+    bench_read(&o, 1);
+    bench_serve(&o);
+
+    return EXIT_SUCCESS;
+}
@@ -3,7 +3,7 @@
 
 /* Definitions for the command line parser. */
 
-#define RCMD_MAXARGS   1024	/* Max number of arguments. */
+#define RCMD_MAXARGS   1024	/* Initial size of the argument vector. */
 #define RCMD_DELIM    " \n\t\r" /* Command line delimiters.   */
 #define RCMD_NONBLOCK '&'	/* Command line nonblock sign.*/
 
@@ -12,6 +12,7 @@
 #define NORMTERM    (1 <<  8)	/* 256 */
 #define EXECOK      (1 <<  9)	/* 1024 */
 #define NONBLOCK    (1 << 10)	/* 2048 */
+#define TIMEDOUT    (1 << 11)	/* 4096 */
 #define RETSTATUS   (0xFF)	/* 255 */
 
 /*
@@ -30,6 +31,8 @@
                        the subprocess; false otherwise.
    EXITSTATUS(result)  returns the exit status returned by the
                        subproccess.
+   IS_TIMEDOUT(result) returns true if the subprocess has been signaled
+                       because its deadline expired; false otherwise.
 
 */
 
@@ -37,6 +40,7 @@
 #define IS_NONBLOCK(result) ((result & NONBLOCK) && 1)
 #define EXITSTATUS(result)  ( result & RETSTATUS)
 #define IS_EXECOK(result)   ((result & EXECOK) && 1)
+#define IS_TIMEDOUT(result) ((result & TIMEDOUT) && 1)
 
 /* Subprocess' exit status upon exec failure.*/
 
@@ -46,6 +50,56 @@
 
 int runcmd (const char *command, int *result, const int *io);
 
+/* Prepared commands.
+
+   runcmd_prepare parses 'command' once, as runcmd does, and resolves the
+   executable through PATH. The returned handle can be run any number of
+   times with runcmd_exec, which only spawns the subprocess: no parsing,
+   allocation or pipe is needed per call. Returns NULL on error.
+
+   runcmd_exec runs the prepared command. If 'overrides' is not NULL it
+   has one entry per argument of the command, args[0] included; a non
+   NULL entry replaces the prepared argument for this call only. 'result'
+   and 'io' are as in runcmd. In nonblocking mode (a trailing '&') the
+   caller must reap the subprocess. On success, returns the subprocess'
+   pid; on error, returns -1 with errno set.
+
+   runcmd_free releases the handle.
+*/
+
+typedef struct runcmd_handle runcmd_handle;
+
+runcmd_handle *runcmd_prepare (const char *command);
+
+int runcmd_exec (runcmd_handle *handle, const char *const *overrides,
+                 const int *io, int *result);
+
+void runcmd_free (runcmd_handle *handle);
+
+/* Deadlines.
+
+   runcmd_timed and runcmd_exec_timed are runcmd and runcmd_exec for
+   blocking commands that must not run longer than 'timeout_ms'. On
+   expiry the subprocess is sent 'signal', and SIGKILL if it is still
+   running 'grace_ms' later (0 sends SIGKILL right away). The wait uses a
+   pidfd and a timerfd, no helper process is created. A subprocess that
+   was signaled this way has TIMEDOUT set in 'result'. Nonblocking
+   commands fail with EINVAL.
+*/
+
+struct runcmd_deadline {
+    long timeout_ms;
+    int signal;
+    long grace_ms;
+};
+
+int runcmd_timed (const char *command, int *result, const int *io,
+                  const struct runcmd_deadline *deadline);
+
+int runcmd_exec_timed (runcmd_handle *handle, const char *const *overrides,
+                       const int *io, int *result,
+                       const struct runcmd_deadline *deadline);
+
 /* Hanlder for SIGCHLD in nonblock mode. */
 
 extern void (*runcmd_onexit)(void);
@@ -1,11 +1,18 @@
+#define _GNU_SOURCE		/* syscall */
+
 #include <runcmd/runcmd.h>
 
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <spawn.h>
+#include <poll.h>
+#include <stdint.h>
 
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
 #include <signal.h>
 
 #include <stdlib.h>
@@ -19,6 +26,8 @@ termination. If this variable points to NULL, no action is performed.
 
 void (*runcmd_onexit)(void) = NULL;
 
+extern char **environ;
+
 struct sigaction act, old_act;
 
 void runcmd_adapter(int dummy);
@@ -55,7 +64,8 @@ int runcmd (const char *command, int *result, const int *io)
 {
     int pid, status;
     int aux, i, tmp_result, pipeErr[2];
-    char *args[RCMD_MAXARGS], *p, *cmd;
+    size_t args_size = RCMD_MAXARGS;
+    char **args, *p, *cmd, **tmp;
 
     tmp_result = 0;
 
@@ -68,10 +78,28 @@ int runcmd (const char *command, int *result, const int *io)
 
     p = strcpy (cmd, command);
 
+    /* The argument vector grows as needed, exec reports E2BIG if the
+       arguments don't fit in ARG_MAX. */
+    args = malloc (args_size * sizeof(char *));
+    if(!args) {
+        free (cmd);
+        return -1;
+    }
+
     i=0;
     args[i++] = strtok (cmd, RCMD_DELIM);
-    while ((i<RCMD_MAXARGS) && (args[i++] = strtok (NULL, RCMD_DELIM)));
-    i--;
+    while ((args[i] = strtok (NULL, RCMD_DELIM))) {
+        if((size_t) ++i == args_size) {
+            args_size *= 2;
+            tmp = realloc (args, args_size * sizeof(char *));
+            if(!tmp) {
+                free (args);
+                free (cmd);
+                return -1;
+            }
+            args = tmp;
+        }
+    }
 
     if(!strcmp(args[i-1], "&")) {
         tmp_result |= NONBLOCK;
@@ -80,7 +108,8 @@ int runcmd (const char *command, int *result, const int *io)
     setup_signal_handlers();
 
     if(pipe(pipeErr) < 0) {
-        return -1;
+        pid = -1;
+        goto out;
     }
 
     /* Create a subprocess. */
@@ -97,16 +126,17 @@ int runcmd (const char *command, int *result, const int *io)
         if(!IS_NONBLOCK(tmp_result)) {
             aux = wait (&status);
             if(aux < 0) {
-                return -1;
+                pid = -1;
             }
 
-            if(read(pipeErr[0], &errno, sizeof errno)) {
-                *result = EXECFAILSTATUS;
-                return -1;
+            /* The child writes errno to the pipe if exec failed. */
+            else if(read(pipeErr[0], &errno, sizeof errno)) {
+                tmp_result = EXECFAILSTATUS;
+                pid = -1;
             }
 
             /* Collect termination mode. */
-            if (WIFEXITED(status)) {
+            else if (WIFEXITED(status)) {
                 tmp_result |= WEXITSTATUS(status);
                 tmp_result |= NORMTERM;
                 tmp_result |= EXECOK;
@@ -145,6 +175,7 @@ int runcmd (const char *command, int *result, const int *io)
         aux = execvp (args[0], args);
         write(pipeErr[1], &errno, sizeof errno);
 
+        free (args);
         free (cmd);
 
         exit (EXECFAILSTATUS);
@@ -153,6 +184,336 @@ int runcmd (const char *command, int *result, const int *io)
     if (result)
         *result = tmp_result;
 
+ out:
+    free (args);
     free (p);
     return pid;			/* Only parent reaches this point. */
 }
+
+/* A command parsed once by runcmd_prepare. */
+
+struct runcmd_handle {
+    char *buffer;		/* Tokenized copy of the command. */
+    char **args;		/* Prepared argument vector. */
+    char **exec_args;		/* Vector passed to exec with overrides. */
+    int argc;
+    char *path;			/* Resolved executable, NULL if not found. */
+    int nonblock;
+};
+
+/* Looks 'name' up in PATH as execvp would. Returns a malloc'd path, or
+   NULL if no executable is found. */
+
+static char *resolve_path (const char *name)
+{
+    const char *dirs = getenv ("PATH"), *end;
+    char *path;
+    size_t len;
+
+    if(strchr (name, '/')) {
+        path = malloc (strlen (name) + 1);
+        return path ? strcpy (path, name) : NULL;
+    }
+
+    if(!dirs)
+        dirs = "/bin:/usr/bin";
+
+    for(;; dirs = end + 1) {
+        end = strchr (dirs, ':');
+        len = end ? (size_t) (end - dirs) : strlen (dirs);
+
+        path = malloc (len + strlen (name) + 3);
+        if(!path)
+            return NULL;
+
+        /* An empty entry is the current directory. */
+        sprintf (path, "%.*s/%s", (int) (len ? len : 1), len ? dirs : ".", name);
+
+        if(access (path, X_OK) == 0)
+            return path;
+
+        free (path);
+        if(!end)
+            return NULL;
+    }
+}
+
+runcmd_handle *runcmd_prepare (const char *command)
+{
+    runcmd_handle *h;
+    size_t args_size = RCMD_MAXARGS;
+    char **tmp;
+    int i;
+
+    h = calloc (1, sizeof (runcmd_handle));
+    if(!h)
+        return NULL;
+
+    h->buffer = malloc (strlen (command) + 1);
+    h->args = malloc (args_size * sizeof (char *));
+    if(!h->buffer || !h->args) {
+        runcmd_free (h);
+        return NULL;
+    }
+
+    strcpy (h->buffer, command);
+
+    i = 0;
+    h->args[i++] = strtok (h->buffer, RCMD_DELIM);
+    if(!h->args[0]) {
+        runcmd_free (h);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    while ((h->args[i] = strtok (NULL, RCMD_DELIM))) {
+        if((size_t) ++i == args_size) {
+            args_size *= 2;
+            tmp = realloc (h->args, args_size * sizeof (char *));
+            if(!tmp) {
+                runcmd_free (h);
+                return NULL;
+            }
+            h->args = tmp;
+        }
+    }
+
+    /* The nonblock sign is not passed to the command. */
+    if(i > 1 && !strcmp (h->args[i-1], "&")) {
+        h->nonblock = 1;
+        h->args[--i] = NULL;
+    }
+
+    h->argc = i;
+    h->exec_args = malloc ((i + 1) * sizeof (char *));
+    if(!h->exec_args) {
+        runcmd_free (h);
+        return NULL;
+    }
+
+    h->path = resolve_path (h->args[0]);
+
+    return h;
+}
+
+/* Spawns the prepared command. Returns the subprocess' pid, or -1 with
+   errno set. */
+
+static int spawn_handle (runcmd_handle *handle, const char *const *overrides,
+                         const int *io)
+{
+    posix_spawn_file_actions_t actions;
+    int pid, err, i;
+    char **args = handle->args;
+
+    if(overrides) {
+        for(i = 0; i < handle->argc; ++i)
+            handle->exec_args[i] = overrides[i] ? (char *) overrides[i] : handle->args[i];
+        handle->exec_args[i] = NULL;
+        args = handle->exec_args;
+    }
+
+    if(io != NULL) {
+        posix_spawn_file_actions_init (&actions);
+        for(i = 0; i < 3; ++i)
+            if(io[i] != i)
+                posix_spawn_file_actions_adddup2 (&actions, io[i], i);
+    }
+
+    /* posix_spawn reports exec failures itself, no error pipe is needed. */
+    if(handle->path)
+        err = posix_spawn (&pid, handle->path, io ? &actions : NULL, NULL, args, environ);
+    else
+        err = posix_spawnp (&pid, args[0], io ? &actions : NULL, NULL, args, environ);
+
+    if(io != NULL)
+        posix_spawn_file_actions_destroy (&actions);
+
+    if(err) {
+        errno = err;
+        return -1;
+    }
+
+    return pid;
+}
+
+/* Collects termination mode. */
+
+static int termination_result (int status)
+{
+    if (WIFEXITED(status))
+        return WEXITSTATUS(status) | NORMTERM;
+
+    return 0;
+}
+
+int runcmd_exec (runcmd_handle *handle, const char *const *overrides,
+                 const int *io, int *result)
+{
+    int pid, status, tmp_result = 0;
+
+    if(handle->nonblock) {
+        tmp_result |= NONBLOCK;
+        setup_signal_handlers();
+    }
+
+    if((pid = spawn_handle (handle, overrides, io)) < 0) {
+        if(result)
+            *result = EXECFAILSTATUS;
+        return -1;
+    }
+
+    tmp_result |= EXECOK;
+
+    if(!handle->nonblock) {
+        while (waitpid (pid, &status, 0) < 0) {
+            if(errno != EINTR)
+                return -1;
+        }
+
+        tmp_result |= termination_result (status);
+    }
+
+    if (result)
+        *result = tmp_result;
+
+    return pid;
+}
+
+static void arm_timer (int fd, long ms)
+{
+    struct itimerspec spec;
+
+    memset (&spec, 0, sizeof spec);
+    spec.it_value.tv_sec = ms / 1000;
+    spec.it_value.tv_nsec = (ms % 1000) * 1000000;
+
+    /* A zero value would disarm the timer. */
+    if(ms <= 0)
+        spec.it_value.tv_nsec = 1;
+
+    timerfd_settime (fd, 0, &spec, NULL);
+}
+
+/* Waits for 'pid', signaling it as 'deadline' says. Returns 1 if the
+   deadline expired, 0 if not, -1 on error. Without pidfd support the
+   subprocess is polled every 10 ms. */
+
+static int wait_deadline (int pid, int *status,
+                          const struct runcmd_deadline *deadline)
+{
+    struct pollfd fds[2];
+    uint64_t expirations;
+    int timed_out = 0, ready;
+
+    fds[0].fd = syscall (SYS_pidfd_open, pid, 0);
+    fds[1].fd = timerfd_create (CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    fds[0].events = fds[1].events = POLLIN;
+    fds[0].revents = fds[1].revents = 0;
+
+    if(fds[1].fd < 0) {
+        kill (pid, SIGKILL);
+        timed_out = -1;
+    } else
+        arm_timer (fds[1].fd, deadline->timeout_ms);
+
+    while (timed_out >= 0) {
+        ready = fds[0].fd >= 0 ? poll (fds, 2, -1) : poll (fds + 1, 1, 10);
+        if(ready < 0 && errno != EINTR) {
+            kill (pid, SIGKILL);
+            timed_out = -1;
+            break;
+        }
+
+        ready = waitpid (pid, status, WNOHANG);
+        if(ready == pid)
+            break;
+        if(ready < 0 && errno != EINTR) {
+            timed_out = -1;
+            break;
+        }
+
+        if(ready >= 0 && (fds[1].revents & POLLIN)) {
+            if(read (fds[1].fd, &expirations, sizeof expirations) < 0)
+                continue;
+
+            if(!timed_out) {
+                timed_out = 1;
+                kill (pid, deadline->signal);
+                if(deadline->grace_ms > 0) {
+                    arm_timer (fds[1].fd, deadline->grace_ms);
+                    continue;
+                }
+            }
+
+            kill (pid, SIGKILL);
+        }
+    }
+
+    /* The subprocess is reaped even after an error. */
+    if(timed_out < 0)
+        while (waitpid (pid, status, 0) < 0 && errno == EINTR);
+
+    if(fds[0].fd >= 0)
+        close (fds[0].fd);
+    if(fds[1].fd >= 0)
+        close (fds[1].fd);
+
+    return timed_out;
+}
+
+int runcmd_exec_timed (runcmd_handle *handle, const char *const *overrides,
+                       const int *io, int *result,
+                       const struct runcmd_deadline *deadline)
+{
+    int pid, status, timed_out;
+
+    if(handle->nonblock) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if((pid = spawn_handle (handle, overrides, io)) < 0) {
+        if(result)
+            *result = EXECFAILSTATUS;
+        return -1;
+    }
+
+    if((timed_out = wait_deadline (pid, &status, deadline)) < 0)
+        return -1;
+
+    if (result)
+        *result = EXECOK | termination_result (status) | (timed_out ? TIMEDOUT : 0);
+
+    return pid;
+}
+
+int runcmd_timed (const char *command, int *result, const int *io,
+                  const struct runcmd_deadline *deadline)
+{
+    runcmd_handle *handle = runcmd_prepare (command);
+    int pid, err;
+
+    if(!handle)
+        return -1;
+
+    pid = runcmd_exec_timed (handle, NULL, io, result, deadline);
+
+    err = errno;
+    runcmd_free (handle);
+    errno = err;
+
+    return pid;
+}
+
+void runcmd_free (runcmd_handle *handle)
+{
+    if(!handle)
+        return;
+
+    free (handle->buffer);
+    free (handle->args);
+    free (handle->exec_args);
+    free (handle->path);
+    free (handle);
+}
@@ -0,0 +1,73 @@
+/*
+ALMiSHELL - A POSIX conformant shell prototype.
+Copyright (C) 2017  Henrique C. S. M. Aranha; Lucas E. C. Mello; Lucas H. F. Leal
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Embedding API of libalmishell. A program creates a shell context,
+   compiles command lines once into programs, and executes them as many
+   times as needed, each call with its own positional parameters and
+   standard descriptors. */
+
+#ifndef ALMISHELL_H
+#define ALMISHELL_H
+
+#include <stddef.h>
+
+/* almishell_create flags */
+#define ALMISHELL_TERMINAL 1    /* take the terminal for job control if stdin is one */
+#define ALMISHELL_BUILTINS 2    /* run the builtins in the shell, else they are exec'd */
+
+struct shell_info;
+struct program;
+
+/* Overrides for a single execution */
+struct almishell_call {
+    char **argv;                /* $1, $2..., NULL terminated, NULL keeps the current ones */
+    int io[3];                  /* stdin, stdout and stderr of the jobs, -1 keeps the current one */
+};
+
+struct almishell_result {
+    int status;                 /* $? after the last job */
+    int syntax_error;           /* a job was not run because of a syntax error */
+    int exited;                 /* the exit builtin was run */
+    size_t job_num;             /* jobs launched */
+    size_t process_num;         /* processes of the last job */
+    int *process_status;        /* their $? form status, -1 if still running */
+};
+
+/* Without ALMISHELL_TERMINAL the context leaves the terminal and the signal
+   dispositions alone. The shell variables start from environ. */
+struct shell_info *almishell_create(int flags);
+
+/* Also deletes the jobs left running in the background */
+void almishell_destroy(struct shell_info *s);
+
+/* Compiles the lines of commands into a program that can be executed
+   any number of times, by any context. Syntax errors are reported when
+   the faulty job is reached. */
+struct program *almishell_compile(const char *commands);
+
+void almishell_free_program(struct program *prog);
+
+/* Runs the jobs of the program in order, stopping after exit. call and
+   result may be NULL, a filled result must be released with
+   almishell_free_result before it is reused. Returns the final $?. */
+int almishell_execute(struct shell_info *s, const struct program *prog,
+                      const struct almishell_call *call, struct almishell_result *result);
+
+void almishell_free_result(struct almishell_result *result);
+
+#endif /* ALMISHELL_H */
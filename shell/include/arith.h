@@ -0,0 +1,31 @@
+/*
+ALMiSHELL - A POSIX conformant shell prototype.
+Copyright (C) 2017  Henrique C. S. M. Aranha; Lucas E. C. Mello; Lucas H. F. Leal
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef ARITH_H
+#define ARITH_H
+
+#include <shell.h>
+
+/* Evaluates the arithmetic expression of a $((...)) expansion, after its
+   parameters were expanded, with the operators of POSIX in their C
+   precedence. Variable names are read, and assigned by =, op=, as
+   integers. Stores the value in *result and returns 0, or returns -1
+   after reporting a syntax error, an overflow or a division by zero. */
+int evaluate_arithmetic(struct shell_info *s, const char *expression, long *result);
+
+#endif /* ARITH_H */
@@ -0,0 +1,38 @@
+/*
+ALMiSHELL - A POSIX conformant shell prototype.
+Copyright (C) 2017  Henrique C. S. M. Aranha; Lucas E. C. Mello; Lucas H. F. Leal
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stddef.h>
+
+#define BATCH_COMMAND "batch"
+
+/* Bytes left for the exec arguments, counting the strings and their
+   pointers, once the environment envp is accounted for */
+size_t exec_arg_space(char **envp);
+
+/* Runs "batch [-P n] command [args] [{}] items...": the items are split in
+   the largest chunks that fit in an exec and the command is run on each
+   chunk, appended to args, by up to n processes at once (1 by default).
+   Without {} every word after the command is an item. Exits with 0 if
+   every chunk succeeded, otherwise with the highest status reported.
+   NOTE: Should be called after fork, it does not return */
+void run_batch(char **argv, char **envp);
+
+#endif /* BATCH_H */
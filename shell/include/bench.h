@@ -0,0 +1,37 @@
+/*
+ALMiSHELL - A POSIX conformant shell prototype.
+Copyright (C) 2017  Henrique C. S. M. Aranha; Lucas E. C. Mello; Lucas H. F. Leal
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* "bench [-n runs] [-w warmups] [-j parallel] [-f text|csv|json] command"
+   launches copies of its job through launch_job and reports the wall,
+   user and system time of the runs. The timing happens in the shell, so
+   only the job's own processes are measured. */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#define BENCH_COMMAND "bench"
+
+struct shell_info;
+struct job;
+
+/* Runs the benchmark j describes and prints its report on the stdout of
+   j. The processes of j are marked completed, with the status 2 on a
+   syntax error, else the status of the last failed run or 0. */
+void bench_job(struct shell_info *s, struct job *j);
+
+#endif /* BENCH_H */
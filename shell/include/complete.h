@@ -0,0 +1,42 @@
+/*
+ALMiSHELL - A POSIX conformant shell prototype.
+Copyright (C) 2017  Henrique C. S. M. Aranha; Lucas E. C. Mello; Lucas H. F. Leal
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef COMPLETE_H
+#define COMPLETE_H
+
+#include <stddef.h>
+
+#include <shell.h>
+
+/* Completion state: a prefix trie of command names built lazily from the
+   PATH directories and the builtins, refreshed per directory by mtime. */
+struct completion;
+
+struct completion *init_completion(void);
+
+void delete_completion(struct completion *c);
+
+/* Computes the candidates for the word ending at position len of line.
+   Returns a NULL terminated, sorted array of complete words (to be released
+   with free_candidates) and stores the index where the word starts in
+   word_start. */
+char **complete_line(struct shell_info *s, const char *line, size_t len, size_t *word_start);
+
+void free_candidates(char **candidates);
+
+#endif /* COMPLETE_H */
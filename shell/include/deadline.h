@@ -0,0 +1,61 @@
+/*
+ALMiSHELL - A POSIX conformant shell prototype.
+Copyright (C) 2017  Henrique C. S. M. Aranha; Lucas E. C. Mello; Lucas H. F. Leal
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DEADLINE_H
+#define DEADLINE_H
+
+#include <time.h>
+
+#define DEADLINE_COMMAND "timeout"
+#define DEADLINE_STATUS 124     /* $? of a job that reached its deadline */
+
+struct job_deadline {
+    struct timespec duration;
+    struct timespec grace;      /* from the signal to SIGKILL */
+    int signal;
+    struct timespec expires;    /* CLOCK_MONOTONIC, set by start_job_deadline, then
+                                   the end of the grace period once timed out */
+    char timed_out;             /* 1 once the signal was sent, 2 once SIGKILL was */
+    int timer;                  /* timerfd in the process watch of the shell, or -1 */
+};
+
+/* Parses "timeout [-s signal] [-k grace] duration command", storing the
+   deadline in a new *d. Durations are seconds, with an optional fraction
+   and an s, m, h or d suffix. The signal is TERM by default and the grace
+   period 5 seconds, 0 sends SIGKILL along with the signal. Returns the
+   number of words before the command, or -1 after printing an error. */
+int parse_job_deadline(struct job_deadline **d, char **argv);
+
+void delete_job_deadline(struct job_deadline *d);
+
+/* Starts the clock of d when its job is launched */
+void start_job_deadline(struct job_deadline *d);
+
+/* Returns a timerfd that becomes readable when d expires, or -1 */
+int deadline_timer(const struct job_deadline *d);
+
+/* To be called when timer is readable. Returns the signal to send the
+   job now, the signal of d the first time and SIGKILL after the grace
+   period, rearming timer for it. */
+int expire_job_deadline(struct job_deadline *d, int timer);
+
+/* As expire_job_deadline, from the clock, for waits without a timerfd.
+   Returns 0 if no signal is due yet. */
+int check_job_deadline(struct job_deadline *d);
+
+#endif /* DEADLINE_H */
@@ -0,0 +1,30 @@
+/*
+ALMiSHELL - A POSIX conformant shell prototype.
+Copyright (C) 2017  Henrique C. S. M. Aranha; Lucas E. C. Mello; Lucas H. F. Leal
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef EXPAND_H
+#define EXPAND_H
+
+#include <shell.h>
+
+/* Expands $NAME, ${NAME}, $?, $$, $#, the positional parameters $n and
+   ${n} and the arithmetic expansions $((...)) in word. Returns a newly
+   allocated string, the caller must free it, or NULL after reporting an
+   arithmetic error. */
+char *expand_parameters(struct shell_info *s, const char *word);
+
+#endif /* EXPAND_H */
@@ -0,0 +1,69 @@
+/*
+ALMiSHELL - A POSIX conformant shell prototype.
+Copyright (C) 2017  Henrique C. S. M. Aranha; Lucas E. C. Mello; Lucas H. F. Leal
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FUNCTION_H
+#define FUNCTION_H
+
+#include <stddef.h>
+
+#define FUNCTION_BUCKETS 64
+#define FUNCTION_MAX_DEPTH 1000 /* nested calls, before the C stack runs out */
+
+struct program;
+struct shell_info;
+
+/* A shell function, with its body compiled once when it is defined */
+struct function {
+    char *name;
+    struct program *body;
+    unsigned long hash;
+    int calls;                  /* running invocations */
+    char retired;               /* redefined or unset while running */
+    struct function *next;      /* hash chain */
+};
+
+struct function_table {
+    struct function *buckets[FUNCTION_BUCKETS];
+    size_t size;
+};
+
+struct function_table *init_functions(void);
+
+void delete_functions(struct function_table *t);
+
+/* Returns the function, or NULL if none has that name */
+struct function *find_function(struct function_table *t, const char *name);
+
+/* Stores body as the function name, replacing any previous definition.
+   The table takes the ownership of body. */
+void define_function(struct function_table *t, const char *name, struct program *body);
+
+/* Returns 0 if the function was not defined */
+int undefine_function(struct function_table *t, const char *name);
+
+/* Marks a call to f as started or finished, a function retired while it
+   runs is freed when its last call finishes */
+void enter_function(struct function *f);
+void leave_function(struct function *f);
+
+/* Runs the body of f in the shell, with argv[1]... as the positional
+   parameters and io as its standard descriptors, until it ends or
+   returns. Returns the exit status. */
+int call_function(struct shell_info *s, struct function *f, char **argv, const int io[3]);
+
+#endif /* FUNCTION_H */
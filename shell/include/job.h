@@ -20,9 +20,14 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define JOB_H
 
 #include <process.h>
+#include <deadline.h>
+#include <memo.h>
+#include <resources.h>
 #include <shell.h>
 #include <termios.h>
 
+#define COPROC_COMMAND "coproc"
+
 struct process_node {
     struct process *p;
     struct process_node *next;
@@ -39,6 +44,14 @@ struct job {
     size_t size;
     struct job *next;
     int io[3];
+    int coproc_fd[2];           /* shell ends of a coprocess: its stdout, its stdin */
+    struct job_resources *resources; /* set by the sched prefix */
+    struct job_deadline *deadline;   /* set by the timeout prefix */
+    struct job_memo *memo;           /* set by the memo prefix */
+    char tail;                  /* nothing runs after the job, it may replace the shell */
+    char notify;                /* its completion is to be shown by jobs or taken by wait */
+    char waited;                /* one of the jobs wait_processes returns on completion */
+    struct job *next_completed; /* in the completion queue of the process watch */
     int priority;
 };
 
@@ -46,7 +59,9 @@ struct job *init_job(char *command_line, char background);
 
 void delete_job(struct job *j);
 
-void wait_job(struct job *j, struct job *first_job);
+/* Waits until every process of j exits or stops, enforcing the deadlines
+   of the jobs meanwhile */
+void wait_job(struct shell_info *s, struct job *j);
 
 void put_job_in_foreground(struct shell_info *s, struct job *j, int cont);
 
@@ -54,14 +69,52 @@ void put_job_in_background(struct job *j, int cont);
 
 int launch_job(struct shell_info *s, struct job *j);
 
+/* Descriptor of the shell end of the pipe to the stdin of the most recent
+   coprocess if to_coproc is set, else from its stdout. -1 if there is no
+   coprocess. */
+int coproc_fd(struct shell_info *s, int to_coproc);
+
+/* Removes j from the job list and deletes it, whatever its state */
+void remove_job(struct shell_info *s, struct job *j);
+
+/* Removes the completed jobs from the job list. A job that ran in the
+   background or stopped stays until jobs or wait notified its completion,
+   so a script can still wait for it. */
+void remove_completed_jobs(struct shell_info *s);
+
 int check_processes(struct job *j);
 
-int mark_process_status(pid_t pid, int status, struct job* j);
+/* Records the status, and the resources used if usage is not NULL, of the
+   process pid of a job in the list starting at j */
+int mark_process_status(pid_t pid, int status, const struct rusage *usage, struct job* j);
+
+/* Records the status reported for p, and the resources it used if usage
+   is not NULL */
+void set_process_status(struct process *p, int status, const struct rusage *usage);
 
-void update_status(struct job *first_job);
+/* Collects the processes that exited or stopped, and signals the jobs
+   past their deadline, without blocking */
+void update_status(struct shell_info *s);
+
+/* Sends sig to the processes of j, and SIGCONT for the stopped ones to
+   act on it */
+void signal_job(struct job *j, int sig);
 
 int job_is_stopped(struct job *j);
 
 int job_is_completed(struct job *j);
 
+int job_exit_status(struct job *j);
+
+int process_exit_status(const struct process *p);
+
+/* Blocks until every procs[i], a process of jobs[i], exits, or if any is
+   set until the first of those jobs completes, which is returned. If procs
+   is NULL every job of s is waited. The processes still running are
+   counted once and counted down as the process watch of s reports them,
+   and a completed job is taken from its completion queue, so a wakeup
+   does not look at the others. Stopped processes are not waited. */
+struct job *wait_processes(struct shell_info *s, struct job **jobs,
+                           struct process **procs, size_t n, int any);
+
 #endif /* JOB_H */
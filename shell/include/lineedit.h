@@ -0,0 +1,30 @@
+/*
+ALMiSHELL - A POSIX conformant shell prototype.
+Copyright (C) 2017  Henrique C. S. M. Aranha; Lucas E. C. Mello; Lucas H. F. Leal
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LINEEDIT_H
+#define LINEEDIT_H
+
+#include <shell.h>
+
+/* Reads a line from the shell terminal in non canonical mode, handling
+   erase, kill and Tab completion. The prompt must already be printed.
+   Returns the line without the newline (caller must free it), or NULL
+   when end of file is received on an empty line. */
+char *edit_line(struct shell_info *s);
+
+#endif /* LINEEDIT_H */
@@ -0,0 +1,69 @@
+/*
+ALMiSHELL - A POSIX conformant shell prototype.
+Copyright (C) 2017  Henrique C. S. M. Aranha; Lucas E. C. Mello; Lucas H. F. Leal
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* "memo [-i files] command" caches the result of a command, its stdout,
+   stderr and exit status, under a key made of its words, assignments,
+   working directory, exported variables, and the path, size, mtime and
+   inode of the executable and of the input files. A hit replays the
+   result without launching the job. The cache is a directory of one file
+   per key, bounded in size by evicting the least recently used ones. */
+
+#ifndef MEMO_H
+#define MEMO_H
+
+#include <stddef.h>
+
+#define MEMO_COMMAND "memo"
+#define MEMO_DIR_VAR "ALMISHELL_MEMO_DIR"   /* default $XDG_CACHE_HOME/almishell/memo */
+#define MEMO_SIZE_VAR "ALMISHELL_MEMO_SIZE" /* bytes, with an optional K, M or G suffix */
+#define MEMO_DEFAULT_SIZE (64UL << 20)
+
+struct shell_info;
+struct process;
+
+struct job_memo {
+    char **inputs;              /* file lists of -i, each separated by ':' */
+    size_t input_num;
+    char *dir;
+    char *key;
+    size_t key_size;
+    char name[17];              /* hash of the key, the entry file name */
+    int capture[2];             /* unlinked files the job writes to on a miss, or -1 */
+    int output[2];              /* where the captured stdout and stderr go */
+    unsigned long limit;        /* cache size in bytes */
+};
+
+/* Parses "memo [-i files]... [--] command", also --inputs, storing the
+   options in a new *m. Returns the number of words before the command,
+   or -1 after printing an error. */
+int parse_job_memo(struct job_memo **m, char **argv);
+
+/* Looks p up in the cache, io being its resolved standard descriptors.
+   On a hit the result is replayed to io, *status set and 1 returned. On
+   a miss the stdout and stderr of p are redirected to capture files and
+   0 is returned. Without a usable cache p is left to run as is. */
+int start_job_memo(struct shell_info *s, struct job_memo *m, struct process *p,
+                   const int io[3], int *status);
+
+/* Copies the captured output of p to its destination, and stores the
+   result if p exited */
+void finish_job_memo(struct job_memo *m, const struct process *p);
+
+void delete_job_memo(struct job_memo *m);
+
+#endif /* MEMO_H */
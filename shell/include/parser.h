@@ -21,15 +21,128 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <process.h>
 #include <job.h>
+#include <shell.h>
 
-size_t count_pipes(char *command_line);
+#include <stdint.h>
+
+#define PROGRAM_MAGIC "ALMISHC"
+#define PROGRAM_FORMAT 7
+
+/* Compiled command lines. A program is a flat buffer of records that
+   refer to each other by offset, so it can be written to a file and
+   mapped back to be executed without parsing it again. Words are kept
+   as written; expansions happen when a job is instantiated. */
+struct program {
+    char *data;
+    size_t size;
+    size_t capacity;            /* 0 when data is a read only mapping */
+    uint32_t last_job;
+
+    /* Function definition spanning several commands, while compiling */
+    char *function;             /* its name, NULL if none is open */
+    char *body;                 /* one command per line */
+    size_t body_size;
+    int depth;                  /* braces open, 0 until the body starts */
+};
+
+struct program_header {
+    char magic[8];
+    uint32_t format;
+    uint32_t first_job;         /* offset of the first job record */
+    char version[16];           /* shell version that compiled it */
+    uint64_t source_size;       /* script the program was compiled from */
+    int64_t source_mtime_sec;
+    int64_t source_mtime_nsec;
+    uint32_t source_path;
+    uint32_t checksum;          /* of everything after the header */
+    uint64_t size;
+    uint32_t line_num;          /* non-empty lines of the script */
+};
+
+enum REDIRECT_TYPE {
+    REDIRECT_INPUT,             /* n<file */
+    REDIRECT_OUTPUT,            /* n>file */
+    REDIRECT_APPEND,            /* n>>file */
+    REDIRECT_DUPLICATE,         /* n>&m, n>&- to close, n>&p to the coprocess */
+    REDIRECT_DUPLICATE_INPUT    /* n<&m, n<&- to close, n<&p from the coprocess */
+};
 
-struct process *parse_process(char *command);
+struct redirect_record {
+    uint32_t type;
+    int32_t fd;
+    uint32_t target;            /* offset of the target word */
+};
 
-struct process *parse_last_process(struct job *j, char *command);
+struct process_record {
+    uint32_t word_num;
+    uint32_t words;             /* offset of the word offsets array */
+    uint32_t redirect_num;
+    uint32_t redirects;         /* offset of the redirect_record array */
+};
+
+struct job_record {
+    uint32_t next;              /* offset of the next job, 0 on the last */
+    uint32_t command;
+    uint32_t process_num;
+    uint32_t processes;         /* offset of the process_record array */
+    int32_t syntax_error;
+    uint32_t function;          /* offset of the name a definition gives its body, else 0 */
+    uint32_t body;              /* offset of the body text of a definition */
+    char background;
+    char padding[3];
+};
+
+#define PROGRAM_RECORD(prog, type, offset) ((type *) ((prog)->data + (offset)))
+
+size_t count_pipes(char *command_line);
 
 char parse_last_ampersand(char *command_line);
 
-struct job *parse_command_line(char *command_line);
+struct program *init_program(void);
+
+void delete_program(struct program *prog);
+
+/* Appends the compiled form of command_line to the program. The line is a
+   list of commands separated by ';', where "name() { commands }" defines a
+   function whose body may span several lines. Returns 0 on success, 1 if
+   the line has no command and -1 on syntax error, in which case an
+   erroneous job record is still appended. */
+int compile_command_line(struct program *prog, const char *command_line);
+
+/* Returns true if a function definition is still open, waiting for the
+   lines of its body */
+int program_incomplete(const struct program *prog);
+
+/* Ends the program, an open definition becomes a syntax error */
+void finish_program(struct program *prog);
+
+/* Compiles the lines of commands into a new finished program, counting
+   them in the stats as command lines read */
+struct program *compile_program(const char *commands);
+
+/* compile_program for commands that are part of a line already counted,
+   the body of a function or a process substitution */
+struct program *compile_nested_program(const char *commands);
+
+/* Stores str in the program and returns its offset */
+uint32_t program_add_string(struct program *prog, const char *str);
+
+/* Offset of the first job record of the program, 0 if it is empty */
+uint32_t program_first_job(const struct program *prog);
+
+uint32_t program_next_job(const struct program *prog, uint32_t job_offset);
+
+/* Returns the name of the function the job record defines, storing its
+   body text in *body, or NULL if the record is a job to run */
+const char *program_job_function(const struct program *prog, uint32_t job_offset,
+                                 const char **body);
+
+/* Expands the words of a compiled job and builds the job to launch.
+   Returns NULL, after reporting it, if the job record has a syntax error
+   or an expansion failed. */
+struct job *instantiate_job(struct shell_info *s, const struct program *prog,
+                            uint32_t job_offset);
+
+struct job *parse_command_line(struct shell_info *s, char *command_line);
 
 #endif /* PARSER_H */
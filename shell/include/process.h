@@ -19,22 +19,66 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #ifndef PROCESS_H
 #define PROCESS_H
 
+#include <sys/resource.h>
 #include <unistd.h>
 
 #include <shell.h>
+#include <resources.h>
+#include <procstat.h>
+
+/* Redirection of a descriptor of the process, applied in order after the
+   pipeline descriptors */
+struct redirection {
+    int fd;                     /* descriptor of the process */
+    int source;                 /* descriptor copied into it, -1 closes it */
+    char opened;                /* source was opened by the shell for it */
+    char multio;                /* an output file, written along with the others of fd */
+};
 
 /* Structure representing a process, from glibc manual*/
 struct process {
     char **argv;                /* for exec */
+    char **assign;              /* variable assignments for this command */
+    struct redirection *redirects;
+    size_t redirect_num;
+    char redirect_failed;       /* a redirection could not be set up */
+    char piped;                 /* stdout is the pipe to the next stage */
     pid_t pid;                  /* process ID */
+    int pidfd;                  /* in the process watch of the shell, or -1 */
     char completed;             /* true if process has completed */
     char stopped;               /* true if process has stopped */
     int status;                 /* reported status value */
+    struct rusage usage;        /* resources used, once completed */
+    struct process_sample *sample; /* live resource use, for jobs -l */
 };
 
 struct process *init_process(void);
 
-/* NOTE: Should be called after fork */
-void run_process(struct shell_info *s, struct process *p, pid_t pgid, int io[3], char bg);
+/* Computes the descriptor table the process starts with: each targets[i]
+   is a copy of the shell descriptor sources[i], or closed if it is -1.
+   The arrays need room for 3 + p->redirect_num entries. Returns the
+   number of entries. */
+size_t resolve_redirections(const struct process *p, const int io[3], int *targets, int *sources);
+
+/* Closes the descriptors the shell opened for the redirections */
+void close_redirections(struct process *p);
+
+/* Starts a relay for each descriptor that the redirections of p send to
+   several outputs, as zsh multios do: n>file more than once, or stdout
+   to a file and to the next stage. The descriptor is redirected to a pipe
+   the relay copies to every output. From the shell the relays are
+   children whose pids go to relays, with room for p->redirect_num, and
+   their number is returned. With relays NULL the calling process becomes
+   the relay and exits with the status of a new child, which returns. */
+size_t split_outputs(struct process *p, const int io[3], pid_t *relays);
+
+/* Waits for the relays returned by split_outputs */
+void wait_relays(const pid_t *relays, size_t n);
+
+/* Runs the process as the stage-th of its pipeline, with the job
+   controls in res if not NULL.
+   NOTE: Should be called after fork */
+void run_process(struct shell_info *s, struct process *p, pid_t pgid, int io[3], char bg,
+                 const struct job_resources *res, size_t stage);
 
 #endif /* PROCESS_H */
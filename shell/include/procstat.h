@@ -0,0 +1,52 @@
+/*
+ALMiSHELL - A POSIX conformant shell prototype.
+Copyright (C) 2017  Henrique C. S. M. Aranha; Lucas E. C. Mello; Lucas H. F. Leal
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PROCSTAT_H
+#define PROCSTAT_H
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <time.h>
+
+/* Live resource use of a process, read from /proc/<pid>/stat and
+   /proc/<pid>/io. The files stay open from one sample to the next and are
+   read again with pread, so a sample costs two reads. */
+struct process_sample {
+    int stat_fd;
+    int io_fd;                  /* -1 if the counters can't be read */
+    uint64_t ticks;             /* user and system CPU time, in clock ticks */
+    struct timespec at;         /* CLOCK_BOOTTIME of the sample */
+
+    char state;                 /* R, S, D, T, Z... as the kernel reports it */
+    double cpu;                 /* % of a CPU since the previous sample, or
+                                   since the process started */
+    uint64_t rss;               /* resident memory, in bytes */
+    uint64_t read_bytes;        /* read and written through system calls */
+    uint64_t write_bytes;
+};
+
+/* Samples the process pid into *sample, which is allocated by the first
+   call. Returns 0 if the process is gone. */
+int sample_process(pid_t pid, struct process_sample **sample);
+
+void delete_process_sample(struct process_sample *sample);
+
+/* Writes bytes as 12.3K, 4.5M... into buffer, with room for 16 chars */
+void format_size(uint64_t bytes, char *buffer);
+
+#endif /* PROCSTAT_H */
@@ -0,0 +1,46 @@
+/*
+ALMiSHELL - A POSIX conformant shell prototype.
+Copyright (C) 2017  Henrique C. S. M. Aranha; Lucas E. C. Mello; Lucas H. F. Leal
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* read and mapfile builtins. The lines of a regular file are read by
+   blocks, kept between calls for the lines that follow, and the file
+   offset is moved to the end of the consumed line, so the commands run
+   next see the rest of the input. Other inputs cannot be given back what
+   was read past the line, they are read one byte at a time. */
+
+#ifndef READ_H
+#define READ_H
+
+#define READ_BLOCK 65536
+
+struct shell_info;
+struct read_buffer;
+
+void delete_read_buffer(struct read_buffer *b);
+
+/* read [-r] [-d delim] [name...], the line is split on IFS, the last
+   name taking the rest of it, and REPLY gets the whole line without a
+   name. Returns 1 at the end of the input. */
+int read_builtin(struct shell_info *s, int fd, char **args);
+
+/* mapfile [-t] [-d delim] [-n count] [-s skip] [name], also readarray.
+   There are no arrays, the lines are stored in name_0, name_1... and name
+   is set to their number, MAPFILE without a name. Without -n the input is
+   consumed to its end, by blocks whatever it is. */
+int mapfile_builtin(struct shell_info *s, int fd, char **args);
+
+#endif /* READ_H */
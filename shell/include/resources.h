@@ -0,0 +1,65 @@
+/*
+ALMiSHELL - A POSIX conformant shell prototype.
+Copyright (C) 2017  Henrique C. S. M. Aranha; Lucas E. C. Mello; Lucas H. F. Leal
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef RESOURCES_H
+#define RESOURCES_H
+
+#include <sys/resource.h>
+
+#include <stddef.h>
+#include <stdio.h>
+
+#define RESOURCES_COMMAND "sched"
+
+struct resource_limit {
+    int resource;               /* RLIMIT_* */
+    struct rlimit limit;
+};
+
+/* CPU and scheduling controls of a job, given by the sched prefix */
+struct job_resources {
+    int *cpus;                  /* allowed CPUs, none keeps the inherited mask */
+    size_t cpu_num;
+    char spread;                /* stage i runs on cpus[i % cpu_num] only */
+    int policy;                 /* SCHED_*, -1 keeps the inherited policy */
+    int nice;                   /* added to the inherited nice value */
+    struct resource_limit *limits;
+    size_t limit_num;
+};
+
+/* Parses "sched [-c cpus] [-r] [-p other|batch|idle] [-n nice]
+   [-l name=value]... command", storing the controls in a new *res.
+   cpus is a list like 0-3,6. Returns the number of words before the
+   command, or -1 after printing an error. */
+int parse_job_resources(struct job_resources **res, char **argv);
+
+void delete_job_resources(struct job_resources *res);
+
+/* Applies the controls to the calling process, stage being its position
+   in the pipeline. Returns -1 after printing an error.
+   NOTE: Should be called after fork */
+int apply_job_resources(const struct job_resources *res, size_t stage);
+
+/* Prints the controls in the sched prefix syntax */
+void print_job_resources(const struct job_resources *res, FILE *out);
+
+/* ulimit [-H|-S] [-a | -c|-d|-f|-l|-n|-s|-t|-u|-v [value|unlimited]],
+   sizes are in kbytes. Returns the exit status. */
+int ulimit_builtin(FILE *out, char **args);
+
+#endif /* RESOURCES_H */
@@ -0,0 +1,33 @@
+/*
+ALMiSHELL - A POSIX conformant shell prototype.
+Copyright (C) 2017  Henrique C. S. M. Aranha; Lucas E. C. Mello; Lucas H. F. Leal
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SCRIPTCACHE_H
+#define SCRIPTCACHE_H
+
+#include <parser.h>
+#include <shell.h>
+
+/* Returns the compiled form of the script at path. If the cache holds a
+   program compiled by this shell version from a script with the same
+   path, size and mtime, it is mapped and returned as is; otherwise the
+   script is compiled and the cache entry replaced. The cache lives in
+   $ALMISHELL_CACHE_DIR, $XDG_CACHE_HOME/almishell or ~/.cache/almishell.
+   Returns NULL, with errno set, if the script can't be read. */
+struct program *load_script(struct shell_info *s, const char *path);
+
+#endif /* SCRIPTCACHE_H */
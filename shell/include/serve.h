@@ -0,0 +1,45 @@
+/*
+ALMiSHELL - A POSIX conformant shell prototype.
+Copyright (C) 2017  Henrique C. S. M. Aranha; Lucas E. C. Mello; Lucas H. F. Leal
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SERVE_H
+#define SERVE_H
+
+#include <shell.h>
+
+/* Local server mode. A warm shell listens on a Unix socket and runs the
+   command lines of its clients, each in a child forked from it, so a
+   request skips the exec and the startup of a new shell.
+
+   A client connects and sends its stdin, stdout and stderr, and
+   optionally a descriptor of its working directory, with SCM_RIGHTS
+   along with the first bytes of the command line. It sends the rest of
+   the line and shuts down its writing side. Once the line has run, the
+   server replies with its $? as an int in host byte order and closes the
+   connection. */
+#define SERVE_OPTION "--serve"
+#define CONNECT_OPTION "--connect"
+
+/* Serves the requests made to the socket at path, replacing a socket left
+   there. Only returns on error, with the exit status of the shell. */
+int serve_socket(struct shell_info *s, const char *path);
+
+/* Runs the command line in the server at path, with the descriptors and
+   the working directory of the caller. Returns its $?. */
+int connect_shell(const char *path, const char *command_line);
+
+#endif /* SERVE_H */
@@ -24,8 +24,20 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <stdio.h>
 
-/* Forward declaration */
+#include <almishell.h>
+
+#define ALMISHELL_VERSION "1.0.0"
+
+#define SHELL_FD_MAX 10         /* exec n>file keeps n open for n below it */
+
+/* Forward declarations */
 struct job;
+struct completion;
+struct var_table;
+struct dir_cache;
+struct function_table;
+struct read_buffer;
+struct process_watch;
 
 enum SHELL_CMD {
     SHELL_EXIT,
@@ -35,40 +47,80 @@ enum SHELL_CMD {
     SHELL_FG,
     SHELL_BG,
     SHELL_ALMISHELL,
+    SHELL_EXPORT,
+    SHELL_UNSET,
+    SHELL_WAIT,
+    SHELL_ULIMIT,
+    SHELL_EXEC,
+    SHELL_RETURN,
+    SHELL_READ,
+    SHELL_MAPFILE,
+    SHELL_READARRAY,
     SHELL_CMD_NUM,
     SHELL_NONE
 };
 
-const char *shell_cmd[SHELL_CMD_NUM];
+extern const char *shell_cmd[SHELL_CMD_NUM];
 
 struct shell_info {
     int terminal;
     int interactive;
+    int builtins;               /* ALMISHELL_BUILTINS was given */
+    int standalone;             /* the shell owns its process, exec may replace it */
+    int tail_exec;              /* the last job of a program may replace the shell */
     pid_t pgid;
     char *current_path;
     struct termios tmodes;
     int run;
+    int last_status;            /* exit status of the last foreground job, for $? */
+    int io[3];                  /* stdin, stdout and stderr of the jobs */
+    char **positional;          /* $0, $1... NULL terminated, not owned */
+    int positional_num;         /* $#, not counting $0 */
+    int fds[SHELL_FD_MAX];      /* shell copy of the descriptor n kept by exec, or -1 */
+
+    struct var_table *vars;
+    struct function_table *functions;
+    int function_depth;         /* calls running in the shell */
+    int returning;              /* return was run, the function body stops */
 
     struct job *first_job, *tail_job;
+    struct process_watch *watch;   /* exits of the job processes, NULL without pidfds */
+
+    struct completion *completion; /* Built on the first Tab */
+    struct dir_cache *dir_cache;   /* Directory listings for globbing */
+    struct read_buffer *read_buffer; /* Block of the file read reads from */
 };
 
 /* Ensures proper shell initialization, making sure the shell is executed in
 foreground, based on
 http://www.gnu.org/software/libc/manual/html_node/Initializing-the-Shell.html#Initializing-the-Shell */
 
-struct shell_info init_shell(void);
+/* flags are the ALMISHELL_* flags of almishell_create */
+struct shell_info init_shell(int flags);
 
+/* Also deletes the jobs left in the job list */
 void delete_shell(struct shell_info *info);
 
+void print_prompt(const char *path);
+
 /*  If it's a builtin command, returns its index in the shell_cmd array,
    else returns -1.
 */
 enum SHELL_CMD is_builtin_command(const char *cmd);
 
-void run_jobs(struct shell_info *sh);
+/* jobs [-l|-v] [-w [seconds]]. -l and -v also list the processes, with
+   their state, CPU use since the last jobs, resident memory and I/O, and
+   the job controls. -w redraws that list every interval until no job
+   runs, or until a line is entered on the terminal. */
+int run_jobs(struct shell_info *sh, FILE *out, char **args);
 
 void fg_bg(struct shell_info *sh, char **args, int id);
 
-void run_builtin_command(struct shell_info *sh, FILE *out, char **args, int id);
+/* wait [-n] [%job|pid ...], returns the exit status of the last operand,
+   or of the first job to complete with -n */
+int wait_jobs(struct shell_info *sh, char **args);
+
+/* Returns the exit status of the builtin, in is its standard input */
+int run_builtin_command(struct shell_info *sh, int in, FILE *out, char **args, int id);
 
 #endif /* SHELL_H */
@@ -0,0 +1,87 @@
+/*
+ALMiSHELL - A POSIX conformant shell prototype.
+Copyright (C) 2017  Henrique C. S. M. Aranha; Lucas E. C. Mello; Lucas H. F. Leal
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+#include <time.h>
+
+#define STATS_COMMAND "stats"   /* almishell stats */
+#define STATS_VAR "ALMISHELL_STATS" /* where the counters are dumped at exit */
+
+enum stats_counter {
+    STATS_LINES,                /* command lines read */
+    STATS_FORKS,
+    STATS_EXEC_FAILURES,        /* reaped with status 126 or 127 */
+    STATS_PIPES,
+    STATS_REAPS,
+    STATS_JOBS,                 /* in the job table */
+    STATS_PEAK_JOBS,
+    STATS_PEAK_HEAP,            /* bytes allocated, sampled at each job */
+    STATS_MEMO_HITS,            /* memo results replayed */
+    STATS_MEMO_MISSES,
+    STATS_COUNTER_NUM
+};
+
+enum stats_timing {
+    STATS_PARSE,                /* compiling a command line */
+    STATS_LAUNCH,               /* launching a job, until its processes are forked */
+    STATS_TIMING_NUM
+};
+
+/* Timing histogram buckets, bucket i counts durations under 2^i us */
+#define STATS_BUCKETS 24
+
+/* Counters of the whole process, shared by every shell context */
+struct shell_stats {
+    unsigned long counters[STATS_COUNTER_NUM];
+    unsigned long histograms[STATS_TIMING_NUM][STATS_BUCKETS];
+    unsigned long timing_num[STATS_TIMING_NUM];
+    double timing_total[STATS_TIMING_NUM]; /* seconds */
+};
+
+extern struct shell_stats shell_stats;
+
+#define STATS_ADD(counter, n) (shell_stats.counters[counter] += (n))
+
+/* Adds the time elapsed since start, from clock_gettime(CLOCK_MONOTONIC),
+   to the histogram */
+void stats_time(enum stats_timing timing, const struct timespec *start);
+
+/* Counts a reaped process with its wait status */
+void stats_reap(int status);
+
+/* Counts jobs added to (delta > 0) or removed from the job table, and
+   samples the heap */
+void stats_job_table(long delta);
+
+void reset_stats(void);
+
+/* Prints the counters and histograms as text, or as key=value lines */
+void print_stats(FILE *out, int key_value);
+
+/* Runs "stats [-k] [-r]": prints the counters, as key=value with -k, and
+   resets them with -r. Returns the exit status. */
+int stats_builtin(FILE *out, char **args);
+
+/* Appends the counters as key=value lines to the file named by value, or
+   to stderr if it is empty or "-" */
+void dump_stats(const char *value);
+
+#endif /* STATS_H */
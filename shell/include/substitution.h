@@ -0,0 +1,36 @@
+/*
+ALMiSHELL - A POSIX conformant shell prototype.
+Copyright (C) 2017  Henrique C. S. M. Aranha; Lucas E. C. Mello; Lucas H. F. Leal
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Process substitution. <(pipeline) and >(pipeline) launch the pipeline
+   as a background job writing to, or reading from, a pipe, and the word
+   becomes the /dev/fd path of the other end, so both sides stream at the
+   same time. The substituted jobs are in the job list like any other. */
+
+#ifndef SUBSTITUTION_H
+#define SUBSTITUTION_H
+
+struct shell_info;
+
+/* Returns true if word is a whole <(...) or >(...) */
+int is_process_substitution(const char *word);
+
+/* Launches the pipeline of the substitution word and returns the shell
+   end of its pipe, close-on-exec, or -1 after reporting an error */
+int substitute_process(struct shell_info *s, const char *word);
+
+#endif /* SUBSTITUTION_H */
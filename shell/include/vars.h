@@ -0,0 +1,85 @@
+/*
+ALMiSHELL - A POSIX conformant shell prototype.
+Copyright (C) 2017  Henrique C. S. M. Aranha; Lucas E. C. Mello; Lucas H. F. Leal
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef VARS_H
+#define VARS_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+/* Shell variable, stored as a single "name=value" string so exported
+   variables can be handed to exec without copying */
+struct variable {
+    char *entry;
+    size_t name_len;
+    char exported;
+    unsigned long hash;
+    struct variable *next;      /* hash chain */
+};
+
+struct var_table {
+    struct variable **buckets;
+    size_t bucket_num;
+    size_t size;
+    size_t exported_num;
+
+    char **envp;                /* cached environment for exec */
+    int envp_dirty;             /* set when an exported variable changes */
+};
+
+/* Creates the table with the variables of env, all of them exported */
+struct var_table *init_vars(char **env);
+
+void delete_vars(struct var_table *t);
+
+/* Returns the value of the variable, or NULL if it is not set */
+const char *get_var(struct var_table *t, const char *name);
+
+/* get_var and set_var for the first len characters of name, which need
+   not be terminated */
+const char *get_var_len(struct var_table *t, const char *name, size_t len);
+void set_var_len(struct var_table *t, const char *name, size_t len, const char *value);
+
+/* Sets the variable, keeping its exported attribute */
+void set_var(struct var_table *t, const char *name, const char *value);
+
+/* Sets the variable from a "name=value" assignment */
+void assign_var(struct var_table *t, const char *assignment);
+
+void export_var(struct var_table *t, const char *name);
+
+void unset_var(struct var_table *t, const char *name);
+
+/* Returns the environment for exec, rebuilt only if an exported variable
+   changed since the last call. The array belongs to the table. */
+char **get_envp(struct var_table *t);
+
+/* Returns a new environment array with the assignments in front of the
+   cached environment entries they do not override. Only the pointer array
+   is allocated, the strings are shared. */
+char **overlay_envp(struct var_table *t, char **assignments);
+
+void print_exported_vars(struct var_table *t, FILE *out);
+
+/* Returns true if word is a valid name followed by '=' */
+int is_assignment(const char *word);
+
+/* Returns the length of the longest valid variable name prefix of str */
+size_t var_name_len(const char *str);
+
+#endif /* VARS_H */
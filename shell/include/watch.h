@@ -0,0 +1,71 @@
+/*
+ALMiSHELL - A POSIX conformant shell prototype.
+Copyright (C) 2017  Henrique C. S. M. Aranha; Lucas E. C. Mello; Lucas H. F. Leal
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef WATCH_H
+#define WATCH_H
+
+#define WATCH_POLL_MS 10        /* period of the checks of what has no descriptor */
+
+/* Forward declarations */
+struct job;
+struct process;
+
+/* Exits of the processes a shell launched, watched through one epoll set
+   kept for the life of the shell. Each process gets a pidfd in the set
+   when it is forked and leaves it when it is reaped, so a wait only looks
+   at the processes that exited. The deadlines of the jobs are timerfds
+   in the same set, enforced wherever the shell waits, and SIGCHLD wakes
+   it up to see the processes that stopped. The jobs are queued in the
+   order they complete. */
+struct process_watch;
+
+/* Returns NULL if the kernel lacks epoll or pidfd_open, the shell then
+   waits with wait4 alone */
+struct process_watch *init_process_watch(void);
+
+void delete_process_watch(struct process_watch *w);
+
+/* Adds p, a process of j that was just forked. Without a descriptor for
+   its pidfd, EMFILE or ENFILE, this is reported once and p is polled
+   every WATCH_POLL_MS until a pidfd can be opened. */
+void watch_process(struct process_watch *w, struct job *j, struct process *p);
+
+/* Arms the deadline of j, a job just launched */
+void watch_deadline(struct process_watch *w, struct job *j);
+
+/* Removes the processes, the deadline and the queued completion of j,
+   which is about to be deleted */
+void unwatch_job(struct process_watch *w, struct job *j);
+
+/* Waits up to timeout milliseconds, -1 for no limit, for watched
+   processes to exit or stop, reaps those that exited and signals the jobs
+   past their deadline. Returns the number of processes that exited or
+   stopped, or -1 on error. */
+int run_process_watch(struct process_watch *w, int timeout);
+
+/* Takes out of the completion queue the job that completed the earliest,
+   among those with waited set if waited is. Returns NULL if there is no
+   such job. */
+struct job *take_completed_job(struct process_watch *w, int waited);
+
+/* Descriptor that becomes readable when run_process_watch has work, for
+   a poll on other descriptors too, or -1 if w is NULL. *timeout is set
+   to the longest such a poll may wait, -1 for no limit. */
+int process_watch_fd(struct process_watch *w, int *timeout);
+
+#endif /* WATCH_H */
@@ -0,0 +1,56 @@
+/*
+ALMiSHELL - A POSIX conformant shell prototype.
+Copyright (C) 2017  Henrique C. S. M. Aranha; Lucas E. C. Mello; Lucas H. F. Leal
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef WILDCARD_H
+#define WILDCARD_H
+
+#include <stddef.h>
+
+#include <shell.h>
+
+/* Pattern compiled once into a token array, see compile_pattern */
+struct pattern;
+
+/* Directory listings kept for the duration of a command line, enabled by
+   setting the GLOBCACHE variable */
+struct dir_cache;
+
+struct pattern *compile_pattern(const char *pattern, size_t len);
+
+void delete_pattern(struct pattern *p);
+
+/* Returns true if name matches the pattern. Names starting with a dot are
+   only matched by patterns starting with a dot. */
+int match_pattern(const struct pattern *p, const char *name);
+
+/* Returns true if word has any of the *, ? or [ wildcards */
+int has_wildcards(const char *word);
+
+/* Performs pathname expansion of word. Returns a NULL terminated array
+   of newly allocated paths sorted in byte order, or NULL if nothing
+   matched. The caller owns both the array and the strings. */
+char **expand_wildcards(struct shell_info *s, const char *word);
+
+struct dir_cache *init_dir_cache(void);
+
+/* Drops the cached listings, called once per command line */
+void clear_dir_cache(struct dir_cache *c);
+
+void delete_dir_cache(struct dir_cache *c);
+
+#endif /* WILDCARD_H */
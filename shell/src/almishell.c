@@ -16,10 +16,17 @@ You should have received a copy of the GNU General Public License
 along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <almishell.h>
 #include <process.h>
 #include <job.h>
 #include <shell.h>
 #include <parser.h>
+#include <lineedit.h>
+#include <wildcard.h>
+#include <scriptcache.h>
+#include <stats.h>
+#include <vars.h>
+#include <serve.h>
 
 #include <sys/types.h>
 #include <sys/wait.h>
@@ -36,25 +43,45 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <stdio.h>
 #include <string.h>
 
-void print_prompt(const char *path)
-{
-    const char *prompt_str = "$ ";
-
-    printf("[%s]%s", path, prompt_str);
-    fflush(stdout);
-}
-
-/* Caller must free the allocated memory */
-char *read_command_line(FILE *input)
+/* Caller must free the allocated memory. At the end of the input, *eof is
+   set and the command is exit. */
+char *read_command_line(struct shell_info *s, FILE *input, int *eof)
 {
     char *command_line = NULL;
     size_t buffer_size = 0;
+    ssize_t command_line_size;
+    int empty;
+
+    /* The terminal is read through the line editor */
+    if(input == stdin && s->interactive) {
+        command_line = edit_line(s);
+
+        if(command_line && command_line[0]) {
+            STATS_ADD(STATS_LINES, 1);
+            return command_line;
+        }
+
+        /* An empty line is not the end of the input */
+        empty = command_line != NULL;
+        free(command_line);
+
+        if(empty)
+            return NULL;
+
+        *eof = 1;
+        printf("\n");
+        fflush(stdout);
+        command_line = (char *) malloc(sizeof(char) * (strlen(shell_cmd[SHELL_EXIT]) + 1));
+        strcpy(command_line, shell_cmd[SHELL_EXIT]);
+        return command_line;
+    }
 
-    ssize_t command_line_size = getline(&command_line, &buffer_size, input);
+    command_line_size = getline(&command_line, &buffer_size, input);
 
     /* If there's at least one character other than newline */
     if(command_line_size > 1) {
         command_line[--command_line_size] = '\0'; /* Remove the newline char */
+        STATS_ADD(STATS_LINES, 1);
         return command_line;
     }
 
@@ -63,6 +90,7 @@ char *read_command_line(FILE *input)
     /* If end of file is reached or CTRL + D is received, the command is exit */
     if(feof(input)) {
         clearerr(input);
+        *eof = 1;
         printf("\n");
         fflush(stdout);
         command_line = (char *) malloc(sizeof(char) * (strlen(shell_cmd[SHELL_EXIT]) + 1));
@@ -86,7 +114,8 @@ char *extract_command_line(int argc, char *argv[])
     for(i = 2; i < argc; ++i)
         command_line_size += strlen(argv[i]) + 1; /* arg + separator char size */
 
-    command_line = (char *) malloc(sizeof(char) * command_line_size);
+    command_line = (char *) malloc(sizeof(char) * (command_line_size + 1));
+    command_line[0] = '\0';
 
     for(i = 2; i < argc; ++i) {
         strcat(command_line, argv[i]);
@@ -98,127 +127,141 @@ char *extract_command_line(int argc, char *argv[])
     return command_line;
 }
 
-int main(int argc, char *argv[])
+static void run_command_line(struct shell_info *s, const char *command_line)
+{
+    struct program *prog = compile_program(command_line);
+
+    almishell_execute(s, prog, NULL, NULL);
+    delete_program(prog);
+}
+
+/* Reads and runs the next command line, and the lines after it while a
+   function definition is open */
+static void run_input(struct shell_info *s)
 {
+    struct program *prog = init_program();
     char *command_line = NULL;
-    FILE *input = stdin;
+    int eof = 0;
+
+    do {
+        while(!command_line) {
+            if(program_incomplete(prog)) {
+                printf("> ");
+                fflush(stdout);
+            } else
+                print_prompt(s->current_path);
+
+            command_line = read_command_line(s, stdin, &eof);
+        }
+
+        /* The exit at the end of the input is not part of a definition */
+        if(eof)
+            finish_program(prog);
+
+        compile_command_line(prog, command_line);
+
+        free(command_line);
+        command_line = NULL;
+    } while(program_incomplete(prog));
+
+    almishell_execute(s, prog, NULL, NULL);
+    delete_program(prog);
+}
+
+int main(int argc, char *argv[])
+{
+    char *command_line = NULL, *script_path = NULL;
+    const char *stats_dump;
+    int status, flags = ALMISHELL_TERMINAL | ALMISHELL_BUILTINS;
+
+    struct shell_info shinfo;
+
+    /* A client hands its command line to a server, no shell is set up */
+    if(argc > 1 && strcmp(argv[1], CONNECT_OPTION) == 0) {
+        if(argc < 4) {
+            printf("almishell: %s: requires a socket and a command\n", argv[1]);
+            return EXIT_FAILURE;
+        }
+
+        command_line = extract_command_line(argc - 1, argv + 1);
+        status = connect_shell(argv[2], command_line);
+        free(command_line);
+
+        return status;
+    }
+
+    /* A server never takes the terminal */
+    if(argc > 1 && strcmp(argv[1], SERVE_OPTION) == 0)
+        flags &= ~ALMISHELL_TERMINAL;
 
-    struct shell_info shinfo = init_shell();
-    struct job *current_job, *previous_job;
+    shinfo = init_shell(flags);
 
-    shinfo.first_job = shinfo.tail_job = NULL;
+    /* $0 is the shell, or the script with its arguments after it */
+    shinfo.positional = argv;
+    shinfo.standalone = 1;
 
     if(argc > 1) {
         if(strcmp(argv[1], "--command") == 0 || strcmp(argv[1], "-c") == 0) {
             if(argc >= 3) {
                 command_line = extract_command_line(argc, argv);
-                shinfo.run = 0; /* Run shell a single time */
             } else {
                 printf("almishell: %s: requires an argument\n", argv[1]);
                 return EXIT_FAILURE;
             }
+        } else if(strcmp(argv[1], SERVE_OPTION) == 0) {
+            if(argc != 3) {
+                printf("almishell: %s: requires a socket\n", argv[1]);
+                return EXIT_FAILURE;
+            }
+
+            status = serve_socket(&shinfo, argv[2]);
+            delete_shell(&shinfo);
+            return status;
         } else if(strcmp(argv[1], "--version") == 0 || strcmp(argv[1], "-v") == 0) {
-            printf("Almishell, version 1.0.0\n");
+            printf("Almishell, version %s\n", ALMISHELL_VERSION);
             return EXIT_FAILURE;
         } else if(argv[1][0] == '-') {
             printf("almishell: %s: invalid option\n", argv[1]);
             return EXIT_FAILURE;
-        } else if(argc > 2) {
-            printf("%s", "almishell: too many arguments");
-            return EXIT_FAILURE;
         } else {
-            input = fopen(argv[1], "r");
-            if(!input) {
-                perror("almishell: fopen");
-                return EXIT_FAILURE;
-            }
+            script_path = argv[1];
+            shinfo.positional = &argv[1];
+            shinfo.positional_num = argc - 2;
         }
     }
 
-    do {
-        struct job *j;
-
-        while(!command_line) {
-            if(input == stdin)
-                print_prompt(shinfo.current_path);
-            command_line = read_command_line(input);
-        }
-
-        j = parse_command_line(command_line);
-
-        if(check_processes(j)) {
-            if(!j) {
-                printf("almishell: syntax error\n");
-            } else {
-                launch_job(&shinfo, j);
-            }
-        } else {
-            if(j->first_process && j->first_process->next)
-                printf("almishell: syntax error\n");
-        }
+    /* A -c string or a script ends with its last job, which can replace
+       the shell instead of being waited for */
+    shinfo.tail_exec = script_path || command_line;
 
-        current_job = shinfo.first_job;
-        previous_job = NULL;
-
-        while(current_job) {
-            int deletedHead = 0;
-
-            if(job_is_completed(current_job)) {
-                struct job *curJob = shinfo.first_job;
-                while(curJob) {
-                    if(curJob->priority > current_job->priority) {
-                        --curJob->priority;
-                    }
-
-                    curJob = curJob->next;
-                }
-
-                if(shinfo.first_job == shinfo.tail_job) {
-                    delete_job(current_job);
-                    current_job = shinfo.first_job = shinfo.tail_job = NULL;
-                } else if(current_job == shinfo.first_job) {
-                    shinfo.first_job = current_job->next;
-                    delete_job(current_job);
-                    current_job = shinfo.first_job;
-                    deletedHead = 1;
-                } else if(current_job == shinfo.tail_job) {
-                    shinfo.tail_job = previous_job;
-
-                    delete_job(current_job);
-
-                    previous_job->next = NULL;
-
-                    current_job = NULL;
-                } else {
-                    previous_job->next = current_job->next;
-                    delete_job(current_job);
-                    current_job = previous_job;
-                }
-            }
-            previous_job = current_job;
-            if(current_job && !deletedHead)
-                current_job = current_job->next;
-        }
+    /* The counters are dumped at exit, so the shell is not replaced */
+    if( (stats_dump = get_var(shinfo.vars, STATS_VAR)) )
+        shinfo.tail_exec = 0;
 
+    if(script_path) {
+        /* Scripts are compiled as a whole, or mapped from the cache */
+        struct program *prog = load_script(&shinfo, script_path);
 
-        if(command_line) {
-            free(command_line);
-            command_line = NULL;
+        if(!prog) {
+            perror("almishell: fopen");
+            return EXIT_FAILURE;
         }
-    } while(shinfo.run);
-
-    current_job = shinfo.first_job;
 
-    while(current_job) {
-        struct job *temp = current_job;
-        current_job = current_job->next;
-        delete_job(temp);
+        almishell_execute(&shinfo, prog, NULL, NULL);
+        delete_program(prog);
+    } else if(command_line) {
+        run_command_line(&shinfo, command_line);
+        free(command_line);
+    } else {
+        while(shinfo.run)
+            run_input(&shinfo);
     }
 
-    delete_shell(&shinfo);
+    if( (stats_dump = get_var(shinfo.vars, STATS_VAR)) )
+        dump_stats(stats_dump);
 
-    if(input != stdin)
-        fclose(input);
+    delete_shell(&shinfo);
 
-    return EXIT_SUCCESS;
+    /* As the last command would, if it was exec'd */
+    return shinfo.last_status;
 }
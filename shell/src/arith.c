@@ -0,0 +1,371 @@
+/*
+ALMiSHELL - A POSIX conformant shell prototype.
+Copyright (C) 2017  Henrique C. S. M. Aranha; Lucas E. C. Mello; Lucas H. F. Leal
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <arith.h>
+#include <vars.h>
+
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct arith {
+    struct shell_info *s;
+    const char *expression;
+    const char *it;
+    int skip;                   /* in a branch that is not evaluated */
+    int error;
+};
+
+struct binary_op {
+    const char *op;
+    int precedence;
+};
+
+/* Longest first, so "<<" is not read as "<" */
+static const struct binary_op binary_ops[] = {
+    {"||", 1}, {"&&", 2}, {"==", 6}, {"!=", 6}, {"<=", 7}, {">=", 7},
+    {"<<", 8}, {">>", 8}, {"|", 3}, {"^", 4}, {"&", 5}, {"<", 7}, {">", 7},
+    {"+", 9}, {"-", 9}, {"*", 10}, {"/", 10}, {"%", 10}
+};
+
+#define BINARY_OP_NUM (sizeof(binary_ops) / sizeof(binary_ops[0]))
+
+/* The operators of op=, longest first */
+static const char *assign_ops[] = {
+    "<<", ">>", "*", "/", "%", "+", "-", "&", "^", "|", ""
+};
+
+#define ASSIGN_OP_NUM (sizeof(assign_ops) / sizeof(assign_ops[0]))
+
+static long parse_assignment(struct arith *a);
+
+static void arith_error(struct arith *a, const char *message)
+{
+    if(!a->error)
+        fprintf(stderr, "almishell: %s: %s\n", a->expression, message);
+    a->error = 1;
+}
+
+static void skip_spaces(struct arith *a)
+{
+    while(isspace((unsigned char) *a->it))
+        ++a->it;
+}
+
+/* Parses an integer constant, decimal, octal with 0 or hex with 0x */
+static long parse_number(struct arith *a, const char *str, const char **end)
+{
+    char *number_end;
+    long value;
+
+    errno = 0;
+    value = strtol(str, &number_end, 0);
+
+    if(number_end == str || isalnum((unsigned char) *number_end) || *number_end == '_') {
+        arith_error(a, "invalid number");
+        return 0;
+    }
+    if(errno == ERANGE)
+        arith_error(a, "value too great");
+
+    *end = number_end;
+    return value;
+}
+
+/* The value of a variable, an unset or empty one is 0 */
+static long variable_value(struct arith *a, const char *name, size_t len)
+{
+    const char *value = get_var_len(a->s->vars, name, len), *end;
+    long n;
+
+    if(!value)
+        return 0;
+
+    while(isspace((unsigned char) *value))
+        ++value;
+    if(!*value)
+        return 0;
+
+    n = parse_number(a, value, &end);
+    while(!a->error && isspace((unsigned char) *end))
+        ++end;
+    if(!a->error && *end)
+        arith_error(a, "invalid number");
+
+    return n;
+}
+
+static long apply_binary(struct arith *a, const char *op, long x, long y)
+{
+    /* Nothing can fail in a branch that is not taken */
+    if(a->skip || a->error)
+        return 0;
+
+    switch(op[0]) {
+    case '+':
+        if((y > 0 && x > LONG_MAX - y) || (y < 0 && x < LONG_MIN - y))
+            break;
+        return x + y;
+
+    case '-':
+        if((y < 0 && x > LONG_MAX + y) || (y > 0 && x < LONG_MIN + y))
+            break;
+        return x - y;
+
+    case '*':
+        if(x && y && (x > 0 ? (y > 0 ? x > LONG_MAX / y : y < LONG_MIN / x)
+                            : (y > 0 ? x < LONG_MIN / y : y < LONG_MAX / x)))
+            break;
+        return x * y;
+
+    case '/':
+    case '%':
+        if(!y) {
+            arith_error(a, "division by zero");
+            return 0;
+        }
+        if(x == LONG_MIN && y == -1)
+            break;
+        return op[0] == '/' ? x / y : x % y;
+
+    case '<':
+    case '>':
+        if(op[1] == op[0]) {
+            if(y < 0 || y >= (long) (sizeof(long) * CHAR_BIT)) {
+                arith_error(a, "shift count out of range");
+                return 0;
+            }
+            return op[0] == '<' ? (long) ((unsigned long) x << y) : x >> y;
+        }
+        if(op[1] == '=')
+            return op[0] == '<' ? x <= y : x >= y;
+        return op[0] == '<' ? x < y : x > y;
+
+    case '=': return x == y;
+    case '!': return x != y;
+    case '&': return x & y;
+    case '^': return x ^ y;
+    case '|': return x | y;
+    }
+
+    arith_error(a, "overflow");
+    return 0;
+}
+
+static long parse_primary(struct arith *a)
+{
+    const char *start;
+    size_t len;
+    long value;
+
+    skip_spaces(a);
+    start = a->it;
+
+    if(*a->it == '(') {
+        ++a->it;
+        value = parse_assignment(a);
+        skip_spaces(a);
+        if(*a->it != ')')
+            arith_error(a, "missing )");
+        else
+            ++a->it;
+        return value;
+    }
+
+    if(isdigit((unsigned char) *a->it))
+        return parse_number(a, start, &a->it);
+
+    if( (len = var_name_len(a->it)) ) {
+        a->it += len;
+        return variable_value(a, start, len);
+    }
+
+    arith_error(a, *a->it ? "syntax error" : "operand expected");
+    return 0;
+}
+
+static long parse_unary(struct arith *a)
+{
+    long value;
+    char op;
+
+    skip_spaces(a);
+    op = *a->it;
+
+    if(!op || !strchr("+-~!", op))
+        return parse_primary(a);
+
+    ++a->it;
+    value = parse_unary(a);
+
+    switch(op) {
+    case '-':
+        if(value == LONG_MIN) {
+            if(!a->skip)
+                arith_error(a, "overflow");
+            return 0;
+        }
+        return -value;
+    case '~':
+        return ~value;
+    case '!':
+        return !value;
+    }
+
+    return value;
+}
+
+/* The binary operator at the current position, NULL if there is none */
+static const struct binary_op *peek_binary(struct arith *a)
+{
+    size_t i, len;
+
+    skip_spaces(a);
+
+    for(i = 0; i < BINARY_OP_NUM; ++i) {
+        len = strlen(binary_ops[i].op);
+        if(strncmp(a->it, binary_ops[i].op, len))
+            continue;
+
+        /* op= is an assignment, == and the like were matched before */
+        if(a->it[len] == '=' && binary_ops[i].op[len - 1] != '=')
+            return NULL;
+
+        return &binary_ops[i];
+    }
+
+    return NULL;
+}
+
+/* Precedence climbing over the binary operators */
+static long parse_binary(struct arith *a, int min_precedence)
+{
+    const struct binary_op *op;
+    long x = parse_unary(a), y;
+    int skip;
+
+    while(!a->error && (op = peek_binary(a)) && op->precedence >= min_precedence) {
+        a->it += strlen(op->op);
+
+        if(!strcmp(op->op, "&&") || !strcmp(op->op, "||")) {
+            /* The right operand is only evaluated if it decides */
+            skip = a->skip;
+            a->skip = skip || (op->op[0] == '&' ? !x : x != 0);
+            y = parse_binary(a, op->precedence + 1);
+            a->skip = skip;
+            x = op->op[0] == '&' ? x && y : x || y;
+        } else {
+            y = parse_binary(a, op->precedence + 1);
+            x = apply_binary(a, op->op, x, y);
+        }
+    }
+
+    return x;
+}
+
+static long parse_conditional(struct arith *a)
+{
+    long condition = parse_binary(a, 1), yes, no;
+    int skip = a->skip;
+
+    skip_spaces(a);
+    if(a->error || *a->it != '?')
+        return condition;
+
+    ++a->it;
+    a->skip = skip || !condition;
+    yes = parse_assignment(a);
+
+    skip_spaces(a);
+    if(*a->it != ':') {
+        arith_error(a, "missing :");
+        return 0;
+    }
+
+    ++a->it;
+    a->skip = skip || condition;
+    no = parse_conditional(a);
+    a->skip = skip;
+
+    return condition ? yes : no;
+}
+
+static long parse_assignment(struct arith *a)
+{
+    const char *name, *op;
+    size_t len, i, op_len = 0;
+    char number[32];
+    long value;
+
+    skip_spaces(a);
+    name = a->it;
+    len = var_name_len(name);
+
+    for(op = name + len; isspace((unsigned char) *op); ++op);
+
+    for(i = 0; len && i < ASSIGN_OP_NUM; ++i) {
+        op_len = strlen(assign_ops[i]);
+        if(!strncmp(op, assign_ops[i], op_len) && op[op_len] == '=' && op[op_len + 1] != '=')
+            break;
+    }
+
+    if(!len || i == ASSIGN_OP_NUM)
+        return parse_conditional(a);
+
+    a->it = op + op_len + 1;
+    value = parse_assignment(a);
+
+    if(op_len)
+        value = apply_binary(a, assign_ops[i], variable_value(a, name, len), value);
+
+    if(!a->skip && !a->error) {
+        sprintf(number, "%ld", value);
+        set_var_len(a->s->vars, name, len, number);
+    }
+
+    return value;
+}
+
+int evaluate_arithmetic(struct shell_info *s, const char *expression, long *result)
+{
+    struct arith a;
+
+    a.s = s;
+    a.expression = expression;
+    a.it = expression;
+    a.skip = 0;
+    a.error = 0;
+
+    /* $(()) is 0 */
+    skip_spaces(&a);
+    if(!*a.it) {
+        *result = 0;
+        return 0;
+    }
+
+    *result = parse_assignment(&a);
+
+    skip_spaces(&a);
+    if(*a.it)
+        arith_error(&a, "syntax error");
+
+    return a.error ? -1 : 0;
+}
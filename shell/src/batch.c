@@ -0,0 +1,162 @@
+/*
+ALMiSHELL - A POSIX conformant shell prototype.
+Copyright (C) 2017  Henrique C. S. M. Aranha; Lucas E. C. Mello; Lucas H. F. Leal
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <batch.h>
+
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <unistd.h>
+#include <limits.h>
+#include <errno.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Kept free for the auxiliary vector and the program name, as xargs does */
+#define EXEC_HEADROOM 2048
+
+/* Size an argument takes in the exec argument space */
+#define ARG_SIZE(arg) (strlen(arg) + 1 + sizeof(char *))
+
+size_t exec_arg_space(char **envp)
+{
+    long arg_max = sysconf(_SC_ARG_MAX);
+    size_t used = EXEC_HEADROOM + sizeof(char *);
+
+    if(arg_max <= 0)
+        arg_max = _POSIX_ARG_MAX;
+
+    for(; envp && *envp; ++envp)
+        used += ARG_SIZE(*envp);
+
+    return (size_t) arg_max > used ? (size_t) arg_max - used : 0;
+}
+
+/* Waits for one chunk, keeping the highest status in *result */
+static void wait_chunk(int *result)
+{
+    int status, code;
+
+    while(wait(&status) < 0) {
+        if(errno != EINTR) {
+            *result = 1;
+            return;
+        }
+    }
+
+    if(WIFEXITED(status))
+        code = WEXITSTATUS(status);
+    else
+        code = 128 + WTERMSIG(status);
+
+    if(code > *result)
+        *result = code;
+}
+
+void run_batch(char **argv, char **envp)
+{
+    size_t space = exec_arg_space(envp), fixed_size = sizeof(char *), size;
+    int parallel = 1, running = 0, result = 0, argc, command, items, fixed_num, i, n;
+    char **chunk, *end;
+    pid_t pid;
+
+    for(argc = 0; argv[argc]; ++argc);
+
+    command = 1;
+    if(argv[command] && !strncmp(argv[command], "-P", 2)) {
+        const char *value = argv[command][2] ? &argv[command][2] : argv[++command];
+
+        parallel = value ? (int) strtol(value, &end, 10) : 0;
+        if(!value || *end || parallel < 1) {
+            fprintf(stderr, "almishell: %s: -P: invalid number\n", BATCH_COMMAND);
+            _exit(2);
+        }
+        ++command;
+    }
+
+    if(command >= argc) {
+        fprintf(stderr, "usage: %s [-P n] command [args] [{}] items...\n", BATCH_COMMAND);
+        _exit(2);
+    }
+
+    /* The items start after {}, or after the command name without it */
+    for(items = command; items < argc && strcmp(argv[items], "{}"); ++items);
+    fixed_num = items < argc ? items - command : 1;
+    items = items < argc ? items + 1 : command + 1;
+
+    for(i = command; i < command + fixed_num; ++i)
+        fixed_size += ARG_SIZE(argv[i]);
+
+    if(fixed_size > space) {
+        fprintf(stderr, "almishell: %s: %s\n", argv[command], strerror(E2BIG));
+        _exit(126);
+    }
+
+    chunk = (char **) malloc((fixed_num + argc - items + 1) * sizeof(char *));
+    memcpy(chunk, &argv[command], fixed_num * sizeof(char *));
+
+    do {
+        /* Take as many items as fit in a single exec */
+        for(n = fixed_num, size = fixed_size; items < argc; ++items, ++n) {
+            if(size + ARG_SIZE(argv[items]) > space)
+                break;
+            size += ARG_SIZE(argv[items]);
+            chunk[n] = argv[items];
+        }
+
+        if(n == fixed_num && items < argc) {
+            fprintf(stderr, "almishell: %s: %.32s...: %s\n", argv[command],
+                    argv[items++], strerror(E2BIG));
+            if(result < 126)
+                result = 126;
+            continue;
+        }
+
+        chunk[n] = NULL;
+
+        if(running == parallel) {
+            wait_chunk(&result);
+            --running;
+        }
+
+        fflush(stdout);
+        pid = fork();
+
+        if(pid == 0) {
+            execvp(chunk[0], chunk);
+            i = errno == ENOENT ? 127 : 126;
+            perror("almishell: execvp");
+            _exit(i);
+        } else if(pid < 0) {
+            perror("almishell: fork");
+            result = 126;
+            break;
+        }
+
+        ++running;
+    } while(items < argc);
+
+    while(running--)
+        wait_chunk(&result);
+
+    free(chunk);
+
+    _exit(result);
+}
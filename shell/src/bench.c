@@ -0,0 +1,415 @@
+/*
+ALMiSHELL - A POSIX conformant shell prototype.
+Copyright (C) 2017  Henrique C. S. M. Aranha; Lucas E. C. Mello; Lucas H. F. Leal
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <bench.h>
+#include <job.h>
+
+#include <sys/resource.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum bench_metric {
+    BENCH_WALL,
+    BENCH_USER,
+    BENCH_SYS,
+    BENCH_METRIC_NUM
+};
+
+static const char *metric_names[BENCH_METRIC_NUM] = {"wall", "user", "sys"};
+
+struct bench_options {
+    long runs;
+    long warmups;
+    long parallel;
+    const char *format;
+};
+
+/* A run in progress */
+struct bench_run {
+    struct job *j;
+    struct timespec start;
+};
+
+static char *copy_string(const char *str)
+{
+    char *copy = (char *) malloc(strlen(str) + 1);
+
+    return strcpy(copy, str);
+}
+
+static char **copy_words(char **words)
+{
+    char **copy;
+    int n;
+
+    if(!words)
+        return NULL;
+
+    for(n = 0; words[n]; ++n);
+    copy = (char **) malloc((n + 1) * sizeof(char *));
+    for(n = 0; words[n]; ++n)
+        copy[n] = copy_string(words[n]);
+    copy[n] = NULL;
+
+    return copy;
+}
+
+/* Copies the job, without its first skip words. The copies use the
+   redirections j opened, which stay with j. */
+static struct job *copy_job(struct job *j, int skip, char background)
+{
+    struct job *copy = init_job(j->command, background);
+    struct process_node *node, **next = &copy->first_process;
+    struct process *p;
+    size_t i;
+
+    memcpy(copy->io, j->io, sizeof(copy->io));
+
+    for(node = j->first_process; node; node = node->next) {
+        p = init_process();
+        p->argv = copy_words(node == j->first_process ? node->p->argv + skip : node->p->argv);
+        p->assign = copy_words(node->p->assign);
+        p->redirect_failed = node->p->redirect_failed;
+
+        if( (p->redirect_num = node->p->redirect_num) ) {
+            p->redirects = (struct redirection *) malloc(p->redirect_num
+                                                         * sizeof(struct redirection));
+            memcpy(p->redirects, node->p->redirects, p->redirect_num * sizeof(struct redirection));
+            for(i = 0; i < p->redirect_num; ++i)
+                p->redirects[i].opened = 0;
+        }
+
+        *next = (struct process_node *) malloc(sizeof(struct process_node));
+        (*next)->p = p;
+        (*next)->next = NULL;
+        next = &(*next)->next;
+        ++copy->size;
+    }
+
+    return copy;
+}
+
+static int parse_count(const char *value, long *count, long min)
+{
+    char *end;
+
+    *count = value ? strtol(value, &end, 10) : 0;
+
+    return value && value[0] && !*end && *count >= min ? 0 : -1;
+}
+
+/* Returns the number of words before the command, or -1 after printing
+   an error */
+static int parse_bench(char **argv, struct bench_options *o)
+{
+    int i, invalid;
+
+    o->runs = 10;
+    o->warmups = 0;
+    o->parallel = 1;
+    o->format = "text";
+
+    for(i = 1; argv[i] && argv[i][0] == '-'; i += 2) {
+        if(!strcmp(argv[i], "--")) {
+            ++i;
+            break;
+        }
+
+        if(!strcmp(argv[i], "-n"))
+            invalid = parse_count(argv[i + 1], &o->runs, 1);
+        else if(!strcmp(argv[i], "-w"))
+            invalid = parse_count(argv[i + 1], &o->warmups, 0);
+        else if(!strcmp(argv[i], "-j"))
+            invalid = parse_count(argv[i + 1], &o->parallel, 1);
+        else if(!strcmp(argv[i], "-f")) {
+            o->format = argv[i + 1];
+            invalid = !o->format || (strcmp(o->format, "text") && strcmp(o->format, "csv")
+                                     && strcmp(o->format, "json"));
+        } else {
+            fprintf(stderr, "almishell: %s: %s: invalid option\n", BENCH_COMMAND, argv[i]);
+            return -1;
+        }
+
+        if(invalid) {
+            fprintf(stderr, "almishell: %s: %s: invalid value\n", BENCH_COMMAND,
+                    argv[i + 1] ? argv[i + 1] : argv[i]);
+            return -1;
+        }
+    }
+
+    if(!argv[i]) {
+        fprintf(stderr, "usage: %s [-n runs] [-w warmups] [-j parallel] "
+                "[-f text|csv|json] command\n", BENCH_COMMAND);
+        return -1;
+    }
+
+    return i;
+}
+
+static double elapsed_ms(const struct timespec *start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (now.tv_sec - start->tv_sec) * 1e3 + (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+static double timeval_ms(const struct timeval *t)
+{
+    return t->tv_sec * 1e3 + t->tv_usec / 1e3;
+}
+
+/* Records the times of a completed run, and returns its exit status */
+static int record_run(struct job *j, const struct timespec *start, double *samples[])
+{
+    struct process_node *node;
+    double user = 0, sys = 0;
+
+    for(node = j->first_process; node; node = node->next) {
+        user += timeval_ms(&node->p->usage.ru_utime);
+        sys += timeval_ms(&node->p->usage.ru_stime);
+    }
+
+    if(samples) {
+        *samples[BENCH_WALL]++ = elapsed_ms(start);
+        *samples[BENCH_USER]++ = user;
+        *samples[BENCH_SYS]++ = sys;
+    }
+
+    return job_exit_status(j);
+}
+
+/* Runs count copies of j, parallel at a time, storing their times in the
+   samples if not NULL. Returns the status of the last failed run. */
+static int run_copies(struct shell_info *s, struct job *j, int skip, long count,
+                      long parallel, double *samples[])
+{
+    struct bench_run *running = (struct bench_run *) malloc(parallel * sizeof(struct bench_run));
+    struct job **jobs;
+    struct process **procs;
+    struct process_node *node;
+    struct job *done;
+    long started = 0, active = 0, i;
+    size_t n, capacity = parallel * j->size;
+    int status = 0, run_status;
+
+    jobs = (struct job **) malloc(capacity * sizeof(struct job *));
+    procs = (struct process **) malloc(capacity * sizeof(struct process *));
+
+    while(started < count || active) {
+        /* A single run is a foreground job, like the command alone */
+        while(started < count && active < parallel) {
+            running[active].j = copy_job(j, skip, parallel > 1 ? 'b' : j->background);
+            clock_gettime(CLOCK_MONOTONIC, &running[active].start);
+            launch_job(s, running[active].j);
+            ++started;
+            ++active;
+        }
+
+        for(n = 0, i = 0; i < active; ++i) {
+            for(node = running[i].j->first_process; node; node = node->next) {
+                jobs[n] = running[i].j;
+                procs[n++] = node->p;
+            }
+        }
+
+        /* Stopped runs are given up on */
+        done = NULL;
+        for(i = 0; i < active && !done; ++i)
+            if(job_is_completed(running[i].j) || job_is_stopped(running[i].j))
+                done = running[i].j;
+
+        if(!done && !(done = wait_processes(s, jobs, procs, n, 1)))
+            done = running[0].j;
+
+        for(i = 0; running[i].j != done; ++i);
+
+        if((run_status = record_run(done, &running[i].start, samples)))
+            status = run_status;
+
+        remove_job(s, done);
+        running[i] = running[--active];
+    }
+
+    free(jobs);
+    free(procs);
+    free(running);
+
+    return status;
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *) a, y = *(const double *) b;
+
+    return x < y ? -1 : x > y;
+}
+
+/* Newton's method, so the library does not need libm */
+static double square_root(double x)
+{
+    double r = x > 1 ? x : 1;
+    int i;
+
+    if(x <= 0)
+        return 0;
+
+    for(i = 0; i < 64; ++i)
+        r = (r + x / r) / 2;
+
+    return r;
+}
+
+struct summary {
+    double min, mean, p50, p90, p99, max, stddev;
+};
+
+static void summarize(double *samples, long n, struct summary *r)
+{
+    double variance = 0;
+    long i;
+
+    qsort(samples, n, sizeof(double), compare_doubles);
+
+    for(r->mean = 0, i = 0; i < n; ++i)
+        r->mean += samples[i] / n;
+    for(i = 0; i < n; ++i)
+        variance += (samples[i] - r->mean) * (samples[i] - r->mean) / n;
+
+    r->min = samples[0];
+    r->p50 = samples[(n - 1) * 50 / 100];
+    r->p90 = samples[(n - 1) * 90 / 100];
+    r->p99 = samples[(n - 1) * 99 / 100];
+    r->max = samples[n - 1];
+    r->stddev = square_root(variance);
+}
+
+static void print_json_string(FILE *out, const char *str)
+{
+    fputc('"', out);
+
+    for(; *str; ++str) {
+        if(*str == '"' || *str == '\\')
+            fprintf(out, "\\%c", *str);
+        else if((unsigned char) *str < 0x20)
+            fprintf(out, "\\u%04x", (unsigned char) *str);
+        else
+            fputc(*str, out);
+    }
+
+    fputc('"', out);
+}
+
+static void print_report(FILE *out, const struct bench_options *o, const char *command,
+                         const struct summary *r)
+{
+    int m;
+
+    if(!strcmp(o->format, "csv")) {
+        fprintf(out, "metric,runs,min,mean,p50,p90,p99,max,stddev\n");
+        for(m = 0; m < BENCH_METRIC_NUM; ++m)
+            fprintf(out, "%s_ms,%ld,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f\n", metric_names[m],
+                    o->runs, r[m].min, r[m].mean, r[m].p50, r[m].p90, r[m].p99, r[m].max,
+                    r[m].stddev);
+    } else if(!strcmp(o->format, "json")) {
+        fprintf(out, "{\"command\": ");
+        print_json_string(out, command);
+        fprintf(out, ", \"runs\": %ld, \"warmups\": %ld, \"parallel\": %ld", o->runs,
+                o->warmups, o->parallel);
+        for(m = 0; m < BENCH_METRIC_NUM; ++m)
+            fprintf(out, ", \"%s_ms\": {\"min\": %.3f, \"mean\": %.3f, \"p50\": %.3f, "
+                    "\"p90\": %.3f, \"p99\": %.3f, \"max\": %.3f, \"stddev\": %.3f}",
+                    metric_names[m], r[m].min, r[m].mean, r[m].p50, r[m].p90, r[m].p99,
+                    r[m].max, r[m].stddev);
+        fprintf(out, "}\n");
+    } else {
+        fprintf(out, "%s: %ld runs, %ld warmups, %ld parallel\n", command, o->runs,
+                o->warmups, o->parallel);
+        fprintf(out, "%-8s %10s %10s %10s %10s %10s %10s %10s\n", "ms", "min", "mean",
+                "p50", "p90", "p99", "max", "stddev");
+        for(m = 0; m < BENCH_METRIC_NUM; ++m)
+            fprintf(out, "%-8s %10.3f %10.3f %10.3f %10.3f %10.3f %10.3f %10.3f\n",
+                    metric_names[m], r[m].min, r[m].mean, r[m].p50, r[m].p90, r[m].p99,
+                    r[m].max, r[m].stddev);
+    }
+
+    fflush(out);
+}
+
+/* Marks the processes of j as run, with the status */
+static void complete_job(struct job *j, int status)
+{
+    struct process_node *node;
+
+    for(node = j->first_process; node; node = node->next) {
+        node->p->status = status << 8;
+        node->p->completed = 1;
+    }
+}
+
+void bench_job(struct shell_info *s, struct job *j)
+{
+    struct bench_options o;
+    struct summary summaries[BENCH_METRIC_NUM];
+    double *samples[BENCH_METRIC_NUM], *cursors[BENCH_METRIC_NUM];
+    const char *command;
+    int skip = parse_bench(j->first_process->p->argv, &o), status, m;
+    FILE *out;
+
+    if(skip < 0) {
+        complete_job(j, 2);
+        return;
+    }
+
+    /* The report names the command without the bench words */
+    command = strstr(j->command, j->first_process->p->argv[skip]);
+    if(!command)
+        command = j->command;
+
+    for(m = 0; m < BENCH_METRIC_NUM; ++m)
+        cursors[m] = samples[m] = (double *) malloc(o.runs * sizeof(double));
+
+    run_copies(s, j, skip, o.warmups, o.parallel, NULL);
+    status = run_copies(s, j, skip, o.runs, o.parallel, cursors);
+
+    for(m = 0; m < BENCH_METRIC_NUM; ++m)
+        summarize(samples[m], o.runs, &summaries[m]);
+
+    /* The report goes to the stdout of the shell, the redirections are
+       the command's */
+    fflush(stdout);
+    out = j->io[1] == STDOUT_FILENO ? stdout
+          : fdopen(fcntl(j->io[1], F_DUPFD_CLOEXEC, 3), "w");
+
+    if(out) {
+        print_report(out, &o, command, summaries);
+        if(out != stdout)
+            fclose(out);
+    }
+
+    for(m = 0; m < BENCH_METRIC_NUM; ++m)
+        free(samples[m]);
+
+    complete_job(j, status);
+}
@@ -0,0 +1,453 @@
+/*
+ALMiSHELL - A POSIX conformant shell prototype.
+Copyright (C) 2017  Henrique C. S. M. Aranha; Lucas E. C. Mello; Lucas H. F. Leal
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <complete.h>
+#include <job.h>
+#include <vars.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <dirent.h>
+#include <fcntl.h>
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Trie node, children are kept as a sibling list sorted by character, so a
+   depth first walk yields the words already in order */
+struct trie_node {
+    char c;
+    unsigned int count;         /* number of sources providing this word */
+    struct trie_node *child;
+    struct trie_node *sibling;
+};
+
+/* A PATH directory whose executables are in the trie */
+struct path_dir {
+    char *path;
+    struct timespec mtime;
+    ino_t ino;
+    char **names;
+    size_t names_num;
+    unsigned long generation;   /* last refresh that found it in PATH */
+    struct path_dir *next;
+};
+
+struct completion {
+    struct trie_node root;
+    struct path_dir *dirs;
+    unsigned long generation;
+    int builtins_loaded;
+};
+
+struct candidates {
+    char **v;
+    size_t size;
+    size_t capacity;
+};
+
+struct completion *init_completion(void)
+{
+    struct completion *c = (struct completion *) calloc(1, sizeof(struct completion));
+
+    return c;
+}
+
+static void delete_trie(struct trie_node *node)
+{
+    while(node) {
+        struct trie_node *next = node->sibling;
+
+        delete_trie(node->child);
+        free(node);
+        node = next;
+    }
+}
+
+static void delete_path_dir(struct path_dir *d)
+{
+    size_t i;
+
+    for(i = 0; i < d->names_num; ++i)
+        free(d->names[i]);
+
+    free(d->names);
+    free(d->path);
+    free(d);
+}
+
+void delete_completion(struct completion *c)
+{
+    struct path_dir *d;
+
+    if(!c)
+        return;
+
+    while( (d = c->dirs) ) {
+        c->dirs = d->next;
+        delete_path_dir(d);
+    }
+
+    delete_trie(c->root.child);
+    free(c);
+}
+
+/* Adds delta to the count of word, creating the nodes on the way */
+static void trie_add(struct trie_node *root, const char *word, int delta)
+{
+    struct trie_node *node = root;
+
+    for(; *word; ++word) {
+        struct trie_node **link = &node->child;
+
+        while(*link && (*link)->c < *word)
+            link = &(*link)->sibling;
+
+        if(!*link || (*link)->c != *word) {
+            struct trie_node *n = (struct trie_node *) calloc(1, sizeof(struct trie_node));
+
+            n->c = *word;
+            n->sibling = *link;
+            *link = n;
+        }
+
+        node = *link;
+    }
+
+    node->count += delta;
+}
+
+static void scan_path_dir(struct completion *c, struct path_dir *d)
+{
+    DIR *dir = opendir(d->path);
+    struct dirent *entry;
+    struct stat st;
+    size_t capacity = 0;
+
+    if(!dir)
+        return;
+
+    while( (entry = readdir(dir)) ) {
+        if(entry->d_name[0] == '.' && (!entry->d_name[1] || !strcmp(entry->d_name, "..")))
+            continue;
+
+        if(fstatat(dirfd(dir), entry->d_name, &st, 0) < 0
+           || !S_ISREG(st.st_mode) || !(st.st_mode & 0111))
+            continue;
+
+        if(d->names_num == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            d->names = (char **) realloc(d->names, capacity * sizeof(char *));
+        }
+
+        d->names[d->names_num] = (char *) malloc(strlen(entry->d_name) + 1);
+        strcpy(d->names[d->names_num++], entry->d_name);
+
+        trie_add(&c->root, entry->d_name, 1);
+    }
+
+    closedir(dir);
+}
+
+static void drop_path_dir(struct completion *c, struct path_dir *d)
+{
+    size_t i;
+
+    for(i = 0; i < d->names_num; ++i) {
+        trie_add(&c->root, d->names[i], -1);
+        free(d->names[i]);
+    }
+
+    free(d->names);
+    d->names = NULL;
+    d->names_num = 0;
+}
+
+/* Brings the trie up to date with PATH. Only directories that are new or
+   whose mtime changed since the last call are read again. */
+static void refresh_completion(struct completion *c, const char *path_env)
+{
+    char *path, *dir_path, *saveptr = NULL;
+    struct path_dir **link, *d;
+    struct stat st;
+    int i;
+
+    if(!c->builtins_loaded) {
+        for(i = 0; i < SHELL_CMD_NUM; ++i)
+            trie_add(&c->root, shell_cmd[i], 1);
+        c->builtins_loaded = 1;
+    }
+
+    ++c->generation;
+
+    path = (char *) malloc(strlen(path_env ? path_env : "") + 1);
+    strcpy(path, path_env ? path_env : "");
+
+    for(dir_path = strtok_r(path, ":", &saveptr); dir_path;
+        dir_path = strtok_r(NULL, ":", &saveptr)) {
+        for(d = c->dirs; d; d = d->next)
+            if(!strcmp(d->path, dir_path))
+                break;
+
+        if(d && d->generation == c->generation) /* Repeated PATH entry */
+            continue;
+
+        if(stat(dir_path, &st) < 0 || !S_ISDIR(st.st_mode))
+            continue;
+
+        if(!d) {
+            d = (struct path_dir *) calloc(1, sizeof(struct path_dir));
+            d->path = (char *) malloc(strlen(dir_path) + 1);
+            strcpy(d->path, dir_path);
+            d->next = c->dirs;
+            c->dirs = d;
+        } else if(d->ino == st.st_ino
+                  && d->mtime.tv_sec == st.st_mtim.tv_sec
+                  && d->mtime.tv_nsec == st.st_mtim.tv_nsec) {
+            d->generation = c->generation;
+            continue;
+        } else {
+            drop_path_dir(c, d);
+        }
+
+        d->ino = st.st_ino;
+        d->mtime = st.st_mtim;
+        d->generation = c->generation;
+        scan_path_dir(c, d);
+    }
+
+    free(path);
+
+    /* Forget directories that left PATH */
+    link = &c->dirs;
+    while( (d = *link) ) {
+        if(d->generation != c->generation) {
+            *link = d->next;
+            drop_path_dir(c, d);
+            delete_path_dir(d);
+        } else {
+            link = &d->next;
+        }
+    }
+}
+
+static void add_candidate(struct candidates *cands, const char *prefix, size_t prefix_len,
+                          const char *suffix)
+{
+    size_t suffix_len = strlen(suffix);
+    char *word = (char *) malloc(prefix_len + suffix_len + 1);
+
+    memcpy(word, prefix, prefix_len);
+    memcpy(word + prefix_len, suffix, suffix_len + 1);
+
+    if(cands->size + 1 >= cands->capacity) {
+        cands->capacity = cands->capacity ? cands->capacity * 2 : 16;
+        cands->v = (char **) realloc(cands->v, cands->capacity * sizeof(char *));
+    }
+
+    cands->v[cands->size++] = word;
+    cands->v[cands->size] = NULL;
+}
+
+/* Depth first walk adding every word below node, buf holds the word so far */
+static void collect_words(struct trie_node *node, char **buf, size_t *buf_size, size_t len,
+                          struct candidates *cands)
+{
+    for(; node; node = node->sibling) {
+        if(len + 2 > *buf_size) {
+            *buf_size *= 2;
+            *buf = (char *) realloc(*buf, *buf_size);
+        }
+
+        (*buf)[len] = node->c;
+        (*buf)[len + 1] = '\0';
+
+        if(node->count)
+            add_candidate(cands, *buf, len + 1, "");
+
+        collect_words(node->child, buf, buf_size, len + 1, cands);
+    }
+}
+
+static void complete_command(struct completion *c, const char *path_env, const char *word,
+                             struct candidates *cands)
+{
+    struct trie_node *node = &c->root;
+    size_t len = strlen(word), buf_size = len + 64;
+    const char *it;
+    char *buf;
+
+    refresh_completion(c, path_env);
+
+    for(it = word; *it && node; ++it) {
+        node = node->child;
+        while(node && node->c != *it)
+            node = node->sibling;
+    }
+
+    if(!node)
+        return;
+
+    if(node->count && len)
+        add_candidate(cands, word, len, "");
+
+    buf = (char *) malloc(buf_size);
+    strcpy(buf, word);
+    collect_words(node->child, &buf, &buf_size, len, cands);
+    free(buf);
+}
+
+static int compare_words(const void *a, const void *b)
+{
+    return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+static void complete_file(const char *word, struct candidates *cands)
+{
+    const char *slash = strrchr(word, '/'), *prefix = slash ? slash + 1 : word;
+    size_t dir_len = slash ? (size_t) (slash - word) + 1 : 0, prefix_len = strlen(prefix);
+    char *dir_path = (char *) malloc(dir_len + 2);
+    struct dirent *entry;
+    struct stat st;
+    DIR *dir;
+
+    if(dir_len) {
+        memcpy(dir_path, word, dir_len);
+        dir_path[dir_len] = '\0';
+    } else {
+        strcpy(dir_path, ".");
+    }
+
+    dir = opendir(dir_path);
+    free(dir_path);
+
+    if(!dir)
+        return;
+
+    while( (entry = readdir(dir)) ) {
+        /* Hidden files only when explicitly asked for */
+        if(entry->d_name[0] == '.' && prefix[0] != '.')
+            continue;
+
+        if(!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, ".."))
+            continue;
+
+        if(strncmp(entry->d_name, prefix, prefix_len) != 0)
+            continue;
+
+        if(fstatat(dirfd(dir), entry->d_name, &st, 0) == 0 && S_ISDIR(st.st_mode)) {
+            /* Directories are completed with the trailing slash */
+            char *name = (char *) malloc(strlen(entry->d_name) + 2);
+
+            strcpy(name, entry->d_name);
+            strcat(name, "/");
+            add_candidate(cands, word, dir_len, name);
+            free(name);
+        } else {
+            add_candidate(cands, word, dir_len, entry->d_name);
+        }
+    }
+
+    closedir(dir);
+
+    if(cands->size > 1)
+        qsort(cands->v, cands->size, sizeof(char *), compare_words);
+}
+
+static void complete_job_spec(struct shell_info *s, const char *word, struct candidates *cands)
+{
+    struct job *j;
+    char spec[32];
+
+    for(j = s->first_job; j; j = j->next) {
+        if(job_is_completed(j))
+            continue;
+
+        sprintf(spec, "%%%d", j->id);
+        if(!strncmp(spec, word, strlen(word)))
+            add_candidate(cands, spec, strlen(spec), "");
+    }
+}
+
+char **complete_line(struct shell_info *s, const char *line, size_t len, size_t *word_start)
+{
+    const char *separators = "|&;<>";
+    struct candidates cands = {NULL, 0, 0};
+    size_t start = len, before = len, cmd_start;
+    char *word;
+
+    while(start > 0 && !isspace((unsigned char) line[start - 1])
+          && !strchr(separators, line[start - 1]))
+        --start;
+
+    word = (char *) malloc(len - start + 1);
+    memcpy(word, line + start, len - start);
+    word[len - start] = '\0';
+
+    before = start;
+    while(before > 0 && isspace((unsigned char) line[before - 1]))
+        --before;
+
+    if(before == 0 || strchr("|&;", line[before - 1])) {
+        /* Command position */
+        if(strchr(word, '/'))
+            complete_file(word, &cands);
+        else {
+            if(!s->completion)
+                s->completion = init_completion();
+            complete_command(s->completion, get_var(s->vars, "PATH"), word, &cands);
+        }
+    } else if(word[0] == '%') {
+        /* Find the command word of the current simple command */
+        cmd_start = before;
+        while(cmd_start > 0 && !strchr("|&;", line[cmd_start - 1]))
+            --cmd_start;
+        while(isspace((unsigned char) line[cmd_start]))
+            ++cmd_start;
+
+        if(((!strncmp(line + cmd_start, shell_cmd[SHELL_FG], 2)
+             || !strncmp(line + cmd_start, shell_cmd[SHELL_BG], 2))
+            && isspace((unsigned char) line[cmd_start + 2]))
+           || (!strncmp(line + cmd_start, shell_cmd[SHELL_WAIT], 4)
+               && isspace((unsigned char) line[cmd_start + 4])))
+            complete_job_spec(s, word, &cands);
+    } else {
+        complete_file(word, &cands);
+    }
+
+    free(word);
+    *word_start = start;
+
+    return cands.v;
+}
+
+void free_candidates(char **candidates)
+{
+    char **it;
+
+    if(!candidates)
+        return;
+
+    for(it = candidates; *it; ++it)
+        free(*it);
+
+    free(candidates);
+}
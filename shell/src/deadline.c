@@ -0,0 +1,237 @@
+/*
+ALMiSHELL - A POSIX conformant shell prototype.
+Copyright (C) 2017  Henrique C. S. M. Aranha; Lucas E. C. Mello; Lucas H. F. Leal
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define _GNU_SOURCE /* timerfd */
+
+#include <deadline.h>
+
+#include <sys/timerfd.h>
+#include <signal.h>
+#include <unistd.h>
+#include <stdint.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct signal_name {
+    const char *name;
+    int signal;
+};
+
+static const struct signal_name signal_names[] = {
+    {"HUP", SIGHUP},
+    {"INT", SIGINT},
+    {"QUIT", SIGQUIT},
+    {"KILL", SIGKILL},
+    {"USR1", SIGUSR1},
+    {"USR2", SIGUSR2},
+    {"ALRM", SIGALRM},
+    {"TERM", SIGTERM}
+};
+
+#define SIGNAL_NAME_NUM (sizeof(signal_names) / sizeof(signal_names[0]))
+
+/* Parses a signal as a number, or as a name with or without SIG */
+static int parse_signal(const char *value)
+{
+    char *end;
+    long n;
+    size_t i;
+
+    n = strtol(value, &end, 10);
+    if(value[0] && !*end)
+        return n > 0 && n < NSIG ? (int) n : -1;
+
+    if(!strncmp(value, "SIG", 3))
+        value += 3;
+
+    for(i = 0; i < SIGNAL_NAME_NUM; ++i)
+        if(!strcmp(signal_names[i].name, value))
+            return signal_names[i].signal;
+
+    return -1;
+}
+
+static int parse_duration(const char *value, struct timespec *t)
+{
+    double seconds;
+    char *end;
+
+    seconds = strtod(value, &end);
+    if(end == value || seconds < 0)
+        return -1;
+
+    switch(*end) {
+    case 'd': seconds *= 24;    /* fall through */
+    case 'h': seconds *= 60;    /* fall through */
+    case 'm': seconds *= 60;    /* fall through */
+    case 's': ++end;
+    }
+
+    if(*end)
+        return -1;
+
+    t->tv_sec = (time_t) seconds;
+    t->tv_nsec = (long) ((seconds - t->tv_sec) * 1e9);
+
+    return 0;
+}
+
+int parse_job_deadline(struct job_deadline **d, char **argv)
+{
+    struct job_deadline *r = (struct job_deadline *) malloc(sizeof(struct job_deadline));
+    int i;
+
+    r->signal = SIGTERM;
+    r->grace.tv_sec = 5;
+    r->grace.tv_nsec = 0;
+    r->timed_out = 0;
+    r->timer = -1;
+    *d = r;
+
+    for(i = 1; argv[i] && argv[i][0] == '-'; i += 2) {
+        if(!argv[i + 1] || (strcmp(argv[i], "-s") && strcmp(argv[i], "-k"))) {
+            fprintf(stderr, "almishell: %s: %s: invalid option\n", DEADLINE_COMMAND, argv[i]);
+            return -1;
+        }
+
+        if(argv[i][1] == 's' && (r->signal = parse_signal(argv[i + 1])) < 0) {
+            fprintf(stderr, "almishell: %s: %s: invalid signal\n", DEADLINE_COMMAND, argv[i + 1]);
+            return -1;
+        }
+
+        if(argv[i][1] == 'k' && parse_duration(argv[i + 1], &r->grace) < 0) {
+            fprintf(stderr, "almishell: %s: %s: invalid duration\n", DEADLINE_COMMAND, argv[i + 1]);
+            return -1;
+        }
+    }
+
+    if(!argv[i] || !argv[i + 1]) {
+        fprintf(stderr, "usage: %s [-s signal] [-k grace] duration command\n", DEADLINE_COMMAND);
+        return -1;
+    }
+
+    if(parse_duration(argv[i], &r->duration) < 0) {
+        fprintf(stderr, "almishell: %s: %s: invalid duration\n", DEADLINE_COMMAND, argv[i]);
+        return -1;
+    }
+
+    return i + 1;
+}
+
+void delete_job_deadline(struct job_deadline *d)
+{
+    free(d);
+}
+
+static void add_time(struct timespec *t, const struct timespec *d)
+{
+    t->tv_sec += d->tv_sec;
+    t->tv_nsec += d->tv_nsec;
+    if(t->tv_nsec >= 1000000000) {
+        t->tv_nsec -= 1000000000;
+        ++t->tv_sec;
+    }
+}
+
+void start_job_deadline(struct job_deadline *d)
+{
+    clock_gettime(CLOCK_MONOTONIC, &d->expires);
+    add_time(&d->expires, &d->duration);
+}
+
+int deadline_timer(const struct job_deadline *d)
+{
+    struct itimerspec spec;
+    int timer;
+
+    if(d->timed_out > 1)
+        return -1;
+
+    if( (timer = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK)) < 0 )
+        return -1;
+
+    memset(&spec, 0, sizeof(spec));
+    spec.it_value = d->expires;
+
+    if(timerfd_settime(timer, TFD_TIMER_ABSTIME, &spec, NULL) < 0) {
+        close(timer);
+        return -1;
+    }
+
+    return timer;
+}
+
+/* The deadline is passed: the signal of d is due, then SIGKILL at the end
+   of the grace period */
+static int pass_deadline(struct job_deadline *d)
+{
+    if(d->timed_out) {
+        if(d->timed_out > 1)
+            return 0;
+        d->timed_out = 2;
+        return SIGKILL;
+    }
+
+    d->timed_out = 1;
+    clock_gettime(CLOCK_MONOTONIC, &d->expires);
+    add_time(&d->expires, &d->grace);
+
+    return d->signal;
+}
+
+int expire_job_deadline(struct job_deadline *d, int timer)
+{
+    struct itimerspec spec;
+    uint64_t expirations;
+    int sig;
+
+    if(read(timer, &expirations, sizeof(expirations)) < 0)
+        return 0;
+
+    if(d->timed_out)
+        return pass_deadline(d);
+
+    sig = pass_deadline(d);
+
+    /* A zero value would disarm the timer */
+    memset(&spec, 0, sizeof(spec));
+    spec.it_value = d->grace;
+    if(!spec.it_value.tv_sec && !spec.it_value.tv_nsec)
+        spec.it_value.tv_nsec = 1;
+
+    timerfd_settime(timer, 0, &spec, NULL);
+
+    return sig;
+}
+
+int check_job_deadline(struct job_deadline *d)
+{
+    struct timespec now;
+
+    if(d->timed_out > 1)
+        return 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if(now.tv_sec < d->expires.tv_sec
+       || (now.tv_sec == d->expires.tv_sec && now.tv_nsec < d->expires.tv_nsec))
+        return 0;
+
+    return pass_deadline(d);
+}
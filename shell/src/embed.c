@@ -0,0 +1,165 @@
+/*
+ALMiSHELL - A POSIX conformant shell prototype.
+Copyright (C) 2017  Henrique C. S. M. Aranha; Lucas E. C. Mello; Lucas H. F. Leal
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <almishell.h>
+#include <shell.h>
+#include <parser.h>
+#include <job.h>
+#include <wildcard.h>
+#include <function.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static char default_name[] = "almishell";
+
+struct shell_info *almishell_create(int flags)
+{
+    struct shell_info *s = (struct shell_info *) malloc(sizeof(struct shell_info));
+
+    *s = init_shell(flags);
+
+    return s;
+}
+
+void almishell_destroy(struct shell_info *s)
+{
+    if(!s)
+        return;
+
+    delete_shell(s);
+    free(s);
+}
+
+struct program *almishell_compile(const char *commands)
+{
+    return compile_program(commands);
+}
+
+void almishell_free_program(struct program *prog)
+{
+    if(prog)
+        delete_program(prog);
+}
+
+/* Copies the statuses of the processes of j to the result */
+static void collect_statuses(struct job *j, struct almishell_result *result)
+{
+    struct process_node *node;
+    size_t i = 0;
+
+    free(result->process_status);
+    result->process_num = j->size;
+    result->process_status = (int *) malloc((j->size ? j->size : 1) * sizeof(int));
+
+    for(node = j->first_process; node; node = node->next)
+        result->process_status[i++] = node->p->completed ? process_exit_status(node->p) : -1;
+}
+
+int almishell_execute(struct shell_info *s, const struct program *prog,
+                      const struct almishell_call *call, struct almishell_result *result)
+{
+    char **positional = s->positional, **args = NULL;
+    int positional_num = s->positional_num, io[3], i;
+    uint32_t job;
+
+    memcpy(io, s->io, sizeof(io));
+
+    if(result) {
+        result->syntax_error = 0;
+        result->job_num = 0;
+        result->process_num = 0;
+        result->process_status = NULL;
+    }
+
+    if(call) {
+        if(call->argv) {
+            for(i = 0; call->argv[i]; ++i);
+
+            /* $0 is kept, the parameters are only borrowed */
+            args = (char **) malloc((i + 2) * sizeof(char *));
+            args[0] = positional ? positional[0] : default_name;
+            memcpy(args + 1, call->argv, (i + 1) * sizeof(char *));
+
+            s->positional = args;
+            s->positional_num = i;
+        }
+
+        for(i = 0; i < 3; ++i)
+            if(call->io[i] >= 0)
+                s->io[i] = call->io[i];
+    }
+
+    s->run = 1;
+
+    /* Directory listings are only reused within one execution */
+    clear_dir_cache(s->dir_cache);
+
+    for(job = program_first_job(prog); job && s->run && !s->returning;
+        job = program_next_job(prog, job)) {
+        struct job *j;
+        const char *name, *body;
+
+        /* Definitions compile the body once, for every call */
+        if( (name = program_job_function(prog, job, &body)) ) {
+            define_function(s->functions, name, compile_nested_program(body));
+            s->last_status = 0;
+            continue;
+        }
+
+        j = instantiate_job(s, prog, job);
+
+        if(j)
+            j->tail = s->tail_exec && !program_next_job(prog, job);
+
+        if(!j) {
+            s->last_status = 2;
+            if(result)
+                result->syntax_error = 1;
+        } else {
+            launch_job(s, j);
+
+            if(result) {
+                ++result->job_num;
+                collect_statuses(j, result);
+            }
+        }
+
+        remove_completed_jobs(s);
+    }
+
+    s->positional = positional;
+    s->positional_num = positional_num;
+    memcpy(s->io, io, sizeof(io));
+    free(args);
+
+    if(result) {
+        result->status = s->last_status;
+        result->exited = !s->run;
+    }
+
+    return s->last_status;
+}
+
+void almishell_free_result(struct almishell_result *result)
+{
+    free(result->process_status);
+    result->process_status = NULL;
+    result->process_num = 0;
+}
@@ -0,0 +1,167 @@
+/*
+ALMiSHELL - A POSIX conformant shell prototype.
+Copyright (C) 2017  Henrique C. S. M. Aranha; Lucas E. C. Mello; Lucas H. F. Leal
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <expand.h>
+#include <vars.h>
+#include <arith.h>
+
+#include <unistd.h>
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct string_builder {
+    char *data;
+    size_t size;
+    size_t capacity;
+};
+
+static void append(struct string_builder *b, const char *str, size_t len)
+{
+    if(b->size + len + 1 > b->capacity) {
+        while(b->size + len + 1 > b->capacity)
+            b->capacity *= 2;
+        b->data = (char *) realloc(b->data, b->capacity);
+    }
+
+    memcpy(b->data + b->size, str, len);
+    b->size += len;
+    b->data[b->size] = '\0';
+}
+
+/* Appends the positional parameter $n, nothing if it is not set */
+static void append_positional(struct string_builder *b, struct shell_info *s, long n)
+{
+    if(n >= 0 && s->positional && n <= s->positional_num && s->positional[n])
+        append(b, s->positional[n], strlen(s->positional[n]));
+}
+
+static void append_var(struct string_builder *b, struct shell_info *s, const char *name,
+                       size_t len)
+{
+    const char *value = get_var_len(s->vars, name, len);
+
+    if(value)
+        append(b, value, strlen(value));
+}
+
+/* Returns the end of the $((...)) starting at word, past its "))", or
+   NULL if it is not closed */
+static const char *arithmetic_end(const char *word)
+{
+    int depth = 0;
+
+    for(; *word; ++word) {
+        if(*word == '(')
+            ++depth;
+        else if(*word == ')' && !--depth)
+            return word[-1] == ')' ? word + 1 : NULL;
+    }
+
+    return NULL;
+}
+
+/* Appends the value of the $((...)) at it, returns 0 on error */
+static int append_arithmetic(struct string_builder *b, struct shell_info *s, const char *it,
+                             const char *end)
+{
+    char *expression = (char *) malloc(end - it), *expanded, number[32];
+    long value;
+    int ok;
+
+    /* The parameters inside are expanded first, nested expansions too */
+    memcpy(expression, it + 3, end - it - 5);
+    expression[end - it - 5] = '\0';
+    expanded = expand_parameters(s, expression);
+
+    ok = expanded && evaluate_arithmetic(s, expanded, &value) == 0;
+    if(ok) {
+        sprintf(number, "%ld", value);
+        append(b, number, strlen(number));
+    }
+
+    free(expression);
+    free(expanded);
+
+    return ok;
+}
+
+char *expand_parameters(struct shell_info *s, const char *word)
+{
+    struct string_builder b;
+    const char *it = word, *dollar, *end;
+    char number[32];
+    size_t len;
+
+    b.capacity = strlen(word) + 1;
+    b.size = 0;
+    b.data = (char *) malloc(b.capacity);
+    b.data[0] = '\0';
+
+    while( (dollar = strchr(it, '$')) ) {
+        append(&b, it, dollar - it);
+        it = dollar + 1;
+
+        if(it[0] == '(' && it[1] == '(') {
+            if(!(end = arithmetic_end(it))) {
+                fprintf(stderr, "almishell: %s: missing ))\n", dollar);
+                free(b.data);
+                return NULL;
+            }
+
+            if(!append_arithmetic(&b, s, dollar, end)) {
+                free(b.data);
+                return NULL;
+            }
+            it = end;
+        } else if(*it == '?') {
+            sprintf(number, "%d", s->last_status);
+            append(&b, number, strlen(number));
+            ++it;
+        } else if(*it == '$') {
+            sprintf(number, "%ld", (long) getpid());
+            append(&b, number, strlen(number));
+            ++it;
+        } else if(*it == '#') {
+            sprintf(number, "%d", s->positional_num);
+            append(&b, number, strlen(number));
+            ++it;
+        } else if(isdigit((unsigned char) *it)) {
+            append_positional(&b, s, *it - '0');
+            ++it;
+        } else if(*it == '{' && isdigit((unsigned char) it[1])
+                  && (len = strspn(it + 1, "0123456789")) && it[len + 1] == '}') {
+            append_positional(&b, s, strtol(it + 1, NULL, 10));
+            it += len + 2;
+        } else if(*it == '{' && (len = var_name_len(it + 1)) && it[len + 1] == '}') {
+            append_var(&b, s, it + 1, len);
+            it += len + 2;
+        } else if( (len = var_name_len(it)) ) {
+            append_var(&b, s, it, len);
+            it += len;
+        } else {
+            append(&b, "$", 1); /* Not an expansion */
+        }
+    }
+
+    append(&b, it, strlen(it));
+
+    return b.data;
+}
@@ -0,0 +1,167 @@
+/*
+ALMiSHELL - A POSIX conformant shell prototype.
+Copyright (C) 2017  Henrique C. S. M. Aranha; Lucas E. C. Mello; Lucas H. F. Leal
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <function.h>
+#include <parser.h>
+#include <shell.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* FNV-1a, as for the variables */
+static unsigned long hash_name(const char *name)
+{
+    unsigned long h = 2166136261UL;
+
+    for(; *name; ++name) {
+        h ^= (unsigned char) *name;
+        h *= 16777619UL;
+    }
+
+    return h;
+}
+
+struct function_table *init_functions(void)
+{
+    return (struct function_table *) calloc(1, sizeof(struct function_table));
+}
+
+static void free_function(struct function *f)
+{
+    free(f->name);
+    delete_program(f->body);
+    free(f);
+}
+
+/* Unlinked functions are freed now, or by their last running call */
+static void retire_function(struct function *f)
+{
+    if(f->calls)
+        f->retired = 1;
+    else
+        free_function(f);
+}
+
+void delete_functions(struct function_table *t)
+{
+    struct function *f, *next;
+    size_t i;
+
+    if(!t)
+        return;
+
+    for(i = 0; i < FUNCTION_BUCKETS; ++i) {
+        for(f = t->buckets[i]; f; f = next) {
+            next = f->next;
+            retire_function(f);
+        }
+    }
+
+    free(t);
+}
+
+struct function *find_function(struct function_table *t, const char *name)
+{
+    unsigned long hash;
+    struct function *f;
+
+    if(!t->size)
+        return NULL;
+
+    hash = hash_name(name);
+
+    for(f = t->buckets[hash % FUNCTION_BUCKETS]; f; f = f->next)
+        if(f->hash == hash && !strcmp(f->name, name))
+            return f;
+
+    return NULL;
+}
+
+void define_function(struct function_table *t, const char *name, struct program *body)
+{
+    struct function *f = (struct function *) malloc(sizeof(struct function));
+
+    undefine_function(t, name);
+
+    f->name = (char *) malloc(strlen(name) + 1);
+    strcpy(f->name, name);
+    f->body = body;
+    f->hash = hash_name(name);
+    f->calls = 0;
+    f->retired = 0;
+    f->next = t->buckets[f->hash % FUNCTION_BUCKETS];
+    t->buckets[f->hash % FUNCTION_BUCKETS] = f;
+    ++t->size;
+}
+
+int undefine_function(struct function_table *t, const char *name)
+{
+    unsigned long hash = hash_name(name);
+    struct function **link = &t->buckets[hash % FUNCTION_BUCKETS], *f;
+
+    for(; (f = *link); link = &f->next) {
+        if(f->hash == hash && !strcmp(f->name, name)) {
+            *link = f->next;
+            --t->size;
+            retire_function(f);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+void enter_function(struct function *f)
+{
+    ++f->calls;
+}
+
+void leave_function(struct function *f)
+{
+    if(!--f->calls && f->retired)
+        free_function(f);
+}
+
+int call_function(struct shell_info *s, struct function *f, char **argv, const int io[3])
+{
+    struct almishell_call call;
+    int tail_exec = s->tail_exec, status;
+
+    if(s->function_depth >= FUNCTION_MAX_DEPTH) {
+        fprintf(stderr, "almishell: %s: maximum function nesting level exceeded\n", f->name);
+        return 1;
+    }
+
+    call.argv = argv + 1;
+    memcpy(call.io, io, sizeof(call.io));
+
+    /* The last job of a body is not the last one of the shell */
+    s->tail_exec = 0;
+    ++s->function_depth;
+    enter_function(f);
+
+    status = almishell_execute(s, f->body, &call, NULL);
+
+    leave_function(f);
+    --s->function_depth;
+    s->returning = 0;
+    s->tail_exec = tail_exec;
+
+    return status;
+}
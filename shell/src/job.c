@@ -16,10 +16,19 @@ You should have received a copy of the GNU General Public License
 along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#define _GNU_SOURCE /* pipe2, wait4 */
+
 #include <job.h>
+#include <vars.h>
+#include <stats.h>
+#include <function.h>
+#include <bench.h>
+#include <watch.h>
 
 #include <unistd.h>
+#include <fcntl.h>
 #include <sys/wait.h>
+#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <errno.h>
@@ -37,6 +46,14 @@ struct job *init_job(char *command_line, char background)
     j->priority = 0;
 
     memcpy(j->io, io, sizeof(int) * 3);
+    j->coproc_fd[0] = j->coproc_fd[1] = -1;
+    j->resources = NULL;
+    j->deadline = NULL;
+    j->memo = NULL;
+    j->tail = 0;
+    j->notify = 0;
+    j->waited = 0;
+    j->next_completed = NULL;
 
     j->command = (char*) malloc((strlen(command_line) + 1) * sizeof(char));
     strcpy(j->command, command_line);
@@ -50,6 +67,10 @@ void delete_job(struct job *j)
 {
     struct process_node *current = j->first_process, *next = NULL;
 
+    /* The output of a memoized job is shown once it completes */
+    if(j->memo && current)
+        finish_job_memo(j->memo, current->p);
+
     while(current) {
         next = current->next;
 
@@ -62,30 +83,85 @@ void delete_job(struct job *j)
                 free(current->p->argv); /* Free token location memory */
             }
 
+            close_redirections(current->p);
+            free(current->p->redirects);
+            delete_process_sample(current->p->sample);
+
+            if(current->p->assign) {
+                int i;
+                for(i = 0; current->p->assign[i]; ++i)
+                    free(current->p->assign[i]);
+                free(current->p->assign);
+            }
+
             free(current->p);
         }
         free(current);
         current = next;
     }
 
+    delete_job_resources(j->resources);
+    delete_job_deadline(j->deadline);
+    delete_job_memo(j->memo);
+
+    if(j->coproc_fd[0] >= 0)
+        close(j->coproc_fd[0]);
+    if(j->coproc_fd[1] >= 0)
+        close(j->coproc_fd[1]);
+
     free(j->command);
     free(j);
 }
 
-void wait_job(struct job *j, struct job *first_job)
+/* Without a process watch the deadlines are checked against the clock
+   while waiting. Returns 1 if a job still has one to enforce. */
+static int check_deadlines(struct shell_info *s)
+{
+    struct job *j;
+    int pending = 0, sig;
+
+    for(j = s->first_job; j; j = j->next) {
+        if(!j->deadline || j->deadline->timed_out > 1 || job_is_completed(j))
+            continue;
+
+        if( (sig = check_job_deadline(j->deadline)) )
+            signal_job(j, sig);
+        pending = 1;
+    }
+
+    return pending;
+}
+
+/* Waits with wait4 for a process of the group pgid, or any child if 0,
+   to exit or stop, for kernels without pidfds. While a deadline is
+   pending the processes are polled every WATCH_POLL_MS, as runcmd does.
+   Returns -1 if there is nothing left to wait. */
+static int wait_any_process(struct shell_info *s, pid_t pgid)
 {
-    pid_t wait_result;
     int status;
+    pid_t pid;
+    struct rusage usage;
+
+    for(;;) {
+        pid = wait4(pgid ? - pgid : -1, &status,
+                    check_deadlines(s) ? WUNTRACED | WNOHANG : WUNTRACED, &usage);
 
-    /*signal (SIGCHLD, SIG_DFL);*/
+        if(pid == 0)
+            poll(NULL, 0, WATCH_POLL_MS);
+        else if(pid > 0 || errno != EINTR)
+            return mark_process_status(pid, status, &usage, s->first_job);
+    }
+}
 
-    do {
-        wait_result = waitpid(- j->pgid, &status, WUNTRACED);
-    } while(!mark_process_status (wait_result, status, first_job)
-            && !job_is_stopped(j)
-            && !job_is_completed(j));
+void wait_job(struct shell_info *s, struct job *j)
+{
+    if(s->watch) {
+        while(!job_is_stopped(j) && run_process_watch(s->watch, -1) >= 0);
+        return;
+    }
 
-    /*signal(SIGCHLD, SIG_IGN);*/
+    /* Without job control the job has no process group of its own */
+    while(!job_is_stopped(j) && !wait_any_process(s, j->pgid));
 }
 
 void signal_continue_job(struct shell_info *s, struct job *j)
@@ -108,7 +184,8 @@ void put_job_in_foreground(struct shell_info *s, struct job *j, int cont)
     if(cont)
         signal_continue_job(s, j);
 
-    wait_job(j, s->first_job);
+    wait_job(s, j);
+    j->notify = !job_is_completed(j);
 
     /* Give access to the terminal back to the shell */
     tcsetpgrp(s->terminal, s->pgid);
@@ -121,6 +198,7 @@ void put_job_in_foreground(struct shell_info *s, struct job *j, int cont)
 void put_job_in_background(struct job *j, int cont)
 {
     j->background = 'b';
+    j->notify = 1;
 
     /* Send the job a continue signal, if necessary.  */
     if (cont)
@@ -128,73 +206,404 @@ void put_job_in_background(struct job *j, int cont)
             perror ("almishell: kill (SIGCONT)");
 }
 
+/* The standard descriptors of a function body run in the shell, with
+   the redirections of p applied to io. A closed one is left as in io. */
+static void function_io(struct process *p, const int io[3], int body_io[3])
+{
+    int *targets = (int *) malloc((3 + p->redirect_num) * sizeof(int) * 2);
+    int *sources = targets + 3 + p->redirect_num;
+    size_t i, size = resolve_redirections(p, io, targets, sources);
+
+    memcpy(body_io, io, 3 * sizeof(int));
+
+    for(i = 0; i < size; ++i)
+        if(targets[i] < 3 && sources[i] >= 0)
+            body_io[targets[i]] = sources[i];
+
+    free(targets);
+}
+
+/* exec without a command: the redirections stay in the shell, 0 to 2 in
+   place and the others as copies the later jobs get at their number.
+   Returns the exit status. */
+static int keep_redirections(struct shell_info *s, struct process *p, const int io[3])
+{
+    int *targets = (int *) malloc((3 + p->redirect_num) * sizeof(int) * 2);
+    int *sources = targets + 3 + p->redirect_num, status = 0, fd, n;
+    size_t i, size = resolve_redirections(p, io, targets, sources);
+
+    fflush(stdout);
+
+    for(i = 0; i < size; ++i) {
+        n = targets[i];
+
+        if(n < 3) {
+            if(sources[i] < 0)
+                close(n);
+            else if(sources[i] != n && dup2(sources[i], n) < 0) {
+                perror("almishell: exec");
+                status = 1;
+            }
+            continue;
+        }
+
+        if(n >= SHELL_FD_MAX) {
+            fprintf(stderr, "almishell: exec: %d: bad file descriptor\n", n);
+            status = 1;
+            continue;
+        }
+
+        if(sources[i] == s->fds[n])
+            continue;
+
+        /* Kept above the descriptors a script may use for itself */
+        fd = -1;
+        if(sources[i] >= 0 && (fd = fcntl(sources[i], F_DUPFD_CLOEXEC, SHELL_FD_MAX)) < 0) {
+            perror("almishell: exec");
+            status = 1;
+            continue;
+        }
+
+        if(s->fds[n] >= 0)
+            close(s->fds[n]);
+        s->fds[n] = fd;
+    }
+
+    free(targets);
+
+    return status;
+}
+
+/* Builtins run in the shell, their output goes to a stream on the
+   descriptor the process would have as stdout */
+static FILE *builtin_output(struct process *p, const int io[3])
+{
+    int *targets = (int *) malloc((3 + p->redirect_num) * sizeof(int) * 2);
+    int *sources = targets + 3 + p->redirect_num, out_fd = STDOUT_FILENO;
+    size_t i, size = resolve_redirections(p, io, targets, sources);
+
+    for(i = 0; i < size; ++i)
+        if(targets[i] == STDOUT_FILENO)
+            out_fd = sources[i];
+
+    free(targets);
+
+    if(out_fd == STDOUT_FILENO)
+        return stdout;
+    if(out_fd < 0)
+        return fopen("/dev/null", "we");
+
+    return fdopen(fcntl(out_fd, F_DUPFD_CLOEXEC, 3), "w");
+}
+
+/* Shell descriptors for coprocesses are kept out of the range used by
+   redirections in commands */
+#define COPROC_FD_MIN 10
+
+/* Turns "coproc NAME command..." into a background job reading from and
+   writing to pipes to the shell. Returns 0 if the syntax is wrong. */
+static int start_coproc(struct job *j, char **name)
+{
+    char **argv = j->first_process->p->argv;
+    int to_coproc[2], from_coproc[2], i;
+
+    if(!argv[1] || !argv[2] || !var_name_len(argv[1]) || argv[1][var_name_len(argv[1])]) {
+        fprintf(stderr, "almishell: usage: %s NAME command [args]\n", COPROC_COMMAND);
+        return 0;
+    }
+
+    if(pipe2(to_coproc, O_CLOEXEC) < 0 || pipe2(from_coproc, O_CLOEXEC) < 0) {
+        perror("almishell: pipe");
+        exit(1);
+    }
+
+    /* The shell ends move up, out of the way of n>file redirections */
+    j->coproc_fd[0] = fcntl(from_coproc[0], F_DUPFD_CLOEXEC, COPROC_FD_MIN);
+    j->coproc_fd[1] = fcntl(to_coproc[1], F_DUPFD_CLOEXEC, COPROC_FD_MIN);
+    close(from_coproc[0]);
+    close(to_coproc[1]);
+
+    j->io[0] = to_coproc[0];
+    j->io[1] = from_coproc[1];
+    j->background = 'b';
+
+    /* Drop the coproc keyword and the name from the command */
+    free(argv[0]);
+    *name = argv[1];
+    for(i = 2; argv[i - 1]; ++i)
+        argv[i - 2] = argv[i];
+
+    return 1;
+}
+
+/* Exports the coprocess descriptors and pid as NAME_OUT, NAME_IN and
+   NAME_PID */
+static void set_coproc_vars(struct shell_info *s, struct job *j, const char *name)
+{
+    struct process_node *last = j->first_process;
+    char *var = (char *) malloc(strlen(name) + 8), value[32];
+
+    while(last->next)
+        last = last->next;
+
+    sprintf(var, "%s_OUT", name);
+    sprintf(value, "%d", j->coproc_fd[0]);
+    set_var(s->vars, var, value);
+
+    sprintf(var, "%s_IN", name);
+    sprintf(value, "%d", j->coproc_fd[1]);
+    set_var(s->vars, var, value);
+
+    sprintf(var, "%s_PID", name);
+    sprintf(value, "%ld", (long) last->p->pid);
+    set_var(s->vars, var, value);
+
+    free(var);
+}
+
+/* Removes the first used words of argv */
+static void remove_prefix(char **argv, int used)
+{
+    int i;
+
+    for(i = 0; i < used; ++i)
+        free(argv[i]);
+    for(i = used; argv[i - 1]; ++i)
+        argv[i - used] = argv[i];
+}
+
+/* Moves the controls of a "sched ...", "timeout ..." or "memo ..." prefix
+   to the job, each is taken once. Returns 1 if argv started with one, 0 if
+   not, -1 if the syntax is wrong. */
+static int start_with_prefix(struct job *j)
+{
+    char **argv = j->first_process->p->argv;
+    int used;
+
+    if(!argv[0])
+        return 0;
+
+    if(!j->resources && !strcmp(argv[0], RESOURCES_COMMAND))
+        used = parse_job_resources(&j->resources, argv);
+    else if(!j->deadline && !strcmp(argv[0], DEADLINE_COMMAND))
+        used = parse_job_deadline(&j->deadline, argv);
+    else if(!j->memo && !strcmp(argv[0], MEMO_COMMAND)) {
+        /* Only the output of a single command can be captured */
+        if(j->size != 1 || j->background == 'b') {
+            fprintf(stderr, "almishell: %s: only a single foreground command is cached\n",
+                    MEMO_COMMAND);
+            return -1;
+        }
+        used = parse_job_memo(&j->memo, argv);
+    } else
+        return 0;
+
+    if(used < 0)
+        return -1;
+
+    remove_prefix(argv, used);
+
+    return 1;
+}
+
+int coproc_fd(struct shell_info *s, int to_coproc)
+{
+    struct job *it;
+    int fd = -1;
+
+    for(it = s->first_job; it; it = it->next)
+        if(it->coproc_fd[0] >= 0)
+            fd = it->coproc_fd[to_coproc ? 1 : 0];
+
+    return fd;
+}
+
+/* Marks the processes from node on as not run, with the exit status */
+static void fail_processes(struct process_node *node, int status)
+{
+    for(; node; node = node->next) {
+        if(!node->p->completed) {
+            node->p->status = status << 8;
+            node->p->completed = 1;
+        }
+    }
+}
+
 int launch_job (struct shell_info *s, struct job *j)
 {
     struct process_node *node;
     pid_t pid;
     int mypipe[2];
-    int io[3] = {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO};
-    enum SHELL_CMD cmd;
+    int io[3];
+    int forked = 0, prefix;
+    enum SHELL_CMD cmd = SHELL_NONE;
+    char *coproc_name = NULL;
+    size_t stage = 0;
+    struct timespec start;
+    struct function *f;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    node = j->first_process;
+
+    /* bench launches copies of the job, which only carries the result */
+    if(node && node->p->argv[0] && !strcmp(node->p->argv[0], BENCH_COMMAND)) {
+        bench_job(s, j);
+        node = NULL;
+    }
+
+    /* A prefix with a wrong syntax fails the whole job with status 2 */
+    while(node && (prefix = start_with_prefix(j)))
+        if(prefix < 0)
+            node = NULL;
+
+    if(j->deadline)
+        start_job_deadline(j->deadline);
+
+    if(node && node->p->argv[0] && !strcmp(node->p->argv[0], COPROC_COMMAND)
+       && !start_coproc(j, &coproc_name))
+        node = NULL;
+
+    /* A cached result is replayed in place of the job */
+    if(node && j->memo) {
+        int memo_io[3], status;
+
+        function_io(node->p, j->io, memo_io);
+        if(start_job_memo(s, j->memo, node->p, memo_io, &status)) {
+            node->p->status = status << 8;
+            node->p->completed = 1;
+            node = NULL;
+        }
+    }
+
+    if(!node)
+        fail_processes(j->first_process, 2);
+
+    /* Make sure the cached environment is up to date before forking */
+    get_envp(s->vars);
 
     io[0] = j->io[0];
-    for (node = j->first_process; node; node = node->next) {
+    io[2] = j->io[2];
+    for (; node; node = node->next) {
         /* Set up pipes, if necessary.  */
         if (node->next) {
-            if (pipe (mypipe) < 0) {
+            if (pipe2 (mypipe, O_CLOEXEC) < 0) {
                 perror ("almishell: pipe");
-                exit (1);
+                fail_processes(node, 126);
+                break;
             }
+            STATS_ADD(STATS_PIPES, 1);
 
             /* Redirect output to the pipe */
             io[1] = mypipe[1];
         } else
             io[1] = j->io[1];
 
-        cmd = is_builtin_command(node->p->argv[0]);
+        node->p->piped = node->next != NULL;
+
+        if(node->p->redirect_failed) {
+            /* The command is not run, with status 1 */
+            node->p->status = 1 << 8;
+            node->p->completed = 1;
+        } else if(!node->p->argv[0]) {
+            /* Only assignments, they are made to the shell variables */
+            char **a;
+
+            for(a = node->p->assign; a && *a; ++a)
+                assign_var(s->vars, *a);
+
+            node->p->completed = 1;
+        } else if(j->size == 1 && j->background != 'b' && !j->deadline
+                  && (!s->builtins || is_builtin_command(node->p->argv[0]) == SHELL_NONE)
+                  && (f = find_function(s->functions, node->p->argv[0]))) {
+            /* A function alone in a foreground job runs in the shell, a
+               deadline needs it in a child */
+            int body_io[3];
+            pid_t *relays = (pid_t *) malloc((node->p->redirect_num + 1) * sizeof(pid_t));
+            size_t relay_num = split_outputs(node->p, io, relays);
+
+            function_io(node->p, io, body_io);
+            node->p->status = call_function(s, f, node->p->argv, body_io) << 8;
+            node->p->completed = 1;
+
+            close_redirections(node->p);
+            wait_relays(relays, relay_num);
+            free(relays);
+        } else if(!s->builtins
+                  || (cmd = is_builtin_command(node->p->argv[0])) == SHELL_NONE
+                  || (cmd == SHELL_EXEC && node->p->argv[1])) {
+            /* Keep the shell output ordered with the child output */
+            fflush(stdout);
+
+            /* exec, or a command the shell would only wait for, runs in
+               place of the shell when it owns its process */
+            if(s->standalone && (cmd == SHELL_EXEC || j->tail) && j->size == 1
+               && j->background != 'b' && !j->deadline && !j->memo)
+                run_process(s, node->p, j->pgid, io, j->background, j->resources, stage);
 
-        if(cmd == SHELL_NONE) {
             /* Fork the child processes.  */
             pid = fork ();
             if (pid == 0)
                 /* This is the child process.  */
-                run_process(s, node->p, j->pgid, io, j->background);
+                run_process(s, node->p, j->pgid, io, j->background, j->resources, stage);
             else if (pid < 0) {
-                /* The fork failed.  */
+                /* The fork failed, the process is reported as not run */
                 perror ("almishell: fork");
-                exit (EXIT_FAILURE);
+                node->p->status = 126 << 8;
+                node->p->completed = 1;
             } else {
                 /* This is the parent process.  */
                 node->p->pid = pid;
+                watch_process(s->watch, j, node->p);
+                forked = 1;
+                STATS_ADD(STATS_FORKS, 1);
                 if (s->interactive) {
                     if (!j->pgid)
                         j->pgid = pid;
                     setpgid (pid, j->pgid);
                 }
             }
-        } else {
-            FILE *out = io[1] == STDOUT_FILENO ? stdout : fdopen(io[1], "w");
 
-            run_builtin_command(s, out, node->p->argv, cmd);
+            close_redirections(node->p);
+        } else {
+            pid_t *relays = (pid_t *) malloc((node->p->redirect_num + 1) * sizeof(pid_t));
+            size_t relay_num = cmd == SHELL_EXEC ? 0 : split_outputs(node->p, io, relays);
+            FILE *out = builtin_output(node->p, io);
+            int in[3];
+
+            /* The input is used as is, read leaves its offset after the line */
+            function_io(node->p, io, in);
+
+            if(cmd == SHELL_EXEC)
+                node->p->status = keep_redirections(s, node->p, io) << 8;
+            else
+                node->p->status = run_builtin_command(s, in[0], out, node->p->argv, cmd) << 8;
             node->p->completed = 1;
 
-            if(out != stdout) {
+            if(out != stdout)
                 fclose(out);
-                io[1] = STDOUT_FILENO;
-            }
+
+            close_redirections(node->p);
+            wait_relays(relays, relay_num);
+            free(relays);
 
             if(cmd == SHELL_EXIT || cmd == SHELL_QUIT) {
-                node = NULL;
-                io[1] = STDOUT_FILENO;
+                if(node->next) {
+                    close(mypipe[0]);
+                    close(mypipe[1]);
+                }
+                fail_processes(node->next, 126);
                 break;
             }
         }
 
-        /* Clean up after pipes. */
+        ++stage;
+
+        /* Clean up after pipes, the job descriptors belong to the caller */
         if(node->next) {
-            if(io[1] != STDOUT_FILENO)
-                close(io[1]);
+            close(io[1]);
 
-            if(node != j->first_process)
+            if(io[0] != j->io[0])
                 close(io[0]);
 
             /* Set the next process input as the pipe input */
@@ -202,6 +611,11 @@ int launch_job (struct shell_info *s, struct job *j)
         }
     }
 
+    if(io[0] != j->io[0])
+        close(io[0]);
+
+    stats_time(STATS_LAUNCH, &start);
+
     j->id = s->tail_job ? s->tail_job->id+1 : 1;
 
     if(!s->first_job) {
@@ -222,27 +636,242 @@ int launch_job (struct shell_info *s, struct job *j)
         s->tail_job = j;
     }
 
-    if(io[0] != STDIN_FILENO)
-        close(io[0]);
+    stats_job_table(1);
 
-    if(io[1] != STDOUT_FILENO)
-        close(io[1]);
+    if(coproc_name) {
+        /* The coprocess ends of the pipes are only needed by its processes */
+        close(j->io[0]);
+        close(j->io[1]);
 
-    if(!j->pgid) /* If the pipeline is composed of only built-in commands */
+        set_coproc_vars(s, j, coproc_name);
+        free(coproc_name);
+    }
+
+    if(!forked) { /* If the pipeline is composed of only built-in commands */
+        s->last_status = job_exit_status(j);
         return 0;
+    }
 
-    if (!s->interactive) {
-        wait_job (j, s->first_job);
-    } else if (j->background == 'f') {
-        put_job_in_foreground(s, j, 0);
-    } else {
-        tcgetattr(s->terminal, &j->tmodes); /* Set up defualt terminal mode */
+    /* The clock started with the job, the timer only ends it */
+    watch_deadline(s->watch, j);
+
+    if (j->background == 'b') {
+        if (s->interactive)
+            tcgetattr(s->terminal, &j->tmodes); /* Set up defualt terminal mode */
         put_job_in_background(j, 0);
+    } else if (!s->interactive) {
+        wait_job (s, j);
+    } else {
+        put_job_in_foreground(s, j, 0);
     }
 
+    s->last_status = j->background == 'b' ? 0 : job_exit_status(j);
+
     return 1;
 }
 
+void remove_job(struct shell_info *s, struct job *j)
+{
+    struct job **link, *previous = NULL, *it;
+
+    for(link = &s->first_job; *link && *link != j; link = &(*link)->next)
+        previous = *link;
+
+    if(!*link)
+        return;
+
+    *link = j->next;
+    if(s->tail_job == j)
+        s->tail_job = previous;
+
+    for(it = s->first_job; it; it = it->next)
+        if(it->priority > j->priority)
+            --it->priority;
+
+    stats_job_table(-1);
+    unwatch_job(s->watch, j);
+    delete_job(j);
+}
+
+/* Removes the completed jobs from the job list */
+void remove_completed_jobs(struct shell_info *s)
+{
+    struct job *current_job, *previous_job;
+
+    current_job = s->first_job;
+    previous_job = NULL;
+
+    while(current_job) {
+        int deletedHead = 0;
+
+        if(job_is_completed(current_job) && !current_job->notify) {
+            struct job *curJob = s->first_job;
+
+            stats_job_table(-1);
+            unwatch_job(s->watch, current_job);
+            while(curJob) {
+                if(curJob->priority > current_job->priority) {
+                    --curJob->priority;
+                }
+
+                curJob = curJob->next;
+            }
+
+            if(s->first_job == s->tail_job) {
+                delete_job(current_job);
+                current_job = s->first_job = s->tail_job = NULL;
+            } else if(current_job == s->first_job) {
+                s->first_job = current_job->next;
+                delete_job(current_job);
+                current_job = s->first_job;
+                deletedHead = 1;
+            } else if(current_job == s->tail_job) {
+                s->tail_job = previous_job;
+
+                delete_job(current_job);
+
+                previous_job->next = NULL;
+
+                current_job = NULL;
+            } else {
+                previous_job->next = current_job->next;
+                delete_job(current_job);
+                current_job = previous_job;
+            }
+        }
+        previous_job = current_job;
+        if(current_job && !deletedHead)
+            current_job = current_job->next;
+    }
+}
+
+/* Returns the exit status of the last process of the job, in the form
+   used by $? */
+int job_exit_status(struct job *j)
+{
+    struct process_node *last = j->first_process;
+
+    if(j->deadline && j->deadline->timed_out)
+        return DEADLINE_STATUS;
+
+    while(last->next)
+        last = last->next;
+
+    return process_exit_status(last->p);
+}
+
+int process_exit_status(const struct process *p)
+{
+    if(WIFEXITED(p->status))
+        return WEXITSTATUS(p->status);
+    if(WIFSIGNALED(p->status))
+        return 128 + WTERMSIG(p->status);
+
+    return 128 + WSTOPSIG(p->status);
+}
+
+/* Counts the processes wait_processes still has to wait */
+static size_t count_pending(struct shell_info *s, struct process **procs, size_t n)
+{
+    struct process_node *node;
+    struct job *j;
+    size_t pending = 0, i;
+
+    if(!procs) {
+        for(j = s->first_job; j; j = j->next)
+            for(node = j->first_process; node; node = node->next)
+                pending += !node->p->completed && !node->p->stopped;
+        return pending;
+    }
+
+    for(i = 0; i < n; ++i)
+        pending += !procs[i]->completed && !procs[i]->stopped;
+
+    return pending;
+}
+
+/* Without a process watch the waited jobs are looked at in turn */
+static struct job *find_completed(struct shell_info *s, struct job **jobs, size_t n)
+{
+    struct job *j;
+    size_t i;
+
+    if(!jobs) {
+        for(j = s->first_job; j; j = j->next)
+            if(job_is_completed(j))
+                return j;
+        return NULL;
+    }
+
+    for(i = 0; i < n; ++i)
+        if(job_is_completed(jobs[i]))
+            return jobs[i];
+
+    return NULL;
+}
+
+struct job *wait_processes(struct shell_info *s, struct job **jobs,
+                           struct process **procs, size_t n, int any)
+{
+    struct job *done = NULL;
+    size_t pending = 0, i;
+    int changed;
+
+    for(i = 0; procs && i < n; ++i)
+        jobs[i]->waited = 1;
+
+    for(;;) {
+        if(any) {
+            if(s->watch)
+                done = take_completed_job(s->watch, procs != NULL);
+            else
+                done = find_completed(s, procs ? jobs : NULL, n);
+
+            if(done)
+                break;
+        }
+
+        /* The count also goes down for processes not waited here, it is
+           only taken again once it runs out */
+        if(!pending && !(pending = count_pending(s, procs, n)))
+            break;
+
+        if(s->watch)
+            changed = run_process_watch(s->watch, -1);
+        else
+            changed = wait_any_process(s, 0) ? -1 : 1;
+
+        if(changed < 0)
+            break;
+
+        pending = (size_t) changed < pending ? pending - changed : 0;
+    }
+
+    for(i = 0; procs && i < n; ++i)
+        jobs[i]->waited = 0;
+
+    return done;
+}
+
+void signal_job(struct job *j, int sig)
+{
+    struct process_node *node;
+
+    if(j->pgid) {
+        kill(- j->pgid, sig);
+        kill(- j->pgid, SIGCONT);
+        return;
+    }
+
+    /* Without job control the job has no process group of its own */
+    for(node = j->first_process; node; node = node->next) {
+        if(!node->p->completed && node->p->pid > 0) {
+            kill(node->p->pid, sig);
+            kill(node->p->pid, SIGCONT);
+        }
+    }
+}
+
 int check_processes(struct job *j)
 {
     struct process_node *current;
@@ -263,7 +892,24 @@ int check_processes(struct job *j)
     return 1;
 }
 
-int mark_process_status (pid_t pid, int status, struct job* j)
+void set_process_status(struct process *p, int status, const struct rusage *usage)
+{
+    p->status = status;
+    if (WIFSTOPPED (status)) {
+        p->stopped = 1;
+        return;
+    }
+
+    p->completed = 1;
+    if (usage)
+        p->usage = *usage;
+    stats_reap(status);
+    if (WIFSIGNALED (status))
+        fprintf (stderr, "%d: Terminated by signal %d.\n",
+                 (int) p->pid, WTERMSIG (status));
+}
+
+int mark_process_status (pid_t pid, int status, const struct rusage *usage, struct job* j)
 {
     struct process_node *node;
 
@@ -272,15 +918,7 @@ int mark_process_status (pid_t pid, int status, struct job* j)
         for (; j; j = j->next) {
             for (node = j->first_process; node; node = node->next) {
                 if (node->p->pid == pid) {
-                    node->p->status = status;
-                    if (WIFSTOPPED (status))
-                        node->p->stopped = 1;
-                    else {
-                        node->p->completed = 1;
-                        if (WIFSIGNALED (status))
-                            fprintf (stderr, "%d: Terminated by signal %d.\n",
-                                     (int) pid, WTERMSIG (node->p->status));
-                    }
+                    set_process_status(node->p, status, usage);
                     return 0;
                 }
             }
@@ -292,21 +930,29 @@ int mark_process_status (pid_t pid, int status, struct job* j)
         return -1;
     else {
         /* Other weird errors.  */
-        perror ("almishell: waitpid");
+        perror ("almishell: wait4");
         return -1;
     }
 }
 
 /* Check for processes that have status information available,
    without blocking.  */
-void update_status(struct job *first_job)
+void update_status(struct shell_info *s)
 {
     int status;
     pid_t pid;
+    struct rusage usage;
+
+    if (s->watch) {
+        run_process_watch(s->watch, 0);
+        return;
+    }
+
+    check_deadlines(s);
 
     do
-        pid = waitpid (-1, &status, WUNTRACED|WNOHANG);
-    while (!mark_process_status (pid, status, first_job));
+        pid = wait4 (-1, &status, WUNTRACED|WNOHANG, &usage);
+    while (!mark_process_status (pid, status, &usage, s->first_job));
 }
 
 /* Return true if all processes in the job have stopped or completed.  */
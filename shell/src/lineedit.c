@@ -0,0 +1,207 @@
+/*
+ALMiSHELL - A POSIX conformant shell prototype.
+Copyright (C) 2017  Henrique C. S. M. Aranha; Lucas E. C. Mello; Lucas H. F. Leal
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <lineedit.h>
+#include <complete.h>
+#include <watch.h>
+
+#include <poll.h>
+#include <unistd.h>
+#include <termios.h>
+#include <errno.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CTRL_D 0x04
+#define CTRL_U 0x15
+#define ESCAPE 0x1b
+#define DELETE 0x7f
+
+struct line_buffer {
+    char *data;
+    size_t size;
+    size_t capacity;
+};
+
+static void insert_text(struct line_buffer *b, const char *text, size_t len)
+{
+    if(b->size + len + 1 > b->capacity) {
+        while(b->size + len + 1 > b->capacity)
+            b->capacity *= 2;
+        b->data = (char *) realloc(b->data, b->capacity);
+    }
+
+    memcpy(b->data + b->size, text, len);
+    b->size += len;
+    b->data[b->size] = '\0';
+
+    fwrite(text, 1, len, stdout);
+}
+
+static void list_candidates(struct shell_info *s, struct line_buffer *b, char **candidates)
+{
+    char **it;
+
+    printf("\n");
+    for(it = candidates; *it; ++it)
+        printf("%s%s", *it, it[1] ? "  " : "\n");
+
+    print_prompt(s->current_path);
+    fwrite(b->data, 1, b->size, stdout);
+}
+
+static void complete_word(struct shell_info *s, struct line_buffer *b)
+{
+    size_t start, common, i;
+    char **candidates = complete_line(s, b->data, b->size, &start);
+
+    if(!candidates || !candidates[0]) {
+        printf("\a");
+        free_candidates(candidates);
+        return;
+    }
+
+    /* Longest common prefix among the candidates */
+    common = strlen(candidates[0]);
+    for(i = 1; candidates[i]; ++i) {
+        size_t k = 0;
+
+        while(k < common && candidates[i][k] == candidates[0][k])
+            ++k;
+        common = k;
+    }
+
+    if(common > b->size - start) {
+        insert_text(b, candidates[0] + (b->size - start), common - (b->size - start));
+
+        if(!candidates[1] && candidates[0][common - 1] != '/')
+            insert_text(b, " ", 1);
+    } else if(candidates[1]) {
+        list_candidates(s, b, candidates);
+    }
+
+    free_candidates(candidates);
+}
+
+/* Discards the rest of an escape sequence, such as the arrow keys */
+static void skip_escape_sequence(int fd)
+{
+    char c;
+
+    if(read(fd, &c, 1) != 1 || (c != '[' && c != 'O'))
+        return;
+
+    while(read(fd, &c, 1) == 1 && !(c >= 0x40 && c <= 0x7e));
+}
+
+/* Reads a key from the terminal. The process watch is serviced while
+   waiting for it, so the background jobs are reaped and their deadlines
+   enforced at the prompt. */
+static ssize_t read_key(struct shell_info *s, char *c)
+{
+    struct pollfd fds[2];
+    int timeout;
+
+    fds[0].fd = s->terminal;
+    fds[1].fd = process_watch_fd(s->watch, &timeout);
+    fds[0].events = fds[1].events = POLLIN;
+
+    while(fds[1].fd >= 0) {
+        fds[0].revents = fds[1].revents = 0;
+
+        if(poll(fds, 2, timeout) < 0) {
+            if(errno != EINTR)
+                break;
+            continue;
+        }
+
+        if(fds[1].revents || timeout >= 0)
+            run_process_watch(s->watch, 0);
+
+        if(fds[0].revents)
+            break;
+
+        process_watch_fd(s->watch, &timeout);
+    }
+
+    return read(s->terminal, c, 1);
+}
+
+char *edit_line(struct shell_info *s)
+{
+    struct line_buffer b;
+    struct termios raw = s->tmodes;
+    ssize_t n;
+    char c;
+    int eof = 0;
+
+    b.capacity = 128;
+    b.size = 0;
+    b.data = (char *) malloc(b.capacity);
+    b.data[0] = '\0';
+
+    raw.c_lflag &= ~(ICANON | ECHO);
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+    tcsetattr(s->terminal, TCSADRAIN, &raw);
+
+    for(;;) {
+        fflush(stdout);
+
+        n = read_key(s, &c);
+        if(n < 0 && errno == EINTR)
+            continue;
+
+        if(n <= 0 || (c == CTRL_D && b.size == 0)) {
+            eof = 1;
+            break;
+        }
+
+        if(c == '\n' || c == '\r') {
+            printf("\n");
+            break;
+        } else if(c == DELETE || c == '\b') {
+            if(b.size) {
+                b.data[--b.size] = '\0';
+                printf("\b \b");
+            }
+        } else if(c == CTRL_U) {
+            for(; b.size; --b.size)
+                printf("\b \b");
+            b.data[0] = '\0';
+        } else if(c == '\t') {
+            complete_word(s, &b);
+        } else if(c == ESCAPE) {
+            skip_escape_sequence(s->terminal);
+        } else if((unsigned char) c >= ' ') {
+            insert_text(&b, &c, 1);
+        }
+    }
+
+    fflush(stdout);
+    tcsetattr(s->terminal, TCSADRAIN, &s->tmodes);
+
+    if(eof) {
+        free(b.data);
+        return NULL;
+    }
+
+    return b.data;
+}
@@ -0,0 +1,589 @@
+/*
+ALMiSHELL - A POSIX conformant shell prototype.
+Copyright (C) 2017  Henrique C. S. M. Aranha; Lucas E. C. Mello; Lucas H. F. Leal
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <memo.h>
+#include <shell.h>
+#include <process.h>
+#include <vars.h>
+#include <stats.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <errno.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MEMO_MAGIC "almishell memo 1\n"
+
+/* FNV-1a parameters */
+#define FNV_OFFSET (((uint64_t) 0xCBF29CE4UL << 32) | 0x84222325UL)
+#define FNV_PRIME (((uint64_t) 1 << 40) | 0x1B3)
+
+/* Key of a command, words separated by '\0' */
+struct memo_key {
+    char *data;
+    size_t size;
+    size_t capacity;
+};
+
+static void append_key(struct memo_key *k, const char *str, size_t len)
+{
+    if(k->size + len + 1 > k->capacity) {
+        while(k->size + len + 1 > k->capacity)
+            k->capacity *= 2;
+        k->data = (char *) realloc(k->data, k->capacity);
+    }
+
+    memcpy(k->data + k->size, str, len);
+    k->size += len;
+    k->data[k->size++] = '\0';
+}
+
+static void append_key_str(struct memo_key *k, const char *str)
+{
+    append_key(k, str, strlen(str));
+}
+
+int parse_job_memo(struct job_memo **m, char **argv)
+{
+    struct job_memo *r = (struct job_memo *) malloc(sizeof(struct job_memo));
+    int i;
+
+    r->inputs = (char **) malloc(sizeof(char *));
+    r->input_num = 0;
+    r->dir = NULL;
+    r->key = NULL;
+    r->key_size = 0;
+    r->name[0] = '\0';
+    r->capture[0] = r->capture[1] = -1;
+    r->output[0] = r->output[1] = -1;
+    r->limit = MEMO_DEFAULT_SIZE;
+    *m = r;
+
+    for(i = 1; argv[i] && argv[i][0] == '-'; i += 2) {
+        if(!strcmp(argv[i], "--")) {
+            ++i;
+            break;
+        }
+
+        if(!argv[i + 1] || (strcmp(argv[i], "-i") && strcmp(argv[i], "--inputs"))) {
+            fprintf(stderr, "almishell: %s: %s: invalid option\n", MEMO_COMMAND, argv[i]);
+            return -1;
+        }
+
+        r->inputs = (char **) realloc(r->inputs, (r->input_num + 1) * sizeof(char *));
+        r->inputs[r->input_num] = (char *) malloc(strlen(argv[i + 1]) + 1);
+        strcpy(r->inputs[r->input_num++], argv[i + 1]);
+    }
+
+    if(!argv[i]) {
+        fprintf(stderr, "usage: %s [-i file[:file...]]... command\n", MEMO_COMMAND);
+        return -1;
+    }
+
+    return i;
+}
+
+/* Adds the identity of the file to the key, its contents are assumed
+   unchanged while it is */
+static void append_file(struct memo_key *k, const char *path)
+{
+    struct stat st;
+    char identity[128];
+
+    append_key_str(k, path);
+
+    if(stat(path, &st) < 0) {
+        append_key_str(k, "missing");
+        return;
+    }
+
+    sprintf(identity, "%lu %ld.%09ld %lu %lu", (unsigned long) st.st_size,
+            (long) st.st_mtim.tv_sec, (long) st.st_mtim.tv_nsec,
+            (unsigned long) st.st_ino, (unsigned long) st.st_dev);
+    append_key_str(k, identity);
+}
+
+/* Adds the executable PATH finds for name, nothing for a builtin */
+static void append_executable(struct shell_info *s, struct memo_key *k, const char *name)
+{
+    const char *path = get_var(s->vars, "PATH"), *end;
+    char *candidate;
+    size_t len;
+
+    if(strchr(name, '/')) {
+        append_file(k, name);
+        return;
+    }
+
+    for(; path && *path; path = *end ? end + 1 : end) {
+        end = strchr(path, ':');
+        if(!end)
+            end = path + strlen(path);
+
+        len = end - path;
+        candidate = (char *) malloc(len + strlen(name) + 3);
+        sprintf(candidate, "%.*s/%s", (int) len, len ? path : ".", name);
+
+        if(access(candidate, X_OK) == 0) {
+            append_file(k, candidate);
+            free(candidate);
+            return;
+        }
+
+        free(candidate);
+    }
+}
+
+static int compare_strings(const void *a, const void *b)
+{
+    return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+static void build_key(struct shell_info *s, struct job_memo *m, const struct process *p)
+{
+    struct memo_key k;
+    char **envp = get_envp(s->vars), **sorted, *cwd, *list, *path;
+    size_t n, i;
+    uint64_t hash = FNV_OFFSET;
+
+    k.capacity = 1024;
+    k.size = 0;
+    k.data = (char *) malloc(k.capacity);
+
+    append_key_str(&k, "argv");
+    for(i = 0; p->argv[i]; ++i)
+        append_key_str(&k, p->argv[i]);
+
+    append_key_str(&k, "assign");
+    for(i = 0; p->assign && p->assign[i]; ++i)
+        append_key_str(&k, p->assign[i]);
+
+    append_key_str(&k, "cwd");
+    cwd = getcwd(NULL, 0);
+    append_key_str(&k, cwd ? cwd : "");
+    free(cwd);
+
+    /* The environment in a stable order, without $_ that changes with
+       every command */
+    append_key_str(&k, "env");
+    for(n = 0; envp[n]; ++n);
+    sorted = (char **) malloc((n + 1) * sizeof(char *));
+    memcpy(sorted, envp, (n + 1) * sizeof(char *));
+    qsort(sorted, n, sizeof(char *), compare_strings);
+    for(i = 0; i < n; ++i)
+        if(strncmp(sorted[i], "_=", 2))
+            append_key_str(&k, sorted[i]);
+    free(sorted);
+
+    append_key_str(&k, "files");
+    append_executable(s, &k, p->argv[0]);
+    for(i = 0; i < m->input_num; ++i) {
+        list = (char *) malloc(strlen(m->inputs[i]) + 1);
+        strcpy(list, m->inputs[i]);
+
+        for(path = strtok(list, ":"); path; path = strtok(NULL, ":"))
+            append_file(&k, path);
+
+        free(list);
+    }
+
+    /* FNV-1a, the entry also holds the key to tell collisions apart */
+    for(i = 0; i < k.size; ++i) {
+        hash ^= (unsigned char) k.data[i];
+        hash *= FNV_PRIME;
+    }
+
+    sprintf(m->name, "%08lx%08lx", (unsigned long) (hash >> 32),
+            (unsigned long) (hash & 0xFFFFFFFFUL));
+
+    m->key = k.data;
+    m->key_size = k.size;
+}
+
+/* Creates the directory and its missing parents */
+static int make_dirs(char *path)
+{
+    char *it;
+
+    for(it = path + 1; *it; ++it) {
+        if(*it != '/')
+            continue;
+
+        *it = '\0';
+        if(mkdir(path, 0700) < 0 && errno != EEXIST) {
+            *it = '/';
+            return -1;
+        }
+        *it = '/';
+    }
+
+    return mkdir(path, 0700) < 0 && errno != EEXIST ? -1 : 0;
+}
+
+static char *cache_dir(struct shell_info *s)
+{
+    const char *dir = get_var(s->vars, MEMO_DIR_VAR), *base;
+    char *path;
+
+    if(dir && dir[0]) {
+        path = (char *) malloc(strlen(dir) + 1);
+        strcpy(path, dir);
+    } else {
+        base = get_var(s->vars, "XDG_CACHE_HOME");
+
+        if(base && base[0]) {
+            path = (char *) malloc(strlen(base) + 32);
+            sprintf(path, "%s/almishell/memo", base);
+        } else {
+            if(!(base = get_var(s->vars, "HOME")))
+                return NULL;
+
+            path = (char *) malloc(strlen(base) + 32);
+            sprintf(path, "%s/.cache/almishell/memo", base);
+        }
+    }
+
+    if(make_dirs(path) < 0) {
+        fprintf(stderr, "almishell: %s: %s: %s\n", MEMO_COMMAND, path, strerror(errno));
+        free(path);
+        return NULL;
+    }
+
+    return path;
+}
+
+static unsigned long parse_size(const char *value)
+{
+    char *end;
+    unsigned long size;
+
+    if(!value || !value[0])
+        return MEMO_DEFAULT_SIZE;
+
+    size = strtoul(value, &end, 10);
+
+    switch(*end) {
+    case 'G': size <<= 10;    /* fall through */
+    case 'M': size <<= 10;    /* fall through */
+    case 'K': size <<= 10;
+    }
+
+    return size;
+}
+
+static char *entry_path(const struct job_memo *m, const char *name)
+{
+    char *path = (char *) malloc(strlen(m->dir) + strlen(name) + 2);
+
+    sprintf(path, "%s/%s", m->dir, name);
+
+    return path;
+}
+
+/* Copies size bytes, or everything if size is -1, from the stream or the
+   descriptor to fd. A closed fd (-1) swallows the data. */
+static int copy_data(FILE *from_stream, int from_fd, int fd, long size)
+{
+    char buffer[65536];
+    size_t chunk;
+    ssize_t n, written;
+
+    while(size) {
+        chunk = size < 0 || (unsigned long) size > sizeof(buffer) ? sizeof(buffer) : (size_t) size;
+
+        if(from_stream)
+            n = fread(buffer, 1, chunk, from_stream);
+        else
+            while((n = read(from_fd, buffer, chunk)) < 0 && errno == EINTR);
+
+        if(n <= 0)
+            return size < 0 && n == 0 ? 0 : -1;
+
+        for(written = 0; fd >= 0 && written < n; ) {
+            ssize_t w = write(fd, buffer + written, n - written);
+
+            if(w < 0 && errno != EINTR)
+                return -1;
+            if(w > 0)
+                written += w;
+        }
+
+        if(size > 0)
+            size -= n;
+    }
+
+    return 0;
+}
+
+/* Replays the entry if it holds the result for the key of m */
+static int replay_entry(struct job_memo *m, const int io[3], int *status)
+{
+    char *path = entry_path(m, m->name), *key;
+    FILE *entry = fopen(path, "rb");
+    unsigned long key_size, out_size, err_size;
+    char magic[sizeof(MEMO_MAGIC)];
+    int hit = 0;
+
+    free(path);
+
+    if(!entry)
+        return 0;
+
+    fflush(stdout);
+
+    if(fread(magic, 1, sizeof(MEMO_MAGIC) - 1, entry) == sizeof(MEMO_MAGIC) - 1
+       && !memcmp(magic, MEMO_MAGIC, sizeof(MEMO_MAGIC) - 1)
+       && fscanf(entry, "%lu %d %lu %lu", &key_size, status, &out_size, &err_size) == 4
+       && fgetc(entry) == '\n' && key_size == m->key_size) {
+        key = (char *) malloc(key_size);
+
+        if(fread(key, 1, key_size, entry) == key_size && !memcmp(key, m->key, key_size)) {
+            hit = 1;
+
+            /* The mtime of an entry is its last use */
+            futimens(fileno(entry), NULL);
+
+            copy_data(entry, -1, io[1], (long) out_size);
+            copy_data(entry, -1, io[2], (long) err_size);
+        }
+
+        free(key);
+    }
+
+    fclose(entry);
+
+    return hit;
+}
+
+/* Opens an unlinked file in the cache directory */
+static int open_capture(struct job_memo *m)
+{
+    char *path = entry_path(m, ".capture.XXXXXX");
+    int fd = mkstemp(path);
+
+    if(fd >= 0) {
+        unlink(path);
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+
+    free(path);
+
+    return fd;
+}
+
+/* Makes fd the descriptor target of p, after its own redirections */
+static void add_capture(struct process *p, int target, int fd)
+{
+    struct redirection *r;
+
+    p->redirects = (struct redirection *) realloc(p->redirects, (p->redirect_num + 1)
+                                                  * sizeof(struct redirection));
+    r = &p->redirects[p->redirect_num++];
+    r->fd = target;
+    r->source = fcntl(fd, F_DUPFD_CLOEXEC, 3);
+    r->opened = 1;
+    r->multio = 0;
+}
+
+int start_job_memo(struct shell_info *s, struct job_memo *m, struct process *p,
+                   const int io[3], int *status)
+{
+    int i;
+
+    if(!(m->dir = cache_dir(s)))
+        return 0;
+
+    m->limit = parse_size(get_var(s->vars, MEMO_SIZE_VAR));
+    build_key(s, m, p);
+
+    if(replay_entry(m, io, status)) {
+        STATS_ADD(STATS_MEMO_HITS, 1);
+        return 1;
+    }
+
+    STATS_ADD(STATS_MEMO_MISSES, 1);
+
+    for(i = 0; i < 2; ++i) {
+        if((m->capture[i] = open_capture(m)) < 0) {
+            perror("almishell: memo");
+            return 0;
+        }
+    }
+
+    for(i = 0; i < 2; ++i) {
+        m->output[i] = io[i + 1] >= 0 ? fcntl(io[i + 1], F_DUPFD_CLOEXEC, 3) : -1;
+        add_capture(p, i + 1, m->capture[i]);
+    }
+
+    return 0;
+}
+
+struct cached_entry {
+    char *name;
+    off_t size;
+    time_t used;
+};
+
+static int compare_use(const void *a, const void *b)
+{
+    const struct cached_entry *x = (const struct cached_entry *) a;
+    const struct cached_entry *y = (const struct cached_entry *) b;
+
+    return x->used < y->used ? -1 : x->used > y->used;
+}
+
+/* Removes the least recently used entries until the cache fits */
+static void evict_entries(struct job_memo *m)
+{
+    DIR *dir = opendir(m->dir);
+    struct dirent *d;
+    struct cached_entry *entries = NULL;
+    size_t n = 0, capacity = 0, i;
+    unsigned long total = 0;
+    struct stat st;
+    char *path;
+
+    if(!dir)
+        return;
+
+    while( (d = readdir(dir)) ) {
+        if(d->d_name[0] == '.')
+            continue;
+
+        path = entry_path(m, d->d_name);
+        if(stat(path, &st) == 0 && S_ISREG(st.st_mode)) {
+            if(n == capacity) {
+                capacity = capacity ? capacity * 2 : 64;
+                entries = (struct cached_entry *) realloc(entries, capacity
+                                                          * sizeof(struct cached_entry));
+            }
+
+            entries[n].name = path;
+            entries[n].size = st.st_size;
+            entries[n++].used = st.st_mtime;
+            total += st.st_size;
+        } else
+            free(path);
+    }
+
+    closedir(dir);
+
+    if(total > m->limit)
+        qsort(entries, n, sizeof(struct cached_entry), compare_use);
+
+    for(i = 0; i < n; ++i) {
+        if(total > m->limit && unlink(entries[i].name) == 0)
+            total -= entries[i].size;
+        free(entries[i].name);
+    }
+
+    free(entries);
+}
+
+static void store_entry(struct job_memo *m, int status)
+{
+    char *temporary = entry_path(m, ".entry.XXXXXX"), *path;
+    off_t sizes[2];
+    FILE *entry;
+    int fd, i, failed;
+
+    for(i = 0; i < 2; ++i)
+        sizes[i] = lseek(m->capture[i], 0, SEEK_END);
+
+    if((fd = mkstemp(temporary)) < 0 || !(entry = fdopen(fd, "wb"))) {
+        if(fd >= 0)
+            close(fd);
+        free(temporary);
+        return;
+    }
+
+    fprintf(entry, "%s%lu %d %lu %lu\n", MEMO_MAGIC, (unsigned long) m->key_size, status,
+            (unsigned long) sizes[0], (unsigned long) sizes[1]);
+    fwrite(m->key, 1, m->key_size, entry);
+    fflush(entry);
+
+    for(failed = 0, i = 0; i < 2 && !failed; ++i)
+        failed = lseek(m->capture[i], 0, SEEK_SET) < 0
+                 || copy_data(NULL, m->capture[i], fd, sizes[i]) < 0;
+
+    /* Renamed into place, so a reader never sees half an entry */
+    path = entry_path(m, m->name);
+    if(fclose(entry) != 0 || failed || rename(temporary, path) < 0)
+        unlink(temporary);
+
+    free(path);
+    free(temporary);
+
+    evict_entries(m);
+}
+
+void finish_job_memo(struct job_memo *m, const struct process *p)
+{
+    int i;
+
+    if(m->capture[0] < 0)
+        return;
+
+    fflush(stdout);
+
+    for(i = 0; i < 2; ++i)
+        if(lseek(m->capture[i], 0, SEEK_SET) == 0)
+            copy_data(NULL, m->capture[i], m->output[i], -1);
+
+    /* A command killed by a signal is run again next time */
+    if(p->completed && WIFEXITED(p->status))
+        store_entry(m, WEXITSTATUS(p->status));
+
+    for(i = 0; i < 2; ++i) {
+        close(m->capture[i]);
+        if(m->output[i] >= 0)
+            close(m->output[i]);
+        m->capture[i] = m->output[i] = -1;
+    }
+}
+
+void delete_job_memo(struct job_memo *m)
+{
+    size_t i;
+
+    if(!m)
+        return;
+
+    for(i = 0; i < m->input_num; ++i)
+        free(m->inputs[i]);
+    free(m->inputs);
+
+    for(i = 0; i < 2; ++i) {
+        if(m->capture[i] >= 0)
+            close(m->capture[i]);
+        if(m->output[i] >= 0)
+            close(m->output[i]);
+    }
+
+    free(m->dir);
+    free(m->key);
+    free(m);
+}
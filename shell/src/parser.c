@@ -17,176 +17,840 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include <parser.h>
+#include <expand.h>
+#include <vars.h>
+#include <wildcard.h>
+#include <stats.h>
+#include <substitution.h>
+
+#include <sys/mman.h>
 
 #include <limits.h>
 #include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
 
 #include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+/* Returns the first of the separators in str, or NULL. The operators
+   inside an arithmetic expansion $((...)) or a process substitution <(...)
+   or >(...) do not separate anything. */
+static char *find_separator(char *str, const char *separators)
+{
+    int depth = 0;
+
+    for(; *str; ++str) {
+        if(depth) {
+            if(*str == '(')
+                ++depth;
+            else if(*str == ')')
+                --depth;
+        } else if(str[0] == '$' && str[1] == '(' && str[2] == '(') {
+            depth = 2;
+            str += 2;
+        } else if((str[0] == '<' || str[0] == '>') && str[1] == '(') {
+            depth = 1;
+            ++str;
+        } else if(strchr(separators, *str)) {
+            return str;
+        }
+    }
+
+    return NULL;
+}
+
+/* strtok, without its state, for the separators find_separator sees */
+static char *split_word(char **rest, const char *separators)
+{
+    char *word = *rest + strspn(*rest, separators), *end;
+
+    if(!*word) {
+        *rest = word;
+        return NULL;
+    }
+
+    if( (end = find_separator(word, separators)) ) {
+        *end = '\0';
+        *rest = end + 1;
+    } else {
+        *rest = word + strlen(word);
+    }
+
+    return word;
+}
+
 size_t count_pipes(char *command_line)
 {
     size_t pipe_num = 0;
-    char *pipe_pos = strchr(command_line, '|');
+    char *pipe_pos = find_separator(command_line, "|");
 
     if(!pipe_pos)
         return 0;
 
     ++pipe_num;
 
-    while( (pipe_pos = strchr(&pipe_pos[1], '|')) )
+    while( (pipe_pos = find_separator(&pipe_pos[1], "|")) )
         ++pipe_num;
 
     return pipe_num;
 }
 
-struct process *parse_process(char *command)
+char parse_last_ampersand(char *command_line)
 {
-    const char *command_delim = "\t ";
-    struct process *p = init_process();
-    char *args[_POSIX_ARG_MAX];
-    int argc = 0, i, p_argc;
+    size_t i = 1;
+    char *ampersand = strrchr(command_line, '&');
 
-    args[argc++] = strtok(command, command_delim);
-    if(!args[0]) {
-        free(p);
-        return NULL;
+    /* If & is not found, there's no need to remove it */
+    if(!ampersand)
+        return 'f';
+
+    /* Skip spaces */
+    while(isspace(ampersand[i])) ++i;
+
+    /* If there were only spaces after the ampersand, remove it and the space */
+    if(ampersand[i] == '\0') {
+        ampersand[0] = '\0';
+        return 'b'; /* Signal background */
+    } else if(ampersand[i] == '<' || ampersand[i] == '>') { /* If the & is followed by file redirection */
+        ampersand[0] = ' ';
+        return 'b'; /* Signal background */
     }
 
-    while( (argc < _POSIX_ARG_MAX) && (args[argc++] = strtok(NULL, command_delim)) );
+    return 'f'; /* Signal foreground */
+}
+
+struct program *init_program(void)
+{
+    struct program *prog = (struct program *) malloc(sizeof(struct program));
+
+    prog->capacity = 1024;
+    prog->size = sizeof(struct program_header);
+    prog->data = (char *) calloc(prog->capacity, 1);
+    prog->last_job = 0;
+    prog->function = NULL;
+    prog->body = NULL;
+    prog->body_size = 0;
+    prog->depth = 0;
+
+    memcpy(prog->data, PROGRAM_MAGIC, sizeof(PROGRAM_MAGIC));
+    PROGRAM_RECORD(prog, struct program_header, 0)->format = PROGRAM_FORMAT;
 
-    p->argv = (char **) malloc(argc-- * sizeof(char *));
+    return prog;
+}
+
+void delete_program(struct program *prog)
+{
+    if(!prog)
+        return;
+
+    if(prog->capacity)
+        free(prog->data);
+    else
+        munmap(prog->data, prog->size);
+
+    free(prog->function);
+    free(prog->body);
+    free(prog);
+}
+
+/* Reserves zeroed, aligned space in the program and returns its offset */
+static uint32_t reserve_record(struct program *prog, size_t size)
+{
+    size_t offset = (prog->size + 7) & ~(size_t) 7;
 
-    for(p_argc = 0, i = 0; args[i]; ++i) {
-        p->argv[p_argc] = (char*) malloc((strlen(args[i]) + 1) * sizeof(char));
-        strcpy(p->argv[p_argc++], args[i]);
+    if(offset + size > prog->capacity) {
+        while(offset + size > prog->capacity)
+            prog->capacity *= 2;
+        prog->data = (char *) realloc(prog->data, prog->capacity);
     }
 
-    p->argv[p_argc] = (char*)NULL;
+    memset(prog->data + prog->size, 0, offset + size - prog->size);
+    prog->size = offset + size;
 
-    return p;
+    return (uint32_t) offset;
+}
+
+uint32_t program_add_string(struct program *prog, const char *str)
+{
+    size_t len = strlen(str) + 1;
+    uint32_t offset;
+
+    if(prog->size + len > prog->capacity) {
+        while(prog->size + len > prog->capacity)
+            prog->capacity *= 2;
+        prog->data = (char *) realloc(prog->data, prog->capacity);
+    }
+
+    offset = (uint32_t) prog->size;
+    memcpy(prog->data + offset, str, len);
+    prog->size += len;
+
+    return offset;
+}
+
+/* Recognizes the redirection operators [n]<, [n]>, [n]>>, [n]<& and [n]>&,
+   not followed by '('.
+   Returns the length of the operator, 0 if word is not a redirection. */
+static size_t parse_redirect_operator(const char *word, int32_t *fd, uint32_t *type)
+{
+    size_t len = 0;
+
+    *fd = -1;
+    while(isdigit((unsigned char) word[len]))
+        *fd = (*fd < 0 ? 0 : *fd * 10) + (word[len++] - '0');
+
+    /* <(...) and >(...) are words */
+    if((word[len] != '<' && word[len] != '>') || word[len + 1] == '(')
+        return 0;
+
+    if(*fd < 0)
+        *fd = word[len] == '<' ? STDIN_FILENO : STDOUT_FILENO;
+
+    if(word[len + 1] == '&') {
+        *type = word[len] == '<' ? REDIRECT_DUPLICATE_INPUT : REDIRECT_DUPLICATE;
+        return len + 2;
+    } else if(word[len] == '>' && word[len + 1] == '>') {
+        *type = REDIRECT_APPEND;
+        return len + 2;
+    }
+
+    *type = word[len] == '<' ? REDIRECT_INPUT : REDIRECT_OUTPUT;
+
+    return len + 1;
 }
 
-struct process *parse_last_process(struct job *j, char *command)
+/* Writes the words of command into the process record at offset. The
+   redirection target is either attached to the operator or the next word.
+   Returns the number of words, or -1 if a redirection lacks its target. */
+static int compile_process(struct program *prog, uint32_t record, char *command)
 {
     const char *command_delim = "\t ";
-    struct process *p = init_process();
-    char *args[_POSIX_ARG_MAX];
-    int argc = 0, i, p_argc, fd;
+    size_t args_capacity = 16;
+    char **args, *rest = command, *word = split_word(&rest, command_delim);
+    int argc = 0, i, word_num = 0, redirect_num = 0;
+    uint32_t words, redirects, offset, type;
+    int32_t fd;
+    size_t len;
+
+    if(!word)
+        return 0;
+
+    /* The words are only limited by the exec argument space */
+    args = (char **) malloc(args_capacity * sizeof(char *));
+    args[argc++] = word;
+
+    while( (args[argc] = split_word(&rest, command_delim)) ) {
+        if((size_t) ++argc == args_capacity) {
+            args_capacity *= 2;
+            args = (char **) realloc(args, args_capacity * sizeof(char *));
+        }
+    }
+
+    words = reserve_record(prog, argc * sizeof(uint32_t));
+    redirects = reserve_record(prog, argc * sizeof(struct redirect_record));
+
+    for(i = 0; i < argc; ++i) {
+        if( (len = parse_redirect_operator(args[i], &fd, &type)) ) {
+            struct redirect_record *r;
+            const char *target = &args[i][len];
+
+            /* The target is either attached or the next word */
+            if(!*target) {
+                if(++i == argc) {
+                    free(args);
+                    return -1;
+                }
+                target = args[i];
+            }
+
+            offset = program_add_string(prog, target);
+            r = &PROGRAM_RECORD(prog, struct redirect_record, redirects)[redirect_num++];
+            r->type = type;
+            r->fd = fd;
+            r->target = offset;
+            continue;
+        }
+
+        offset = program_add_string(prog, args[i]);
+        PROGRAM_RECORD(prog, uint32_t, words)[word_num++] = offset;
+    }
+
+    PROGRAM_RECORD(prog, struct process_record, record)->word_num = word_num;
+    PROGRAM_RECORD(prog, struct process_record, record)->words = words;
+    PROGRAM_RECORD(prog, struct process_record, record)->redirect_num = redirect_num;
+    PROGRAM_RECORD(prog, struct process_record, record)->redirects = redirects;
+
+    free(args);
+
+    return argc;
+}
+
+/* Appends the job record to the job list */
+static void link_job(struct program *prog, uint32_t job)
+{
+    if(prog->last_job)
+        PROGRAM_RECORD(prog, struct job_record, prog->last_job)->next = job;
+    else
+        PROGRAM_RECORD(prog, struct program_header, 0)->first_job = job;
+    prog->last_job = job;
+}
+
+/* Appends an erroneous job record for command, returns -1 */
+static int add_syntax_error(struct program *prog, const char *command)
+{
+    uint32_t job = reserve_record(prog, sizeof(struct job_record));
+    uint32_t offset = program_add_string(prog, command);
+
+    PROGRAM_RECORD(prog, struct job_record, job)->command = offset;
+    PROGRAM_RECORD(prog, struct job_record, job)->syntax_error = -1;
+    link_job(prog, job);
+
+    return -1;
+}
+
+/* Compiles a pipeline, see compile_command_line */
+static int compile_job(struct program *prog, const char *command_line)
+{
+    size_t i = 0, command_num;
+    const char *command_delim = "|";
+    char *line = (char *) malloc(strlen(command_line) + 1), **commands, *rest;
+    uint32_t job, command, processes;
+    int result = 0;
+    char background;
+
+    strcpy(line, command_line);
+    background = parse_last_ampersand(line);
+    command_num = count_pipes(line) + 1;
+    commands = (char **) malloc(sizeof(char *) * command_num);
+
+    /* Records are addressed by offset, the data moves as the program grows */
+    job = reserve_record(prog, sizeof(struct job_record));
+    command = program_add_string(prog, line);
+    PROGRAM_RECORD(prog, struct job_record, job)->background = background;
+    PROGRAM_RECORD(prog, struct job_record, job)->command = command;
+
+    rest = line;
+    commands[i++] = split_word(&rest, command_delim);
+    while( (i < command_num) && (commands[i++] = split_word(&rest, command_delim)) );
+
+    processes = reserve_record(prog, command_num * sizeof(struct process_record));
+
+    /* The pipeline is split entirely before compiling the processes */
+    for(i = 0; i < command_num && result == 0; ++i) {
+        uint32_t record = processes + i * sizeof(struct process_record);
+        int word_num = commands[i] ? compile_process(prog, record, commands[i]) : -1;
+
+        if(word_num < 0)
+            result = -1;
+        else if(!word_num)
+            result = command_num > 1 ? -1 : 1;
+    }
+
+    free(commands);
+    free(line);
+
+    if(result == 1) {
+        /* Nothing to run, drop the record */
+        prog->size = job;
+        return result;
+    }
+
+    PROGRAM_RECORD(prog, struct job_record, job)->process_num = command_num;
+    PROGRAM_RECORD(prog, struct job_record, job)->processes = processes;
+    PROGRAM_RECORD(prog, struct job_record, job)->syntax_error = result;
+
+    link_job(prog, job);
+
+    return result;
+}
+
+static char *skip_blanks(char *str)
+{
+    while(isspace((unsigned char) *str))
+        ++str;
+
+    return str;
+}
+
+/* If command starts with "name ( )", stores name in a new *name and
+   returns what follows the parentheses, else returns NULL */
+static char *parse_definition(char *command, char **name)
+{
+    char *rest;
+    size_t len = var_name_len(command);
+
+    if(!len)
+        return NULL;
+
+    rest = skip_blanks(command + len);
+    if(*rest != '(')
+        return NULL;
 
-    args[argc++] = strtok(command, command_delim);
-    if(!args[0]) {
-        free(p);
+    rest = skip_blanks(rest + 1);
+    if(*rest != ')')
         return NULL;
+
+    *name = (char *) malloc(len + 1);
+    memcpy(*name, command, len);
+    (*name)[len] = '\0';
+
+    return skip_blanks(rest + 1);
+}
+
+static void append_body(struct program *prog, const char *command)
+{
+    size_t len = strlen(command);
+
+    prog->body = (char *) realloc(prog->body, prog->body_size + len + 2);
+    memcpy(prog->body + prog->body_size, command, len);
+    prog->body_size += len;
+    prog->body[prog->body_size++] = '\n';
+    prog->body[prog->body_size] = '\0';
+}
+
+/* Closes the open definition, appending its record */
+static int end_definition(struct program *prog)
+{
+    uint32_t job = reserve_record(prog, sizeof(struct job_record)), name, body;
+
+    name = program_add_string(prog, prog->function);
+    body = program_add_string(prog, prog->body ? prog->body : "");
+    PROGRAM_RECORD(prog, struct job_record, job)->command = name;
+    PROGRAM_RECORD(prog, struct job_record, job)->function = name;
+    PROGRAM_RECORD(prog, struct job_record, job)->body = body;
+    link_job(prog, job);
+
+    free(prog->function);
+    free(prog->body);
+    prog->function = prog->body = NULL;
+    prog->body_size = 0;
+
+    return 0;
+}
+
+/* Compiles a command of a list, which may be part of a definition */
+static int compile_command(struct program *prog, char *command)
+{
+    char *text = skip_blanks(command), *end = text + strlen(text), *rest, *name;
+
+    while(end > text && isspace((unsigned char) end[-1]))
+        *--end = '\0';
+
+    if(!prog->function) {
+        if(!(rest = parse_definition(text, &name)))
+            return compile_job(prog, text);
+
+        prog->function = name;
+        prog->depth = 0;
+
+        /* The body may start on a later line */
+        return *rest ? compile_command(prog, rest) : 1;
+    }
+
+    if(!*text)
+        return 1;
+
+    if(!prog->depth) {
+        if(*text != '{') {
+            free(prog->function);
+            prog->function = NULL;
+            return add_syntax_error(prog, text);
+        }
+
+        prog->depth = 1;
+        if(!*(text = skip_blanks(text + 1)))
+            return 1;
+    }
+
+    /* Braces are counted so nested definitions end where they should */
+    if(!strcmp(text, "}")) {
+        if(!--prog->depth)
+            return end_definition(prog);
+    } else if(*text == '{') {
+        ++prog->depth;
+    } else if( (rest = parse_definition(text, &name)) ) {
+        free(name);
+        if(*rest == '{')
+            ++prog->depth;
+    }
+
+    append_body(prog, text);
+
+    return 1;
+}
+
+int compile_command_line(struct program *prog, const char *command_line)
+{
+    char *line = (char *) malloc(strlen(command_line) + 1), *command, *next;
+    int result = 1, command_result;
+    struct timespec start;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    strcpy(line, command_line);
+
+    for(command = line; command; command = next) {
+        if( (next = find_separator(command, ";")) )
+            *next++ = '\0';
+
+        command_result = compile_command(prog, command);
+
+        if(command_result < 0 || (command_result == 0 && result > 0))
+            result = command_result;
+    }
+
+    free(line);
+
+    stats_time(STATS_PARSE, &start);
+
+    return result;
+}
+
+int program_incomplete(const struct program *prog)
+{
+    return prog->function != NULL;
+}
+
+void finish_program(struct program *prog)
+{
+    if(!prog->function)
+        return;
+
+    add_syntax_error(prog, prog->function);
+
+    free(prog->function);
+    free(prog->body);
+    prog->function = prog->body = NULL;
+    prog->body_size = 0;
+}
+
+static struct program *compile_lines(const char *commands, int read)
+{
+    struct program *prog = init_program();
+    char *copy = (char *) malloc(strlen(commands) + 1), *line, *next;
+
+    strcpy(copy, commands);
+
+    for(line = copy; line; line = next) {
+        if( (next = strchr(line, '\n')) )
+            *next++ = '\0';
+
+        if(line[0]) {
+            if(read)
+                STATS_ADD(STATS_LINES, 1);
+            compile_command_line(prog, line);
+        }
     }
 
-    while( (argc < _POSIX_ARG_MAX) && (args[argc++] = strtok(NULL, command_delim)) );
+    free(copy);
+    finish_program(prog);
 
-    p->argv = (char **) malloc(argc-- * sizeof(char *));
+    return prog;
+}
 
-    for(p_argc = 0, i = 0; args[i]; ++i) {
-        int true_arg = 1;
+struct program *compile_program(const char *commands)
+{
+    return compile_lines(commands, 1);
+}
 
-        if(i + 1 != argc) {
-            if(args[i][0] == '<') {
-                fd = open(args[++i], O_RDONLY);
+struct program *compile_nested_program(const char *commands)
+{
+    return compile_lines(commands, 0);
+}
 
-                if(fd < 0)
-                    perror("almishell: open");
-                else
-                    j->io[0] = fd;
+uint32_t program_first_job(const struct program *prog)
+{
+    return PROGRAM_RECORD(prog, struct program_header, 0)->first_job;
+}
 
-                true_arg = 0;
-            } else if(args[i][0] == '>') {
-                fd = open(args[++i], O_WRONLY|O_CREAT, 0666);
+uint32_t program_next_job(const struct program *prog, uint32_t job_offset)
+{
+    return PROGRAM_RECORD(prog, struct job_record, job_offset)->next;
+}
 
-                if(fd < 0)
-                    perror("almishell: open");
-                else
-                    j->io[1] = fd;
+const char *program_job_function(const struct program *prog, uint32_t job_offset,
+                                 const char **body)
+{
+    const struct job_record *record = PROGRAM_RECORD(prog, struct job_record, job_offset);
 
-                true_arg = 0;
+    if(!record->function)
+        return NULL;
+
+    *body = prog->data + record->body;
+
+    return prog->data + record->function;
+}
+
+/* Adds the redirection to the process, opening its file. On error the
+   process is marked so it does not run. Returns 0 if the target could not
+   be expanded, 1 otherwise. */
+static int add_redirection(struct shell_info *s, struct process *p, const struct program *prog,
+                           const struct redirect_record *r)
+{
+    struct redirection *redir = &p->redirects[p->redirect_num];
+    char *target, *end;
+    int flags = O_CLOEXEC;
+
+    /* < <(...) and > >(...) take the pipe end itself */
+    if(is_process_substitution(prog->data + r->target) && r->type != REDIRECT_DUPLICATE
+       && r->type != REDIRECT_DUPLICATE_INPUT) {
+        redir->fd = r->fd;
+        redir->opened = 1;
+        redir->multio = r->type == REDIRECT_OUTPUT || r->type == REDIRECT_APPEND;
+
+        if((redir->source = substitute_process(s, prog->data + r->target)) < 0) {
+            p->redirect_failed = 1;
+            return 0;
+        }
+
+        ++p->redirect_num;
+        return 1;
+    }
+
+    if(!(target = expand_parameters(s, prog->data + r->target))) {
+        p->redirect_failed = 1;
+        return 0;
+    }
+
+    redir->fd = r->fd;
+    redir->opened = 0;
+    redir->multio = r->type == REDIRECT_OUTPUT || r->type == REDIRECT_APPEND;
+
+    switch(r->type) {
+    case REDIRECT_DUPLICATE:
+    case REDIRECT_DUPLICATE_INPUT:
+        if(!strcmp(target, "-")) {
+            redir->source = -1;
+        } else if(!strcmp(target, "p")) {
+            /* The shell end of the pipe to or from the last coprocess */
+            redir->source = coproc_fd(s, r->type == REDIRECT_DUPLICATE);
+
+            if(redir->source < 0) {
+                fprintf(stderr, "almishell: %s: no coprocess\n", target);
+                p->redirect_failed = 1;
+                free(target);
+                return 1;
+            }
+        } else {
+            redir->source = (int) strtol(target, &end, 10);
+
+            if(!isdigit((unsigned char) target[0]) || *end) {
+                fprintf(stderr, "almishell: %s: ambiguous redirect\n", target);
+                p->redirect_failed = 1;
+                free(target);
+                return 1;
             }
         }
+        break;
+
+    case REDIRECT_INPUT:
+        flags |= O_RDONLY;
+        break;
+
+    case REDIRECT_OUTPUT:
+        flags |= O_WRONLY | O_CREAT | O_TRUNC;
+        break;
 
-        if(true_arg) {
-            p->argv[p_argc] = (char*) malloc((strlen(args[i]) + 1) * sizeof(char));
-            strcpy(p->argv[p_argc++], args[i]);
+    case REDIRECT_APPEND:
+        flags |= O_WRONLY | O_CREAT | O_APPEND;
+        break;
+    }
+
+    if(r->type != REDIRECT_DUPLICATE && r->type != REDIRECT_DUPLICATE_INPUT) {
+        /* Opened close-on-exec, the child gets its copy through dup2 */
+        redir->source = open(target, flags, 0666);
+        redir->opened = 1;
+
+        if(redir->source < 0) {
+            fprintf(stderr, "almishell: %s: %s\n", target, strerror(errno));
+            p->redirect_failed = 1;
+            free(target);
+            return 1;
         }
     }
 
-    p->argv[p_argc] = (char*)NULL;
+    ++p->redirect_num;
+    free(target);
 
-    return p;
+    return 1;
 }
 
-char parse_last_ampersand(char *command_line)
+/* Launches the substitution and returns the /dev/fd path of its pipe end,
+   which p keeps open at its number */
+static char *substitution_word(struct shell_info *s, struct process *p, const char *arg)
 {
-    size_t i = 1;
-    char *ampersand = strrchr(command_line, '&');
+    struct redirection *keep;
+    char *path;
+    int fd = substitute_process(s, arg);
 
-    /* If & is not found, there's no need to remove it */
-    if(!ampersand)
-        return 'f';
+    if(fd < 0)
+        return NULL;
 
-    /* Skip spaces */
-    while(isspace(ampersand[i])) ++i;
+    p->redirects = (struct redirection *) realloc(p->redirects, (p->redirect_num + 1)
+                                                  * sizeof(struct redirection));
+    keep = &p->redirects[p->redirect_num++];
+    keep->fd = fd;
+    keep->source = fd;
+    keep->opened = 1;
+    keep->multio = 0;
 
-    /* If there were only spaces after the ampersand, remove it and the space */
-    if(ampersand[i] == '\0') {
-        ampersand[0] = '\0';
-        return 'b'; /* Signal background */
-    } else if(ampersand[i] == '<' || ampersand[i] == '>') { /* If the & is followed by file redirection */
-        ampersand[0] = ' ';
-        return 'b'; /* Signal background */
+    path = (char *) malloc(32);
+    sprintf(path, "/dev/fd/%d", fd);
+
+    return path;
+}
+
+/* Builds a process from its compiled words. Leading assignments go to the
+   process assign list. Sets *failed if an expansion failed, the process is
+   still complete. */
+static struct process *instantiate_process(struct shell_info *s,
+                                           const struct program *prog,
+                                           const struct process_record *record,
+                                           int *failed)
+{
+    const uint32_t *words = PROGRAM_RECORD(prog, uint32_t, record->words);
+    struct process *p = init_process();
+    size_t argv_capacity = record->word_num + 1;
+    int argc = record->word_num, i, p_argc, assign_num = 0, kept = 0;
+
+    for(i = 3; i < SHELL_FD_MAX; ++i)
+        kept += s->fds[i] >= 0;
+
+    if(record->redirect_num + kept)
+        p->redirects = (struct redirection *) malloc((record->redirect_num + kept)
+                                                     * sizeof(struct redirection));
+
+    /* The descriptors kept by exec come first, so n>&m can refer to them */
+    for(i = 3; i < SHELL_FD_MAX; ++i) {
+        if(s->fds[i] >= 0) {
+            p->redirects[p->redirect_num].fd = i;
+            p->redirects[p->redirect_num].source = s->fds[i];
+            p->redirects[p->redirect_num].multio = 0;
+            p->redirects[p->redirect_num++].opened = 0;
+        }
     }
 
-    return 'f'; /* Signal foreground */
+    for(i = 0; i < (int) record->redirect_num && !p->redirect_failed; ++i)
+        if(!add_redirection(s, p, prog, &PROGRAM_RECORD(prog, struct redirect_record,
+                                                        record->redirects)[i]))
+            *failed = 1;
+
+    p->argv = (char **) malloc(argv_capacity * sizeof(char *));
+
+    for(p_argc = 0, i = 0; i < argc; ++i) {
+        const char *arg = prog->data + words[i];
+        char *word, **matches, **match;
+
+        if(p_argc == 0 && is_assignment(arg)) {
+            if(!p->assign)
+                p->assign = (char **) calloc(argc + 1, sizeof(char *));
+
+            if( (p->assign[assign_num] = expand_parameters(s, arg)) )
+                ++assign_num;
+            else
+                *failed = 1;
+            continue;
+        }
+
+        if(is_process_substitution(arg)) {
+            if(!(word = substitution_word(s, p, arg))) {
+                *failed = 1;
+                continue;
+            }
+        } else if(!(word = expand_parameters(s, arg))) {
+            *failed = 1;
+            continue;
+        }
+
+        /* An expansion to nothing produces no argument */
+        if(!word[0] && strchr(arg, '$')) {
+            free(word);
+            continue;
+        }
+
+        /* Pathname expansion, a pattern matching nothing is kept as is */
+        matches = has_wildcards(word) ? expand_wildcards(s, word) : NULL;
+        if(matches)
+            free(word);
+
+        for(match = matches; !matches || *match; ++match) {
+            /* Room for the remaining words and the terminating NULL */
+            if((size_t) (p_argc + argc - i) >= argv_capacity) {
+                argv_capacity = (p_argc + argc - i) * 2;
+                p->argv = (char **) realloc(p->argv, argv_capacity * sizeof(char *));
+            }
+
+            if(!matches) {
+                p->argv[p_argc++] = word;
+                break;
+            }
+
+            p->argv[p_argc++] = *match;
+        }
+
+        free(matches);
+    }
+
+    p->argv[p_argc] = (char*)NULL;
+
+    return p;
 }
 
-struct job *parse_command_line(char *command_line)
+struct job *instantiate_job(struct shell_info *s, const struct program *prog,
+                            uint32_t job_offset)
 {
-    size_t i = 0, command_num = count_pipes(command_line) + 1;
-    const char *command_delim = "|";
-    char **commands = (char **) malloc(sizeof(char *) * command_num);
+    const struct job_record *record = PROGRAM_RECORD(prog, struct job_record, job_offset);
     struct job *j;
     struct process_node **next, *current;
-    char background = parse_last_ampersand(command_line);
+    uint32_t i;
+    int failed = 0;
 
-    j = init_job(command_line, background);
-    next = &j->first_process;
+    if(record->syntax_error) {
+        fprintf(stderr, "almishell: syntax error\n");
+        return NULL;
+    }
 
-    commands[i++] = strtok(command_line, command_delim);
-    while( (i < command_num) && (commands[i++] = strtok(NULL, command_delim)) );
+    j = init_job(prog->data + record->command, record->background);
+    memcpy(j->io, s->io, sizeof(j->io));
+    next = &j->first_process;
 
-    i = 0;
-    while( (i + 1 < command_num) && commands[i] ) {
+    for(i = 0; i < record->process_num; ++i) {
         current = (struct process_node *) malloc(sizeof(struct process_node));
-        current->p = parse_process(commands[i]);
+        current->p = instantiate_process(s, prog,
+                                         &PROGRAM_RECORD(prog, struct process_record,
+                                                         record->processes)[i],
+                                         &failed);
         current->next = NULL;
 
         *next = current;
         next = &current->next;
-
-        ++i;
     }
 
-    /* Handle last process */
-    current = (struct process_node *) malloc(sizeof(struct process_node));
-    current->p = parse_last_process(j, commands[i]);
-    current->next = NULL;
-    *next = current;
-
-    j->size = command_num;
+    j->size = record->process_num;
 
-    if(i < command_num && !commands[i]) {
+    /* The expansion reported its own error */
+    if(failed) {
         delete_job(j);
-        j = NULL;
+        return NULL;
     }
 
-    free(commands);
+    return j;
+}
+
+struct job *parse_command_line(struct shell_info *s, char *command_line)
+{
+    struct program *prog = init_program();
+    struct job *j = NULL;
+    const char *body;
+
+    if(compile_command_line(prog, command_line) != 1
+       && !program_job_function(prog, program_first_job(prog), &body))
+        j = instantiate_job(s, prog, program_first_job(prog));
+
+    delete_program(prog);
 
     return j;
 }
@@ -16,12 +16,23 @@ You should have received a copy of the GNU General Public License
 along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#define _GNU_SOURCE /* syscall, tee, splice */
+
 #include <sys/signal.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <fcntl.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <errno.h>
 
 #include <process.h>
+#include <vars.h>
+#include <batch.h>
+#include <function.h>
+
+extern char **environ;
 
 /* Create process with default values */
 struct process *init_process()
@@ -29,20 +40,455 @@ struct process *init_process()
     struct process *p = (struct process *) malloc(sizeof(struct process));
 
     p->argv = NULL;
+    p->assign = NULL;
+    p->redirects = NULL;
+    p->redirect_num = 0;
+    p->redirect_failed = 0;
+    p->piped = 0;
     p->completed = 0;
     p->pid = -1;
+    p->pidfd = -1;
     p->status = 0;
     p->stopped = 0;
+    memset(&p->usage, 0, sizeof(p->usage));
+    p->sample = NULL;
 
     return p;
 }
 
-void run_process(struct shell_info *s, struct process *p, pid_t pgid, int io[3], char bg)
+size_t resolve_redirections(const struct process *p, const int io[3], int *targets, int *sources)
+{
+    size_t i, k, size = 3;
+
+    for(i = 0; i < 3; ++i) {
+        targets[i] = i;
+        sources[i] = io[i];
+    }
+
+    for(i = 0; i < p->redirect_num; ++i) {
+        const struct redirection *r = &p->redirects[i];
+        int source = r->source;
+
+        /* n>&m copies whatever m refers to at this point */
+        if(!r->opened && source >= 0)
+            for(k = 0; k < size; ++k)
+                if(targets[k] == source)
+                    source = sources[k];
+
+        for(k = 0; k < size && targets[k] != r->fd; ++k);
+
+        if(k == size)
+            targets[size++] = r->fd;
+        sources[k] = source;
+    }
+
+    return size;
+}
+
+void close_redirections(struct process *p)
+{
+    size_t i;
+
+    for(i = 0; i < p->redirect_num; ++i) {
+        if(p->redirects[i].opened) {
+            close(p->redirects[i].source);
+            p->redirects[i].opened = 0;
+            p->redirects[i].source = -1;
+        }
+    }
+}
+
+static void close_fd_range(int first, int last)
+{
+    long max_fd;
+
+#ifdef SYS_close_range
+    if(syscall(SYS_close_range, (unsigned int) first, (unsigned int) last, 0) == 0)
+        return;
+#endif
+
+    /* Kernels without close_range */
+    max_fd = sysconf(_SC_OPEN_MAX);
+    if(max_fd < 0 || max_fd > 65536)
+        max_fd = 65536;
+    if((unsigned int) last > (unsigned int) max_fd)
+        last = max_fd;
+
+    for(; first <= last; ++first)
+        close(first);
+}
+
+/* Sets up the descriptors of the child, with one dup2 per descriptor that
+   changes, and closes every other descriptor above stderr */
+static void apply_redirections(struct process *p, const int io[3])
+{
+    size_t size = 3 + p->redirect_num, i, k, pending;
+    int *targets = (int *) malloc(size * sizeof(int) * 2), *sources = targets + size;
+    int max_target = 2, keep_from = 3;
+
+    size = resolve_redirections(p, io, targets, sources);
+
+    for(i = 0; i < size; ++i)
+        if(targets[i] > max_target)
+            max_target = targets[i];
+
+    /* Descriptors already in place only lose close-on-exec */
+    for(pending = 0, i = 0; i < size; ++i) {
+        if(sources[i] == targets[i]) {
+            if(targets[i] > 2)
+                fcntl(targets[i], F_SETFD, 0);
+            sources[i] = -2; /* done */
+        } else if(sources[i] >= 0) {
+            ++pending;
+        }
+    }
+
+    while(pending) {
+        int progress = 0;
+
+        for(i = 0; i < size; ++i) {
+            if(sources[i] < 0)
+                continue;
+
+            /* A target still needed as a source can't be overwritten yet */
+            for(k = 0; k < size && !(k != i && sources[k] == targets[i]); ++k);
+
+            if(k == size) {
+                if(dup2(sources[i], targets[i]) < 0) {
+                    fprintf(stderr, "almishell: %d: %s\n", sources[i], strerror(errno));
+                    _exit(EXIT_FAILURE);
+                }
+                sources[i] = -2;
+                --pending;
+                progress = 1;
+            }
+        }
+
+        if(!progress) {
+            /* Cycle, such as 1>&2 2>&1 on swapped descriptors: move one
+               source out of the way */
+            for(i = 0; sources[i] < 0; ++i);
+
+            for(k = 0; k < size; ++k)
+                if(sources[k] == targets[i])
+                    break;
+
+            sources[k] = fcntl(targets[i], F_DUPFD_CLOEXEC, max_target + 1);
+        }
+    }
+
+    for(i = 0; i < size; ++i)
+        if(sources[i] == -1)
+            close(targets[i]);
+
+    /* Close everything above stderr that is not a target */
+    while(keep_from <= max_target) {
+        int next_kept = max_target + 1;
+
+        for(i = 0; i < size; ++i)
+            if(targets[i] >= keep_from && targets[i] < next_kept && sources[i] == -2)
+                next_kept = targets[i];
+
+        if(next_kept > keep_from)
+            close_fd_range(keep_from, next_kept - 1);
+
+        keep_from = next_kept + 1;
+    }
+
+    close_fd_range(keep_from, ~0U >> 1);
+
+    free(targets);
+}
+
+/* Largest amount a relay moves per round, the default pipe capacity */
+#define RELAY_BUFFER 65536
+
+static int write_buffer(int fd, const char *buffer, size_t len)
+{
+    ssize_t n;
+
+    while(len) {
+        if((n = write(fd, buffer, len)) < 0) {
+            if(errno == EINTR)
+                continue;
+            return -1;
+        }
+
+        buffer += n;
+        len -= n;
+    }
+
+    return 0;
+}
+
+/* Closes the descriptors above stderr but in and the outputs */
+static void close_other_fds(int in, const int *outs, size_t n)
+{
+    int from = 3, next;
+    size_t i;
+
+    for(;;) {
+        next = in >= from ? in : -1;
+        for(i = 0; i < n; ++i)
+            if(outs[i] >= from && (next < 0 || outs[i] < next))
+                next = outs[i];
+
+        if(next < 0)
+            break;
+
+        if(next > from)
+            close_fd_range(from, next - 1);
+        from = next + 1;
+    }
+
+    close_fd_range(from, ~0U >> 1);
+}
+
+/* Moves len bytes from the pipe in to *out. Once *out fails it is set to
+   -1 and the bytes are dropped. */
+static void move_bytes(int in, int *out, size_t len, char *buffer)
+{
+    ssize_t n;
+    int fallback;
+
+    while(len) {
+        n = *out >= 0 ? splice(in, NULL, *out, NULL, len, SPLICE_F_MOVE) : -1;
+
+        if(n > 0) {
+            len -= n;
+            continue;
+        } else if(n < 0 && errno == EINTR) {
+            continue;
+        }
+
+        /* Outputs without splice, such as files in append mode, are
+           written the usual way */
+        fallback = *out >= 0 && n < 0 && errno == EINVAL;
+
+        while((n = read(in, buffer, len)) < 0 && errno == EINTR);
+        if(n <= 0)
+            return;
+        len -= n;
+
+        if(!fallback || write_buffer(*out, buffer, n) < 0)
+            *out = -1;
+    }
+}
+
+/* Reads exactly len bytes, that the pipe is known to hold */
+static void read_buffer(int in, char *buffer, size_t len)
+{
+    ssize_t n;
+
+    while(len) {
+        if((n = read(in, buffer, len)) < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)
+            return;
+
+        buffer += n;
+        len -= n;
+    }
+}
+
+/* Relay through user space, when its pipes can't be made */
+static void copy_outputs(int in, int *outs, size_t n, char *buffer)
+{
+    ssize_t len;
+    size_t i;
+
+    while((len = read(in, buffer, RELAY_BUFFER)) != 0) {
+        if(len < 0) {
+            if(errno == EINTR)
+                continue;
+            break;
+        }
+
+        for(i = 0; i < n; ++i)
+            if(outs[i] >= 0 && write_buffer(outs[i], buffer, len) < 0)
+                outs[i] = -1;
+    }
+}
+
+/* Copies everything written to the pipe in to the n > 1 outputs, without
+   going through user space: each output but the last gets a tee of the
+   data in a pipe of its own, spliced to it, and the last output takes
+   the data itself */
+static void relay_outputs(int in, int *outs, size_t n)
+{
+    int (*copies)[2] = (int (*)[2]) malloc((n - 1) * sizeof(*copies));
+    ssize_t *copied = (ssize_t *) malloc(n * sizeof(ssize_t)), len;
+    char *buffer = (char *) malloc(RELAY_BUFFER * 2), *data = buffer + RELAY_BUFFER;
+    size_t i, made;
+    int whole;
+
+    /* A broken output is dropped, the others are still written */
+    signal(SIGPIPE, SIG_IGN);
+
+    for(made = 0; made + 1 < n && pipe(copies[made]) == 0; ++made);
+
+    if(made + 1 < n) {
+        for(i = 0; i < made; ++i) {
+            close(copies[i][0]);
+            close(copies[i][1]);
+        }
+
+        copy_outputs(in, outs, n, buffer);
+        n = 1;
+    }
+
+    while(n > 1) {
+        /* The first tee sets how much the round moves. The other pipes are
+           as empty and as large, so they take as much. */
+        while((len = tee(in, copies[0][1], RELAY_BUFFER, 0)) < 0 && errno == EINTR);
+        if(len <= 0)
+            break;
+
+        copied[0] = len;
+        whole = 1;
+
+        for(i = 1; i + 1 < n; ++i) {
+            while((copied[i] = tee(in, copies[i][1], len, 0)) < 0 && errno == EINTR);
+
+            if(copied[i] < len) {
+                if(copied[i] < 0)
+                    copied[i] = 0;
+                whole = 0;
+            }
+        }
+
+        if(whole) {
+            move_bytes(in, &outs[n - 1], len, buffer);
+        } else {
+            /* Short tee, what a copy lacks is written from user space */
+            read_buffer(in, data, len);
+            if(outs[n - 1] >= 0 && write_buffer(outs[n - 1], data, len) < 0)
+                outs[n - 1] = -1;
+        }
+
+        for(i = 0; i + 1 < n; ++i) {
+            move_bytes(copies[i][0], &outs[i], copied[i], buffer);
+
+            if(copied[i] < len && outs[i] >= 0
+               && write_buffer(outs[i], data + copied[i], len - copied[i]) < 0)
+                outs[i] = -1;
+        }
+    }
+
+    free(copies);
+    free(copied);
+    free(buffer);
+}
+
+/* Gathers the outputs fd is written to: its n>file redirections since it
+   was last redirected otherwise, and the pipe out of the stage for stdout
+   if it was not */
+static size_t fan_out_targets(const struct process *p, int fd, int pipe_out, int *outs)
+{
+    size_t i, n = 0;
+
+    for(i = 0; i < p->redirect_num; ++i) {
+        const struct redirection *r = &p->redirects[i];
+
+        if(r->fd != fd)
+            continue;
+
+        if(r->multio && r->source >= 0) {
+            outs[n++] = r->source;
+        } else {
+            n = 0;
+            pipe_out = -1;
+        }
+    }
+
+    if(n && pipe_out >= 0)
+        outs[n++] = pipe_out;
+
+    return n;
+}
+
+size_t split_outputs(struct process *p, const int io[3], pid_t *relays)
+{
+    int *outs = (int *) malloc((p->redirect_num + 1) * sizeof(int)), fds[2], fd, status;
+    size_t i, k, n, started = 0;
+    struct redirection *r;
+    pid_t pid;
+
+    for(i = 0; i < p->redirect_num; ++i) {
+        fd = p->redirects[i].fd;
+
+        /* Each descriptor once */
+        for(k = 0; k < i && p->redirects[k].fd != fd; ++k);
+
+        if(k < i || (n = fan_out_targets(p, fd, fd == 1 && p->piped ? io[1] : -1, outs)) < 2)
+            continue;
+
+        if(pipe2(fds, O_CLOEXEC) < 0) {
+            perror("almishell: pipe");
+            break;
+        }
+
+        if((pid = fork()) < 0) {
+            perror("almishell: fork");
+            close(fds[0]);
+            close(fds[1]);
+            break;
+        }
+
+        if((pid == 0) == (relays != NULL)) {
+            close(fds[1]);
+            close_other_fds(fds[0], outs, n);
+            relay_outputs(fds[0], outs, n);
+
+            if(relays)
+                _exit(0);
+
+            /* The relay stands for the process in its job */
+            while(waitpid(pid, &status, 0) < 0 && errno == EINTR);
+
+            if(WIFSIGNALED(status)) {
+                signal(WTERMSIG(status), SIG_DFL);
+                raise(WTERMSIG(status));
+            }
+            _exit(WEXITSTATUS(status));
+        }
+
+        close(fds[0]);
+
+        /* The pipe overrides the outputs */
+        p->redirects = (struct redirection *) realloc(p->redirects, (p->redirect_num + 1)
+                                                      * sizeof(struct redirection));
+        r = &p->redirects[p->redirect_num++];
+        r->fd = fd;
+        r->source = fds[1];
+        r->opened = 1;
+        r->multio = 0;
+
+        if(relays)
+            relays[started++] = pid;
+    }
+
+    free(outs);
+
+    return started;
+}
+
+void wait_relays(const pid_t *relays, size_t n)
+{
+    size_t i;
+
+    for(i = 0; i < n; ++i)
+        while(waitpid(relays[i], NULL, 0) < 0 && errno == EINTR);
+}
+
+void run_process(struct shell_info *s, struct process *p, pid_t pgid, int io[3], char bg,
+                 const struct job_resources *res, size_t stage)
 {
     int i;
     pid_t pid;
-    const int std_filenos[3] = {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO};
     struct sigaction sact;
+    char **argv = p->argv;
+    struct function *f;
 
     if(s->interactive) {
         pid = getpid();
@@ -68,19 +514,51 @@ void run_process(struct shell_info *s, struct process *p, pid_t pgid, int io[3],
         sigaction(SIGCHLD, &sact, NULL);
     }
 
+    /* CPU, scheduling and limits, before anything runs in the process */
+    if(apply_job_resources(res, stage) < 0)
+        _exit(126);
+
+    /* The outputs of multios are copied by relays, this process becoming
+       one if needed */
+    split_outputs(p, io, NULL);
+
     /* Set the standard input/output channels of the new process.  */
-    for(i = 0; i < 3; ++i) {
-        if(io[i] != std_filenos[i]) {
-            if(dup2(io[i], std_filenos[i]) < 0) {
-                perror("almishell: dup2");
-            }
-            close(io[i]);
-        }
+    apply_redirections(p, io);
+
+    /* Assignments prefixing the command are laid over the cached environment */
+    environ = p->assign ? overlay_envp(s->vars, p->assign) : get_envp(s->vars);
+
+    /* exec only names the command to run */
+    if(!strcmp(argv[0], shell_cmd[SHELL_EXEC]) && argv[1])
+        ++argv;
+
+    if(!strcmp(argv[0], BATCH_COMMAND))
+        run_batch(argv, environ);
+
+    /* A function in a pipeline or in the background runs in this child,
+       which carries on as a non-interactive shell */
+    if((!s->builtins || is_builtin_command(argv[0]) == SHELL_NONE)
+       && (f = find_function(s->functions, argv[0]))) {
+        s->interactive = 0;
+        s->first_job = s->tail_job = NULL;
+        for(i = 0; i < 3; ++i)
+            s->io[i] = i;
+
+        i = call_function(s, f, argv, s->io);
+        fflush(stdout);
+        _exit(i);
     }
 
-    if(is_builtin_command(p->argv[0]) == SHELL_NONE)
-        execvp(p->argv[0], p->argv);
+    if(!s->builtins || is_builtin_command(argv[0]) == SHELL_NONE)
+        execvp(argv[0], argv);
 
+    i = errno;
     perror("almishell: execvp");
-    exit(EXIT_FAILURE);
+
+    if(i == E2BIG)
+        fprintf(stderr, "almishell: %s: run it through %s to split the arguments\n",
+                argv[0], BATCH_COMMAND);
+
+    /* _exit, so the stdio buffers shared with the shell are left alone */
+    _exit(i == ENOENT ? 127 : 126);
 }
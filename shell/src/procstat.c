@@ -0,0 +1,144 @@
+/*
+ALMiSHELL - A POSIX conformant shell prototype.
+Copyright (C) 2017  Henrique C. S. M. Aranha; Lucas E. C. Mello; Lucas H. F. Leal
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define _GNU_SOURCE /* CLOCK_BOOTTIME */
+
+#include <procstat.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Reads the whole file from its start into buffer, NUL terminated */
+static ssize_t read_proc_file(int fd, char *buffer, size_t size)
+{
+    ssize_t n = pread(fd, buffer, size - 1, 0);
+
+    if(n >= 0)
+        buffer[n] = '\0';
+
+    return n;
+}
+
+static uint64_t io_counter(const char *io, const char *name)
+{
+    const char *field = strstr(io, name);
+
+    return field ? strtoul(field + strlen(name), NULL, 10) : 0;
+}
+
+int sample_process(pid_t pid, struct process_sample **sample)
+{
+    struct process_sample *s = *sample;
+    char path[64], buffer[1024], *fields;
+    unsigned long utime, stime, start, rss;
+    long tick_rate = sysconf(_SC_CLK_TCK);
+    struct timespec now;
+    double elapsed;
+    uint64_t ticks;
+    int i;
+
+    if(!s) {
+        s = *sample = (struct process_sample *) malloc(sizeof(struct process_sample));
+
+        sprintf(path, "/proc/%ld/stat", (long) pid);
+        s->stat_fd = open(path, O_RDONLY | O_CLOEXEC);
+        sprintf(path, "/proc/%ld/io", (long) pid);
+        s->io_fd = open(path, O_RDONLY | O_CLOEXEC);
+
+        s->ticks = 0;
+        s->at.tv_sec = s->at.tv_nsec = 0;
+        s->state = '-';
+        s->cpu = 0;
+        s->rss = s->read_bytes = s->write_bytes = 0;
+    }
+
+    if(s->stat_fd < 0 || read_proc_file(s->stat_fd, buffer, sizeof(buffer)) <= 0) {
+        s->state = '-';
+        return 0;
+    }
+
+    /* The command name may hold spaces and parentheses, the fields start
+       after its last ')' with the state, field 3 */
+    if(!(fields = strrchr(buffer, ')')))
+        return 0;
+    fields += 2;
+    s->state = *fields;
+
+    /* utime and stime are fields 14 and 15, starttime 22, rss 24 */
+    for(i = 3; i < 14 && (fields = strchr(fields, ' ')); ++i)
+        ++fields;
+    if(!fields || sscanf(fields, "%lu %lu %*d %*d %*d %*d %*d %*d %lu %*u %lu",
+                         &utime, &stime, &start, &rss) != 4)
+        return 0;
+
+    ticks = (uint64_t) utime + stime;
+    clock_gettime(CLOCK_BOOTTIME, &now);
+
+    /* The first sample covers the life of the process */
+    if(!s->at.tv_sec && !s->at.tv_nsec) {
+        s->ticks = 0;
+        s->at.tv_sec = start / tick_rate;
+        s->at.tv_nsec = (long) (start % tick_rate) * (1000000000L / tick_rate);
+    }
+
+    elapsed = (now.tv_sec - s->at.tv_sec) + (now.tv_nsec - s->at.tv_nsec) / 1e9;
+    s->cpu = elapsed > 0 ? (ticks - s->ticks) * 100.0 / tick_rate / elapsed : 0;
+    s->ticks = ticks;
+    s->at = now;
+    s->rss = (uint64_t) rss * sysconf(_SC_PAGESIZE);
+
+    if(s->io_fd >= 0 && read_proc_file(s->io_fd, buffer, sizeof(buffer)) > 0) {
+        s->read_bytes = io_counter(buffer, "rchar: ");
+        s->write_bytes = io_counter(buffer, "wchar: ");
+    }
+
+    return 1;
+}
+
+void delete_process_sample(struct process_sample *sample)
+{
+    if(!sample)
+        return;
+
+    if(sample->stat_fd >= 0)
+        close(sample->stat_fd);
+    if(sample->io_fd >= 0)
+        close(sample->io_fd);
+
+    free(sample);
+}
+
+void format_size(uint64_t bytes, char *buffer)
+{
+    const char *units = "BKMGTP";
+    double size = (double) bytes;
+
+    while(size >= 1024 && units[1]) {
+        size /= 1024;
+        ++units;
+    }
+
+    if(*units == 'B')
+        sprintf(buffer, "%luB", (unsigned long) bytes);
+    else
+        sprintf(buffer, "%.1f%c", size, *units);
+}
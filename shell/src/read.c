@@ -0,0 +1,450 @@
+/*
+ALMiSHELL - A POSIX conformant shell prototype.
+Copyright (C) 2017  Henrique C. S. M. Aranha; Lucas E. C. Mello; Lucas H. F. Leal
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <read.h>
+#include <shell.h>
+#include <vars.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Block of a regular file, valid while the file is not changed */
+struct read_buffer {
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+    off_t offset;               /* file offset of data[0] */
+    size_t len;
+    char data[READ_BLOCK];
+};
+
+/* Growing string, always terminated */
+struct line {
+    char *data;
+    size_t size;
+    size_t capacity;
+};
+
+static void init_line(struct line *l)
+{
+    l->capacity = 128;
+    l->data = (char *) malloc(l->capacity);
+    l->data[0] = '\0';
+    l->size = 0;
+}
+
+static void append_line(struct line *l, const char *data, size_t len)
+{
+    if(l->size + len + 1 > l->capacity) {
+        while(l->size + len + 1 > l->capacity)
+            l->capacity *= 2;
+        l->data = (char *) realloc(l->data, l->capacity);
+    }
+
+    memcpy(l->data + l->size, data, len);
+    l->size += len;
+    l->data[l->size] = '\0';
+}
+
+void delete_read_buffer(struct read_buffer *b)
+{
+    free(b);
+}
+
+static int block_covers(const struct read_buffer *b, const struct stat *st, off_t pos)
+{
+    return b->len && b->dev == st->st_dev && b->ino == st->st_ino && b->size == st->st_size
+           && b->mtime.tv_sec == st->st_mtim.tv_sec && b->mtime.tv_nsec == st->st_mtim.tv_nsec
+           && pos >= b->offset && pos < b->offset + (off_t) b->len;
+}
+
+/* Reads the line at pos from the blocks of the regular file, and leaves
+   the offset right after its delimiter */
+static int read_file_line(struct shell_info *s, int fd, const struct stat *st, off_t pos,
+                          int delim, struct line *l)
+{
+    struct read_buffer *b = s->read_buffer;
+    const char *start, *end;
+    ssize_t n;
+    int found = 0;
+
+    if(!b) {
+        b = s->read_buffer = (struct read_buffer *) malloc(sizeof(struct read_buffer));
+        b->len = 0;
+    }
+
+    while(!found) {
+        if(!block_covers(b, st, pos)) {
+            while((n = pread(fd, b->data, READ_BLOCK, pos)) < 0 && errno == EINTR);
+
+            if(n < 0) {
+                b->len = 0;
+                return -1;
+            }
+
+            b->len = n;
+            if(!n)
+                break;
+
+            b->dev = st->st_dev;
+            b->ino = st->st_ino;
+            b->size = st->st_size;
+            b->mtime = st->st_mtim;
+            b->offset = pos;
+        }
+
+        start = b->data + (pos - b->offset);
+        end = (const char *) memchr(start, delim, b->data + b->len - start);
+        found = end != NULL;
+        if(!found)
+            end = b->data + b->len;
+
+        append_line(l, start, end - start);
+        pos += end - start + found;
+    }
+
+    if(lseek(fd, pos, SEEK_SET) < 0)
+        return -1;
+
+    return found;
+}
+
+static int read_byte_line(int fd, int delim, struct line *l)
+{
+    ssize_t n;
+    char c;
+
+    while((n = read(fd, &c, 1)) != 0) {
+        if(n < 0) {
+            if(errno == EINTR)
+                continue;
+            return -1;
+        }
+
+        if(c == delim)
+            return 1;
+
+        append_line(l, &c, 1);
+    }
+
+    return 0;
+}
+
+/* Appends the next line of fd, without its delimiter, to l. Returns 1 if
+   the delimiter was found, 0 at the end of the input and -1 on error. */
+static int read_line(struct shell_info *s, int fd, int delim, struct line *l)
+{
+    struct stat st;
+    off_t pos;
+
+    if(fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && (pos = lseek(fd, 0, SEEK_CUR)) >= 0)
+        return read_file_line(s, fd, &st, pos, delim, l);
+
+    return read_byte_line(fd, delim, l);
+}
+
+static int valid_name(const char *builtin, const char *name)
+{
+    size_t len = var_name_len(name);
+
+    if(len && !name[len])
+        return 1;
+
+    fprintf(stderr, "almishell: %s: %s: not a valid identifier\n", builtin, name);
+
+    return 0;
+}
+
+/* Parses the options of args, those in with_value take the next word or
+   the rest of the word. Returns the index of the first operand, or -1
+   after reporting an invalid option. */
+static int parse_options(char **args, const char *flags, const char *with_value,
+                         int *set, char **values)
+{
+    const char *option, *known;
+    int i;
+
+    for(i = 1; args[i] && args[i][0] == '-' && args[i][1]; ++i) {
+        if(!strcmp(args[i], "--"))
+            return i + 1;
+
+        for(option = &args[i][1]; *option; ++option) {
+            if( (known = strchr(with_value, *option)) ) {
+                values[known - with_value] = option[1] ? (char *) option + 1 : args[++i];
+
+                if(!values[known - with_value]) {
+                    fprintf(stderr, "almishell: %s: -%c: option requires an argument\n",
+                            args[0], *option);
+                    return -1;
+                }
+                break;
+            }
+
+            if(!(known = strchr(flags, *option))) {
+                fprintf(stderr, "almishell: %s: -%c: invalid option\n", args[0], *option);
+                return -1;
+            }
+
+            set[known - flags] = 1;
+        }
+    }
+
+    return i;
+}
+
+static int is_separator(const char *ifs, const char *data, const char *quoted, size_t i)
+{
+    return !quoted[i] && data[i] && strchr(ifs, data[i]);
+}
+
+static int is_space(const char *ifs, const char *data, const char *quoted, size_t i)
+{
+    return is_separator(ifs, data, quoted, i)
+           && (data[i] == ' ' || data[i] == '\t' || data[i] == '\n');
+}
+
+/* Splits the line on IFS into the variables. IFS whitespace is trimmed
+   and collapses, other IFS characters end one field each. */
+static void assign_fields(struct shell_info *s, char **names, const struct line *l,
+                          const char *quoted)
+{
+    const char *ifs = get_var(s->vars, "IFS"), *data = l->data;
+    size_t i = 0, start, end;
+    char saved;
+
+    if(!ifs)
+        ifs = " \t\n";
+
+    while(i < l->size && is_space(ifs, data, quoted, i))
+        ++i;
+
+    for(; *names; ++names) {
+        start = i;
+
+        if(!names[1]) {
+            /* The last name takes the rest of the line */
+            end = l->size;
+            while(end > i && is_space(ifs, data, quoted, end - 1))
+                --end;
+            i = l->size;
+        } else {
+            while(i < l->size && !is_separator(ifs, data, quoted, i))
+                ++i;
+            end = i;
+
+            while(i < l->size && is_space(ifs, data, quoted, i))
+                ++i;
+            if(i < l->size && is_separator(ifs, data, quoted, i))
+                for(++i; i < l->size && is_space(ifs, data, quoted, i); ++i);
+        }
+
+        saved = l->data[end];
+        l->data[end] = '\0';
+        set_var(s->vars, *names, data + start);
+        l->data[end] = saved;
+    }
+}
+
+int read_builtin(struct shell_info *s, int fd, char **args)
+{
+    static char *reply[] = {"REPLY", NULL};
+    char *values[1] = {NULL}, **names, *quoted;
+    int set[1] = {0}, first, status, i, continued, delim;
+    struct line raw, line;
+    size_t k;
+
+    if((first = parse_options(args, "r", "d", set, values)) < 0)
+        return 2;
+
+    delim = values[0] ? (unsigned char) values[0][0] : '\n';
+    names = args[first] ? &args[first] : reply;
+
+    for(i = 0; names[i]; ++i)
+        if(!valid_name(args[0], names[i]))
+            return 2;
+
+    init_line(&raw);
+    init_line(&line);
+    quoted = (char *) malloc(1);
+
+    /* Without -r a backslash quotes the next character, and before the
+       delimiter continues the line */
+    do {
+        raw.size = 0;
+        continued = 0;
+
+        if((status = read_line(s, fd, delim, &raw)) < 0)
+            break;
+
+        quoted = (char *) realloc(quoted, line.size + raw.size + 1);
+
+        for(k = 0; k < raw.size; ++k) {
+            if(!set[0] && raw.data[k] == '\\') {
+                if(++k == raw.size) {
+                    continued = status;
+                    break;
+                }
+                quoted[line.size] = 1;
+            } else
+                quoted[line.size] = 0;
+
+            append_line(&line, &raw.data[k], 1);
+        }
+    } while(continued);
+
+    if(status < 0) {
+        perror("almishell: read");
+        status = 1;
+    } else {
+        assign_fields(s, names, &line, quoted);
+        status = !status;
+    }
+
+    free(raw.data);
+    free(line.data);
+    free(quoted);
+
+    return status;
+}
+
+/* Sets name_index to the line, and the delimiter if it is kept */
+static void store_line(struct shell_info *s, const char *name, unsigned long index,
+                       struct line *l, int delim)
+{
+    char *var = (char *) malloc(strlen(name) + 24);
+
+    if(delim >= 0) {
+        char c = delim;
+        append_line(l, &c, 1);
+    }
+
+    sprintf(var, "%s_%lu", name, index);
+    set_var(s->vars, var, l->data);
+    free(var);
+}
+
+int mapfile_builtin(struct shell_info *s, int fd, char **args)
+{
+    char *values[3] = {NULL, NULL, NULL}, *var, number[24];
+    const char *name, *old;
+    int set[1] = {0}, first, status = 1, delim;
+    unsigned long count, skip, n = 0, old_count, i;
+    struct line all, line;
+    ssize_t size;
+
+    if((first = parse_options(args, "t", "dns", set, values)) < 0)
+        return 2;
+
+    delim = values[0] ? (unsigned char) values[0][0] : '\n';
+    count = values[1] ? strtoul(values[1], NULL, 10) : 0;
+    skip = values[2] ? strtoul(values[2], NULL, 10) : 0;
+    name = args[first] ? args[first] : "MAPFILE";
+
+    if(!valid_name(args[0], name))
+        return 2;
+
+    old = get_var(s->vars, name);
+    old_count = old ? strtoul(old, NULL, 10) : 0;
+
+    init_line(&line);
+
+    if(!count) {
+        /* Everything is consumed, the input is read by blocks */
+        const char *start, *end;
+
+        init_line(&all);
+
+        for(;;) {
+            if(all.capacity - all.size < READ_BLOCK + 1) {
+                all.capacity = all.size + READ_BLOCK + 1;
+                all.data = (char *) realloc(all.data, all.capacity);
+            }
+
+            if((size = read(fd, all.data + all.size, READ_BLOCK)) < 0) {
+                if(errno == EINTR)
+                    continue;
+                status = -1;
+                break;
+            }
+
+            if(!size)
+                break;
+            all.size += size;
+        }
+
+        for(start = all.data; status >= 0 && start < all.data + all.size; start = end + 1) {
+            end = (const char *) memchr(start, delim, all.data + all.size - start);
+            if(!end)
+                end = all.data + all.size;
+
+            if(skip) {
+                --skip;
+                continue;
+            }
+
+            line.size = 0;
+            append_line(&line, start, end - start);
+            store_line(s, name, n++, &line,
+                       set[0] || end == all.data + all.size ? -1 : delim);
+        }
+
+        free(all.data);
+    } else {
+        /* Only the lines stored are consumed */
+        while(n < count) {
+            line.size = 0;
+
+            if((status = read_line(s, fd, delim, &line)) <= 0 && !line.size)
+                break;
+
+            if(skip) {
+                --skip;
+                continue;
+            }
+
+            store_line(s, name, n++, &line, set[0] || !status ? -1 : delim);
+        }
+    }
+
+    free(line.data);
+
+    if(status < 0) {
+        perror("almishell: mapfile");
+        return 1;
+    }
+
+    /* The lines of a previous, longer load are removed */
+    var = (char *) malloc(strlen(name) + 24);
+    for(i = n; i < old_count; ++i) {
+        sprintf(var, "%s_%lu", name, i);
+        unset_var(s->vars, var);
+    }
+    free(var);
+
+    sprintf(number, "%lu", n);
+    set_var(s->vars, name, number);
+
+    return 0;
+}
@@ -0,0 +1,399 @@
+/*
+ALMiSHELL - A POSIX conformant shell prototype.
+Copyright (C) 2017  Henrique C. S. M. Aranha; Lucas E. C. Mello; Lucas H. F. Leal
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define _GNU_SOURCE /* sched_setaffinity, SCHED_BATCH, SCHED_IDLE */
+
+#include <resources.h>
+
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sched.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+struct limit_name {
+    char option;                /* ulimit option */
+    const char *name;           /* sched -l name */
+    int resource;
+    rlim_t unit;
+};
+
+static const struct limit_name limit_names[] = {
+    {'c', "core", RLIMIT_CORE, 1024},
+    {'d', "data", RLIMIT_DATA, 1024},
+    {'f', "fsize", RLIMIT_FSIZE, 1024},
+    {'l', "memlock", RLIMIT_MEMLOCK, 1024},
+    {'n', "nofile", RLIMIT_NOFILE, 1},
+    {'s', "stack", RLIMIT_STACK, 1024},
+    {'t', "cpu", RLIMIT_CPU, 1},
+    {'u', "nproc", RLIMIT_NPROC, 1},
+    {'v', "as", RLIMIT_AS, 1024}
+};
+
+#define LIMIT_NAME_NUM (sizeof(limit_names) / sizeof(limit_names[0]))
+
+static const struct limit_name *find_limit(char option, const char *name)
+{
+    size_t i;
+
+    for(i = 0; i < LIMIT_NAME_NUM; ++i)
+        if(name ? !strcmp(limit_names[i].name, name) : limit_names[i].option == option)
+            return &limit_names[i];
+
+    return NULL;
+}
+
+/* Parses a limit value in the resource unit, or "unlimited" */
+static int parse_limit_value(const char *value, const struct limit_name *l, rlim_t *result)
+{
+    char *end;
+    unsigned long n;
+
+    if(!strcmp(value, "unlimited")) {
+        *result = RLIM_INFINITY;
+        return 0;
+    }
+
+    n = strtoul(value, &end, 10);
+    if(!value[0] || *end || value[0] == '-')
+        return -1;
+
+    *result = (rlim_t) n * l->unit;
+
+    return 0;
+}
+
+static void print_limit_value(FILE *out, rlim_t value, const struct limit_name *l)
+{
+    if(value == RLIM_INFINITY)
+        fprintf(out, "unlimited");
+    else
+        fprintf(out, "%lu", (unsigned long) (value / l->unit));
+}
+
+/* Parses a list like 0-3,6 into a new array. Returns the number of CPUs,
+   0 if the list is malformed. */
+static size_t parse_cpu_list(const char *list, int **cpus)
+{
+    size_t num = 0, capacity = 8;
+    long first, last;
+    char *end;
+    int valid;
+
+    *cpus = (int *) malloc(capacity * sizeof(int));
+
+    /* A bad entry anywhere invalidates the whole list */
+    do {
+        valid = 0;
+        first = last = strtol(list, &end, 10);
+        if(end == list || first < 0)
+            break;
+
+        if(*end == '-') {
+            list = end + 1;
+            last = strtol(list, &end, 10);
+            if(end == list || last < first)
+                break;
+        }
+
+        if(last >= CPU_SETSIZE)
+            break;
+
+        for(; first <= last; ++first) {
+            if(num == capacity) {
+                capacity *= 2;
+                *cpus = (int *) realloc(*cpus, capacity * sizeof(int));
+            }
+            (*cpus)[num++] = (int) first;
+        }
+
+        list = end + 1;
+        valid = 1;
+    } while(*end == ',');
+
+    if(!valid || *end) {
+        free(*cpus);
+        *cpus = NULL;
+        return 0;
+    }
+
+    return num;
+}
+
+int parse_job_resources(struct job_resources **res, char **argv)
+{
+    struct job_resources *r = (struct job_resources *) malloc(sizeof(struct job_resources));
+    const struct limit_name *l;
+    int i;
+    char *value, *end, option;
+
+    r->cpus = NULL;
+    r->cpu_num = 0;
+    r->spread = 0;
+    r->policy = -1;
+    r->nice = 0;
+    r->limits = NULL;
+    r->limit_num = 0;
+    *res = r;
+
+    for(i = 1; argv[i] && argv[i][0] == '-'; ++i) {
+        if(!strcmp(argv[i], "-r")) {
+            r->spread = 1;
+            continue;
+        }
+
+        if(strlen(argv[i]) != 2 || !strchr("cpnl", argv[i][1]) || !argv[i + 1]) {
+            fprintf(stderr, "almishell: %s: %s: invalid option\n", RESOURCES_COMMAND, argv[i]);
+            return -1;
+        }
+
+        option = argv[i][1];
+        value = argv[++i];
+
+        switch(option) {
+        case 'c':
+            free(r->cpus);
+            if( !(r->cpu_num = parse_cpu_list(value, &r->cpus)) ) {
+                fprintf(stderr, "almishell: %s: %s: invalid CPU list\n", RESOURCES_COMMAND, value);
+                return -1;
+            }
+            break;
+
+        case 'p':
+            if(!strcmp(value, "other"))
+                r->policy = SCHED_OTHER;
+            else if(!strcmp(value, "batch"))
+                r->policy = SCHED_BATCH;
+            else if(!strcmp(value, "idle"))
+                r->policy = SCHED_IDLE;
+            else {
+                fprintf(stderr, "almishell: %s: %s: invalid policy\n", RESOURCES_COMMAND, value);
+                return -1;
+            }
+            break;
+
+        case 'n':
+            r->nice = (int) strtol(value, &end, 10);
+            if(!value[0] || *end) {
+                fprintf(stderr, "almishell: %s: %s: invalid nice value\n", RESOURCES_COMMAND, value);
+                return -1;
+            }
+            break;
+
+        case 'l':
+            end = strchr(value, '=');
+            if(end)
+                *end = '\0';
+            l = end ? find_limit(0, value) : NULL;
+            if(end)
+                *end = '=';
+
+            r->limits = (struct resource_limit *) realloc(r->limits, (r->limit_num + 1)
+                                                          * sizeof(struct resource_limit));
+
+            if(!l || parse_limit_value(end + 1, l, &r->limits[r->limit_num].limit.rlim_cur)) {
+                fprintf(stderr, "almishell: %s: %s: invalid limit\n", RESOURCES_COMMAND, value);
+                return -1;
+            }
+
+            /* Only the soft limit is changed, the hard one is kept */
+            r->limits[r->limit_num].limit.rlim_max = RLIM_INFINITY;
+            r->limits[r->limit_num++].resource = l->resource;
+            break;
+        }
+    }
+
+    if(!argv[i]) {
+        fprintf(stderr, "usage: %s [-c cpus] [-r] [-p other|batch|idle] [-n nice] "
+                "[-l name=value]... command\n", RESOURCES_COMMAND);
+        return -1;
+    }
+
+    return i;
+}
+
+void delete_job_resources(struct job_resources *res)
+{
+    if(!res)
+        return;
+
+    free(res->cpus);
+    free(res->limits);
+    free(res);
+}
+
+int apply_job_resources(const struct job_resources *res, size_t stage)
+{
+    struct sched_param param;
+    struct rlimit current;
+    cpu_set_t set;
+    size_t i;
+
+    if(!res)
+        return 0;
+
+    if(res->cpu_num) {
+        CPU_ZERO(&set);
+
+        if(res->spread)
+            CPU_SET(res->cpus[stage % res->cpu_num], &set);
+        else
+            for(i = 0; i < res->cpu_num; ++i)
+                CPU_SET(res->cpus[i], &set);
+
+        if(sched_setaffinity(0, sizeof(set), &set) < 0) {
+            perror("almishell: sched_setaffinity");
+            return -1;
+        }
+    }
+
+    if(res->policy >= 0) {
+        param.sched_priority = 0;
+        if(sched_setscheduler(0, res->policy, &param) < 0) {
+            perror("almishell: sched_setscheduler");
+            return -1;
+        }
+    }
+
+    if(res->nice) {
+        errno = 0;
+        if(nice(res->nice) == -1 && errno) {
+            perror("almishell: nice");
+            return -1;
+        }
+    }
+
+    for(i = 0; i < res->limit_num; ++i) {
+        struct rlimit limit = res->limits[i].limit;
+
+        if(getrlimit(res->limits[i].resource, &current) == 0)
+            limit.rlim_max = current.rlim_max;
+
+        if(setrlimit(res->limits[i].resource, &limit) < 0) {
+            perror("almishell: setrlimit");
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+void print_job_resources(const struct job_resources *res, FILE *out)
+{
+    size_t i, k;
+
+    fprintf(out, "%s", RESOURCES_COMMAND);
+
+    for(i = 0; i < res->cpu_num; i = k) {
+        /* Runs of consecutive CPUs are printed as ranges */
+        for(k = i + 1; k < res->cpu_num && res->cpus[k] == res->cpus[k - 1] + 1; ++k);
+
+        fprintf(out, "%s%d", i ? "," : " -c ", res->cpus[i]);
+        if(k - i > 1)
+            fprintf(out, "-%d", res->cpus[k - 1]);
+    }
+
+    if(res->spread)
+        fprintf(out, " -r");
+
+    if(res->policy >= 0)
+        fprintf(out, " -p %s", res->policy == SCHED_BATCH ? "batch"
+                : res->policy == SCHED_IDLE ? "idle" : "other");
+
+    if(res->nice)
+        fprintf(out, " -n %d", res->nice);
+
+    for(i = 0; i < res->limit_num; ++i) {
+        for(k = 0; limit_names[k].resource != res->limits[i].resource; ++k);
+
+        fprintf(out, " -l %s=", limit_names[k].name);
+        print_limit_value(out, res->limits[i].limit.rlim_cur, &limit_names[k]);
+    }
+}
+
+int ulimit_builtin(FILE *out, char **args)
+{
+    const struct limit_name *l = find_limit('f', NULL);
+    struct rlimit limit;
+    int i, hard = 0, soft = 0, all = 0;
+    rlim_t value;
+
+    for(i = 1; args[i] && args[i][0] == '-' && args[i][1]; ++i) {
+        const char *option;
+
+        for(option = &args[i][1]; *option; ++option) {
+            if(*option == 'H')
+                hard = 1;
+            else if(*option == 'S')
+                soft = 1;
+            else if(*option == 'a')
+                all = 1;
+            else if( !(l = find_limit(*option, NULL)) ) {
+                fprintf(stderr, "almishell: ulimit: -%c: invalid option\n", *option);
+                return 2;
+            }
+        }
+    }
+
+    if(all) {
+        size_t k;
+
+        for(k = 0; k < LIMIT_NAME_NUM; ++k) {
+            getrlimit(limit_names[k].resource, &limit);
+            fprintf(out, "-%c %-8s ", limit_names[k].option, limit_names[k].name);
+            print_limit_value(out, hard ? limit.rlim_max : limit.rlim_cur, &limit_names[k]);
+            fprintf(out, "\n");
+        }
+        fflush(out);
+
+        return 0;
+    }
+
+    if(getrlimit(l->resource, &limit) < 0) {
+        perror("almishell: ulimit");
+        return 1;
+    }
+
+    if(!args[i]) {
+        print_limit_value(out, hard ? limit.rlim_max : limit.rlim_cur, l);
+        fprintf(out, "\n");
+        fflush(out);
+        return 0;
+    }
+
+    if(parse_limit_value(args[i], l, &value)) {
+        fprintf(stderr, "almishell: ulimit: %s: invalid limit\n", args[i]);
+        return 1;
+    }
+
+    /* Without -H or -S both limits are set */
+    if(hard || !soft)
+        limit.rlim_max = value;
+    if(soft || !hard)
+        limit.rlim_cur = value;
+
+    if(setrlimit(l->resource, &limit) < 0) {
+        perror("almishell: ulimit");
+        return 1;
+    }
+
+    return 0;
+}
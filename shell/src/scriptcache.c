@@ -0,0 +1,262 @@
+/*
+ALMiSHELL - A POSIX conformant shell prototype.
+Copyright (C) 2017  Henrique C. S. M. Aranha; Lucas E. C. Mello; Lucas H. F. Leal
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define _XOPEN_SOURCE 700 /* realpath */
+
+#include <scriptcache.h>
+#include <vars.h>
+#include <stats.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <errno.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* FNV-1a, used both for the cache file names and the body checksum */
+static uint32_t hash_bytes(const char *data, size_t size)
+{
+    uint32_t h = 2166136261U;
+    size_t i;
+
+    for(i = 0; i < size; ++i) {
+        h ^= (unsigned char) data[i];
+        h *= 16777619U;
+    }
+
+    return h;
+}
+
+/* Directory holding the cache entries, NULL if caching is disabled.
+   Caller must free the returned string. */
+static char *cache_dir(struct shell_info *s)
+{
+    const char *dir = get_var(s->vars, "ALMISHELL_CACHE_DIR"), *base;
+    const char *suffix;
+    char *path;
+
+    if(dir) {
+        if(!dir[0])
+            return NULL;
+        base = dir;
+        suffix = "";
+    } else if( (base = get_var(s->vars, "XDG_CACHE_HOME")) && base[0] ) {
+        suffix = "/almishell";
+    } else if( (base = get_var(s->vars, "HOME")) && base[0] ) {
+        suffix = "/.cache/almishell";
+    } else {
+        return NULL;
+    }
+
+    path = (char *) malloc(strlen(base) + strlen(suffix) + 1);
+    strcpy(path, base);
+    strcat(path, suffix);
+
+    return path;
+}
+
+static char *cache_file(const char *dir, const char *real_path)
+{
+    char *path = (char *) malloc(strlen(dir) + 32);
+
+    sprintf(path, "%s/%08lx.almc", dir,
+            (unsigned long) hash_bytes(real_path, strlen(real_path)));
+
+    return path;
+}
+
+/* Maps the cache entry if it was compiled by this shell from the script
+   as it is now */
+static struct program *map_cache(const char *cache_path, const char *real_path,
+                                 const struct stat *source)
+{
+    const struct program_header *h;
+    struct program *prog;
+    struct stat st;
+    char *data;
+    int fd = open(cache_path, O_RDONLY | O_CLOEXEC);
+
+    if(fd < 0)
+        return NULL;
+
+    if(fstat(fd, &st) < 0 || (size_t) st.st_size < sizeof(struct program_header)) {
+        close(fd);
+        return NULL;
+    }
+
+    data = (char *) mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if(data == MAP_FAILED)
+        return NULL;
+
+    h = (const struct program_header *) data;
+
+    if(memcmp(h->magic, PROGRAM_MAGIC, sizeof(PROGRAM_MAGIC))
+       || h->format != PROGRAM_FORMAT
+       || strncmp(h->version, ALMISHELL_VERSION, sizeof(h->version))
+       || h->size != (uint64_t) st.st_size
+       || h->source_size != (uint64_t) source->st_size
+       || h->source_mtime_sec != (int64_t) source->st_mtim.tv_sec
+       || h->source_mtime_nsec != (int64_t) source->st_mtim.tv_nsec
+       || h->source_path >= h->size
+       || !memchr(data + h->source_path, '\0', h->size - h->source_path)
+       || strcmp(data + h->source_path, real_path)
+       || h->checksum != hash_bytes(data + sizeof(struct program_header),
+                                    h->size - sizeof(struct program_header))) {
+        munmap(data, st.st_size);
+        return NULL;
+    }
+
+    prog = (struct program *) malloc(sizeof(struct program));
+    prog->data = data;
+    prog->size = st.st_size;
+    prog->capacity = 0;
+    prog->last_job = 0;
+    prog->function = NULL;
+    prog->body = NULL;
+    prog->body_size = 0;
+    prog->depth = 0;
+
+    return prog;
+}
+
+static struct program *compile_script(FILE *input)
+{
+    struct program *prog = init_program();
+    char *line = NULL;
+    size_t buffer_size = 0;
+    ssize_t line_size;
+    uint32_t line_num = 0;
+
+    while( (line_size = getline(&line, &buffer_size, input)) != -1 ) {
+        if(line_size && line[line_size - 1] == '\n')
+            line[--line_size] = '\0';
+
+        if(line_size) {
+            ++line_num;
+            compile_command_line(prog, line);
+        }
+    }
+
+    free(line);
+    finish_program(prog);
+
+    /* Kept in the header so a mapped program counts its lines too */
+    PROGRAM_RECORD(prog, struct program_header, 0)->line_num = line_num;
+
+    return prog;
+}
+
+/* Writes the program to a temporary file renamed over the entry, so
+   concurrent runs never map a partial file */
+static void write_cache(const char *dir, const char *cache_path, const struct program *prog)
+{
+    char *tmp_path = (char *) malloc(strlen(cache_path) + 8);
+    size_t written = 0;
+    ssize_t n;
+    int fd;
+
+    /* Create the cache directory and its parent if needed */
+    if(mkdir(dir, 0700) < 0 && errno == ENOENT) {
+        char *parent = (char *) malloc(strlen(dir) + 1), *slash;
+
+        strcpy(parent, dir);
+        if( (slash = strrchr(parent, '/')) && slash != parent ) {
+            *slash = '\0';
+            mkdir(parent, 0700);
+        }
+        free(parent);
+        mkdir(dir, 0700);
+    }
+
+    sprintf(tmp_path, "%s.XXXXXX", cache_path);
+
+    if( (fd = mkstemp(tmp_path)) < 0 ) {
+        free(tmp_path);
+        return;
+    }
+
+    while(written < prog->size
+          && (n = write(fd, prog->data + written, prog->size - written)) > 0)
+        written += n;
+
+    if(close(fd) < 0 || written != prog->size || rename(tmp_path, cache_path) < 0)
+        unlink(tmp_path);
+
+    free(tmp_path);
+}
+
+struct program *load_script(struct shell_info *s, const char *path)
+{
+    struct program_header *h;
+    struct program *prog = NULL;
+    char *dir = cache_dir(s), *cache_path = NULL, *real_path;
+    struct stat st;
+    uint32_t source_path;
+    FILE *input;
+
+    if(stat(path, &st) < 0 || !(real_path = realpath(path, NULL))) {
+        free(dir);
+        return NULL;
+    }
+
+    if(dir) {
+        cache_path = cache_file(dir, real_path);
+        prog = map_cache(cache_path, real_path, &st);
+    }
+
+    if(!prog && (input = fopen(path, "r"))) {
+        prog = compile_script(input);
+        fclose(input);
+
+        h = PROGRAM_RECORD(prog, struct program_header, 0);
+        strncpy(h->version, ALMISHELL_VERSION, sizeof(h->version));
+        h->source_size = st.st_size;
+        h->source_mtime_sec = st.st_mtim.tv_sec;
+        h->source_mtime_nsec = st.st_mtim.tv_nsec;
+
+        source_path = program_add_string(prog, real_path);
+
+        /* The header pointer is stale after the program grows */
+        h = PROGRAM_RECORD(prog, struct program_header, 0);
+        h->source_path = source_path;
+        h->size = prog->size;
+        h->checksum = hash_bytes(prog->data + sizeof(struct program_header),
+                                 prog->size - sizeof(struct program_header));
+
+        if(cache_path)
+            write_cache(dir, cache_path, prog);
+    }
+
+    if(prog)
+        STATS_ADD(STATS_LINES, PROGRAM_RECORD(prog, struct program_header, 0)->line_num);
+
+    free(cache_path);
+    free(real_path);
+    free(dir);
+
+    return prog;
+}
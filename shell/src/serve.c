@@ -0,0 +1,398 @@
+/*
+ALMiSHELL - A POSIX conformant shell prototype.
+Copyright (C) 2017  Henrique C. S. M. Aranha; Lucas E. C. Mello; Lucas H. F. Leal
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define _GNU_SOURCE /* MSG_CMSG_CLOEXEC */
+
+#include <serve.h>
+#include <almishell.h>
+#include <parser.h>
+#include <vars.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/un.h>
+#include <sys/select.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* stdin, stdout, stderr and the working directory */
+#define SERVE_FDS 4
+
+union serve_control {
+    struct cmsghdr header;
+    char buffer[CMSG_SPACE(sizeof(int) * SERVE_FDS)];
+};
+
+static int socket_address(const char *path, struct sockaddr_un *addr)
+{
+    if(strlen(path) >= sizeof(addr->sun_path)) {
+        fprintf(stderr, "almishell: %s: socket path too long\n", path);
+        return -1;
+    }
+
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    strcpy(addr->sun_path, path);
+
+    return 0;
+}
+
+/* Receives the descriptors of the client and its command line, to be
+   freed. Returns the number of descriptors, or -1 if the connection was
+   closed without a request. */
+static int receive_request(int conn, int *fds, char **line)
+{
+    size_t size, capacity = 4096;
+    char *buffer = (char *) malloc(capacity);
+    union serve_control control;
+    struct cmsghdr *c;
+    struct msghdr msg;
+    struct iovec iov;
+    int fd_num = 0;
+    ssize_t n;
+
+    memset(&msg, 0, sizeof(msg));
+    iov.iov_base = buffer;
+    iov.iov_len = capacity - 1;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buffer;
+    msg.msg_controllen = sizeof(control.buffer);
+
+    while((n = recvmsg(conn, &msg, MSG_CMSG_CLOEXEC)) < 0 && errno == EINTR);
+
+    if(n <= 0) {
+        free(buffer);
+        return -1;
+    }
+
+    for(c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c)) {
+        if(c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_RIGHTS) {
+            fd_num = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            memcpy(fds, CMSG_DATA(c), fd_num * sizeof(int));
+        }
+    }
+
+    /* The rest of the line, up to the end of the client writes */
+    for(size = n; n > 0; size += n) {
+        if(size + 1 == capacity)
+            buffer = (char *) realloc(buffer, capacity *= 2);
+
+        while((n = read(conn, buffer + size, capacity - size - 1)) < 0 && errno == EINTR);
+        if(n < 0)
+            n = 0;
+    }
+
+    buffer[size] = '\0';
+    *line = buffer;
+
+    return fd_num;
+}
+
+/* A request being run, answered once its child exits */
+struct serve_request {
+    pid_t pid;
+    int conn;
+};
+
+static volatile sig_atomic_t child_exited;
+
+static void note_child(int sig)
+{
+    (void) sig;
+    child_exited = 1;
+}
+
+/* Runs the request of the connection in this child of the server, as
+   almishell -c would from the client. The server sends the exit status. */
+static void run_request(struct shell_info *s, int conn)
+{
+    int fds[SERVE_FDS], fd_num, i;
+    struct program *prog;
+    char *line;
+
+    fd_num = receive_request(conn, fds, &line);
+    close(conn);
+
+    /* Such as the probe of a server starting on the same path */
+    if(fd_num < 0)
+        _exit(EXIT_FAILURE);
+
+    if(fd_num < 3) {
+        fprintf(stderr, "almishell: request without stdin, stdout and stderr\n");
+        _exit(EXIT_FAILURE);
+    }
+
+    for(i = 0; i < 3; ++i)
+        dup2(fds[i], i);
+
+    /* The child moves to the directory of the client */
+    if(fd_num > 3 && fchdir(fds[3]) == 0) {
+        free(s->current_path);
+        s->current_path = getcwd(NULL, 0);
+        set_var(s->vars, "PWD", s->current_path);
+    }
+
+    for(i = 0; i < fd_num; ++i)
+        if(fds[i] > 2)
+            close(fds[i]);
+
+    /* The last job can replace the child, its status is the same */
+    s->standalone = 1;
+    s->tail_exec = 1;
+
+    prog = compile_program(line);
+    free(line);
+
+    i = almishell_execute(s, prog, NULL, NULL);
+    fflush(stdout);
+    _exit(i);
+}
+
+/* Sends their status to the clients of the requests that finished */
+static void reply_finished(struct serve_request *requests, size_t *request_num)
+{
+    int status;
+    size_t i;
+    pid_t pid;
+
+    child_exited = 0;
+
+    while((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+        for(i = 0; i < *request_num && requests[i].pid != pid; ++i);
+
+        if(i == *request_num)
+            continue;
+
+        status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+        send(requests[i].conn, &status, sizeof(status), MSG_NOSIGNAL);
+        close(requests[i].conn);
+
+        requests[i] = requests[--*request_num];
+    }
+}
+
+/* Returns 1 if nothing listens on the socket at addr any more */
+static int stale_socket(const struct sockaddr_un *addr)
+{
+    int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0), refused;
+
+    if(probe < 0)
+        return 0;
+
+    refused = connect(probe, (const struct sockaddr *) addr, sizeof(*addr)) < 0
+              && errno == ECONNREFUSED;
+    close(probe);
+
+    return refused;
+}
+
+int serve_socket(struct shell_info *s, const char *path)
+{
+    struct serve_request *requests = NULL;
+    size_t request_num = 0, request_capacity = 0;
+    struct sigaction sact, old_sact;
+    sigset_t chld, old_mask;
+    struct sockaddr_un addr;
+    struct stat st;
+    int server, conn;
+    fd_set ready;
+    mode_t mask;
+    pid_t pid;
+
+    if(socket_address(path, &addr) < 0)
+        return EXIT_FAILURE;
+
+    if((server = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0) {
+        perror("almishell: socket");
+        return EXIT_FAILURE;
+    }
+
+    /* A socket left by a server that did not stop cleanly is replaced,
+       the one of a server still running is not */
+    if(lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        if(!stale_socket(&addr)) {
+            fprintf(stderr, "almishell: %s: address in use\n", path);
+            close(server);
+            return EXIT_FAILURE;
+        }
+        unlink(path);
+    }
+
+    /* Only the user can connect */
+    mask = umask(077);
+    if(bind(server, (struct sockaddr *) &addr, sizeof(addr)) < 0
+       || listen(server, SOMAXCONN) < 0) {
+        fprintf(stderr, "almishell: %s: %s\n", path, strerror(errno));
+        umask(mask);
+        close(server);
+        return EXIT_FAILURE;
+    }
+    umask(mask);
+
+    /* The children start with the environment ready */
+    get_envp(s->vars);
+
+    /* SIGCHLD only comes while waiting for connections */
+    sigemptyset(&chld);
+    sigaddset(&chld, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &chld, &old_mask);
+
+    sact.sa_handler = note_child;
+    sigemptyset(&sact.sa_mask);
+    sact.sa_flags = 0;
+    sigaction(SIGCHLD, &sact, &old_sact);
+
+    for(;;) {
+        FD_ZERO(&ready);
+        FD_SET(server, &ready);
+
+        if(pselect(server + 1, &ready, NULL, NULL, NULL, &old_mask) < 0) {
+            if(errno != EINTR) {
+                perror("almishell: pselect");
+                break;
+            }
+            FD_ZERO(&ready);
+        }
+
+        if(child_exited)
+            reply_finished(requests, &request_num);
+
+        if(!FD_ISSET(server, &ready))
+            continue;
+
+        if((conn = accept(server, NULL, NULL)) < 0) {
+            if(errno == EINTR || errno == ECONNABORTED)
+                continue;
+
+            perror("almishell: accept");
+            break;
+        }
+
+        fflush(stdout);
+
+        if((pid = fork()) == 0) {
+            sigaction(SIGCHLD, &old_sact, NULL);
+            sigprocmask(SIG_SETMASK, &old_mask, NULL);
+            close(server);
+            run_request(s, conn);
+        } else if(pid < 0) {
+            perror("almishell: fork");
+            close(conn);
+            continue;
+        }
+
+        if(request_num == request_capacity) {
+            request_capacity = request_capacity ? request_capacity * 2 : 16;
+            requests = (struct serve_request *) realloc(requests, request_capacity
+                                                        * sizeof(struct serve_request));
+        }
+
+        requests[request_num].pid = pid;
+        requests[request_num++].conn = conn;
+    }
+
+    while(request_num)
+        close(requests[--request_num].conn);
+    free(requests);
+
+    sigaction(SIGCHLD, &old_sact, NULL);
+    sigprocmask(SIG_SETMASK, &old_mask, NULL);
+
+    close(server);
+    unlink(path);
+
+    return EXIT_FAILURE;
+}
+
+int connect_shell(const char *path, const char *command_line)
+{
+    size_t len = strlen(command_line), sent;
+    int fds[SERVE_FDS], fd_num = 3, conn, status;
+    union serve_control control;
+    struct sockaddr_un addr;
+    struct cmsghdr *c;
+    struct msghdr msg;
+    struct iovec iov;
+    ssize_t n;
+
+    if(socket_address(path, &addr) < 0)
+        return EXIT_FAILURE;
+
+    if((conn = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0
+       || connect(conn, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        fprintf(stderr, "almishell: %s: %s\n", path, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    fds[0] = STDIN_FILENO;
+    fds[1] = STDOUT_FILENO;
+    fds[2] = STDERR_FILENO;
+    if((fds[3] = open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC)) >= 0)
+        ++fd_num;
+
+    memset(&msg, 0, sizeof(msg));
+    memset(&control, 0, sizeof(control));
+    /* Ancillary data needs a byte to travel with, the final NUL if need be */
+    iov.iov_base = (void *) command_line;
+    iov.iov_len = len ? len : 1;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buffer;
+    msg.msg_controllen = CMSG_SPACE(sizeof(int) * fd_num);
+
+    c = CMSG_FIRSTHDR(&msg);
+    c->cmsg_level = SOL_SOCKET;
+    c->cmsg_type = SCM_RIGHTS;
+    c->cmsg_len = CMSG_LEN(sizeof(int) * fd_num);
+    memcpy(CMSG_DATA(c), fds, sizeof(int) * fd_num);
+
+    /* The descriptors go with the first bytes, a long line ends in writes */
+    while((n = sendmsg(conn, &msg, MSG_NOSIGNAL)) < 0 && errno == EINTR);
+
+    for(sent = n < 0 ? len : (size_t) n; sent < len; sent += n) {
+        while((n = send(conn, command_line + sent, len - sent, MSG_NOSIGNAL)) < 0
+              && errno == EINTR);
+        if(n < 0)
+            break;
+    }
+
+    if(fd_num > 3)
+        close(fds[3]);
+
+    shutdown(conn, SHUT_WR);
+
+    while((n = read(conn, &status, sizeof(status))) < 0 && errno == EINTR);
+    close(conn);
+
+    if(n != sizeof(status)) {
+        fprintf(stderr, "almishell: %s: no status from the server\n", path);
+        return EXIT_FAILURE;
+    }
+
+    return status;
+}
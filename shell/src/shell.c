@@ -21,9 +21,18 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <string.h>
 
 #include <sys/signal.h>
+#include <poll.h>
+#include <unistd.h>
 
 #include <shell.h>
 #include <job.h>
+#include <complete.h>
+#include <vars.h>
+#include <wildcard.h>
+#include <stats.h>
+#include <function.h>
+#include <read.h>
+#include <watch.h>
 
 const char *shell_cmd[SHELL_CMD_NUM] = {
     "exit",
@@ -32,16 +41,31 @@ const char *shell_cmd[SHELL_CMD_NUM] = {
     "jobs",
     "fg",
     "bg",
-    "almishell"
+    "almishell",
+    "export",
+    "unset",
+    "wait",
+    "ulimit",
+    "exec",
+    "return",
+    "read",
+    "mapfile",
+    "readarray"
 };
 
-struct shell_info init_shell()
+extern char **environ;
+
+struct shell_info init_shell(int flags)
 {
     struct shell_info info;
     struct sigaction sact;
+    int i;
 
     info.terminal = STDIN_FILENO;
-    info.interactive = isatty(info.terminal);
+    info.interactive = (flags & ALMISHELL_TERMINAL) && isatty(info.terminal);
+    info.builtins = (flags & ALMISHELL_BUILTINS) != 0;
+    info.standalone = 0;
+    info.tail_exec = 0;
 
     info.current_path = getcwd(NULL, 0);
 
@@ -79,15 +103,65 @@ struct shell_info init_shell()
     }
 
     info.run = 1;
+    info.last_status = 0;
+    info.io[0] = STDIN_FILENO;
+    info.io[1] = STDOUT_FILENO;
+    info.io[2] = STDERR_FILENO;
+    info.positional = NULL;
+    info.positional_num = 0;
+    for(i = 0; i < SHELL_FD_MAX; ++i)
+        info.fds[i] = -1;
+    info.vars = init_vars(environ);
+    info.functions = init_functions();
+    info.function_depth = 0;
+    info.returning = 0;
     info.first_job = NULL;
     info.tail_job = NULL;
+    info.watch = init_process_watch();
+    info.completion = NULL;
+    info.dir_cache = init_dir_cache();
+    info.read_buffer = NULL;
 
     return info;
 }
 
 void delete_shell(struct shell_info *info)
 {
+    struct job *current = info->first_job, *next;
+    int i;
+
+    while(current) {
+        next = current->next;
+        unwatch_job(info->watch, current);
+        delete_job(current);
+        stats_job_table(-1);
+        current = next;
+    }
+    info->first_job = info->tail_job = NULL;
+    delete_process_watch(info->watch);
+    info->watch = NULL;
+
+    for(i = 0; i < SHELL_FD_MAX; ++i) {
+        if(info->fds[i] >= 0)
+            close(info->fds[i]);
+        info->fds[i] = -1;
+    }
+
     free(info->current_path);
+    delete_completion(info->completion);
+    delete_vars(info->vars);
+    delete_functions(info->functions);
+    delete_dir_cache(info->dir_cache);
+    delete_read_buffer(info->read_buffer);
+    info->read_buffer = NULL;
+}
+
+void print_prompt(const char *path)
+{
+    const char *prompt_str = "$ ";
+
+    printf("[%s]%s", path, prompt_str);
+    fflush(stdout);
 }
 
 /*  If it's a builtin command, returns its index in the shell_cmd array,
@@ -99,6 +173,36 @@ enum SHELL_CMD is_builtin_command(const char *cmd)
     case 'e':
         if(strcmp(shell_cmd[SHELL_EXIT], cmd) == 0)
             return SHELL_EXIT;
+        if(strcmp(shell_cmd[SHELL_EXPORT], cmd) == 0)
+            return SHELL_EXPORT;
+        if(strcmp(shell_cmd[SHELL_EXEC], cmd) == 0)
+            return SHELL_EXEC;
+        break;
+
+    case 'u':
+        if(strcmp(shell_cmd[SHELL_UNSET], cmd) == 0)
+            return SHELL_UNSET;
+        if(strcmp(shell_cmd[SHELL_ULIMIT], cmd) == 0)
+            return SHELL_ULIMIT;
+        break;
+
+    case 'w':
+        if(strcmp(shell_cmd[SHELL_WAIT], cmd) == 0)
+            return SHELL_WAIT;
+        break;
+
+    case 'r':
+        if(strcmp(shell_cmd[SHELL_RETURN], cmd) == 0)
+            return SHELL_RETURN;
+        if(strcmp(shell_cmd[SHELL_READ], cmd) == 0)
+            return SHELL_READ;
+        if(strcmp(shell_cmd[SHELL_READARRAY], cmd) == 0)
+            return SHELL_READARRAY;
+        break;
+
+    case 'm':
+        if(strcmp(shell_cmd[SHELL_MAPFILE], cmd) == 0)
+            return SHELL_MAPFILE;
         break;
 
     case 'q':
@@ -138,13 +242,48 @@ enum SHELL_CMD is_builtin_command(const char *cmd)
     return SHELL_NONE;
 }
 
-void run_jobs(struct shell_info *sh)
+/* Prints the line of each process of the job that was started, with its
+   resource use sampled now. Returns the number of lines. */
+static int print_job_processes(FILE *out, struct job *j)
+{
+    struct process_node *node;
+    char rss[16], reads[16], writes[16];
+    int lines = 0;
+
+    for(node = j->first_process; node; node = node->next) {
+        struct process *p = node->p;
+
+        if(p->pid <= 0)
+            continue;
+
+        if(!p->completed && sample_process(p->pid, &p->sample)) {
+            format_size(p->sample->rss, rss);
+            format_size(p->sample->read_bytes, reads);
+            format_size(p->sample->write_bytes, writes);
+
+            fprintf(out, "\t%7ld  %c %6.1f %8s %8s %8s  %s\n", (long) p->pid,
+                    p->sample->state, p->sample->cpu, rss, reads, writes, p->argv[0]);
+        } else {
+            fprintf(out, "\t%7ld  - %6s %8s %8s %8s  %s\n", (long) p->pid,
+                    "-", "-", "-", "-", p->argv[0]);
+        }
+
+        ++lines;
+    }
+
+    return lines;
+}
+
+/* Prints the job list, with list the processes and the job controls.
+   Returns the number of lines printed. */
+static int print_jobs(struct shell_info *sh, FILE *out, int list)
 {
     struct job *it = sh->first_job;
     struct job *curJob, *minusJob, *plusJob;
+    int lines = 0;
     curJob = plusJob = minusJob = sh->first_job;
 
-    update_status(sh->first_job);
+    update_status(sh);
 
     while(curJob) {
         if(curJob->priority > plusJob->priority) {
@@ -160,8 +299,14 @@ void run_jobs(struct shell_info *sh)
         curJob = curJob->next;
     }
 
+    if(list && it) {
+        fprintf(out, "\t%7s  S %6s %8s %8s %8s  %s\n", "PID", "CPU%", "RSS", "READ", "WRITE",
+                "COMMAND");
+        ++lines;
+    }
+
     while(it) {
-        printf("[%d]%c  ", it->id, (plusJob->id==it->id ? '+' : (minusJob->id==it->id ? '-' : ' ')));
+        fprintf(out, "[%d]%c  ", it->id, (plusJob->id==it->id ? '+' : (minusJob->id==it->id ? '-' : ' ')));
 
         if(job_is_completed(it)) {
             struct process_node *last = it->first_process;
@@ -170,19 +315,107 @@ void run_jobs(struct shell_info *sh)
             while(last->next != NULL)
                 last = last->next;
 
-            printf("Done");
+            fprintf(out, "Done");
+            it->notify = 0;
 
             if(last->p->status != 0)
-                printf("(%d)", last->p->status);
+                fprintf(out, "(%d)", last->p->status);
         } else if(job_is_stopped(it)) {
-            printf("Stopped");
+            fprintf(out, "Stopped");
         } else { /* Job is running */
-            printf("Running");
+            fprintf(out, "Running");
+        }
+
+        fprintf(out, "\t\t\t%s%s\n", it->command, it->background == 'b' ? " &" : "");
+        ++lines;
+
+        if(list) {
+            lines += print_job_processes(out, it);
+
+            if(it->resources) {
+                fprintf(out, "\t");
+                print_job_resources(it->resources, out);
+                fprintf(out, "\n");
+                ++lines;
+            }
         }
 
-        printf("\t\t\t%s%s\n", it->command, it->background == 'b' ? " &" : "");
         it = it->next;
     }
+
+    return lines;
+}
+
+static int jobs_running(struct shell_info *sh)
+{
+    struct job *j;
+
+    for(j = sh->first_job; j; j = j->next)
+        if(!job_is_completed(j) && !job_is_stopped(j))
+            return 1;
+
+    return 0;
+}
+
+int run_jobs(struct shell_info *sh, FILE *out, char **args)
+{
+    int list = 0, watch = 0, lines, i;
+    double interval = 1;
+    struct pollfd input;
+    char *end, line[256];
+
+    for(i = 1; args[i]; ++i) {
+        if(!strcmp(args[i], "-l") || !strcmp(args[i], "-v")) {
+            list = 1;
+        } else if(!strcmp(args[i], "-w")) {
+            watch = list = 1;
+
+            /* An optional refresh interval, in seconds */
+            if(args[i + 1]) {
+                interval = strtod(args[i + 1], &end);
+
+                if(*end || end == args[i + 1]) {
+                    interval = 1;
+                } else if(interval <= 0) {
+                    fprintf(stderr, "almishell: jobs: %s: invalid interval\n", args[i + 1]);
+                    return 2;
+                } else {
+                    ++i;
+                }
+            }
+        } else {
+            fprintf(stderr, "almishell: jobs: %s: invalid option\n"
+                    "usage: jobs [-l|-v] [-w [seconds]]\n", args[i]);
+            return 2;
+        }
+    }
+
+    lines = print_jobs(sh, out, list);
+
+    /* The terminal is watched for a line that ends the refresh, other
+       shells only refresh until no job runs */
+    input.fd = sh->interactive ? sh->terminal : -1;
+    input.events = POLLIN;
+
+    while(watch && jobs_running(sh)) {
+        fflush(out);
+
+        if(poll(&input, 1, (int) (interval * 1000)) > 0 && (input.revents & POLLIN)) {
+            if(read(input.fd, line, sizeof(line)) < 0)
+                perror("almishell: jobs");
+            break;
+        }
+
+        /* Redrawn in place on a terminal */
+        if(isatty(fileno(out)))
+            fprintf(out, "\033[%dA\033[J", lines);
+
+        lines = print_jobs(sh, out, list);
+    }
+
+    fflush(out);
+
+    return 0;
 }
 
 void fg_bg(struct shell_info *sh, char **args, int id)
@@ -202,7 +435,8 @@ void fg_bg(struct shell_info *sh, char **args, int id)
     if(!args[1]) {
         i = maxPriority->id;
     } else {
-        i = atoi(args[1]);
+        /* Accept both the job number and the %n job spec */
+        i = atoi(args[1][0] == '%' ? &args[1][1] : args[1]);
     }
 
     if(i < 1) {
@@ -243,8 +477,88 @@ void fg_bg(struct shell_info *sh, char **args, int id)
     printf("almishell: %s: %s: no such job\n", args[0], args[1] ? args[1] : "current");
 }
 
-void run_builtin_command(struct shell_info *sh, FILE *out, char **args, int id)
+int wait_jobs(struct shell_info *sh, char **args)
+{
+    struct job **jobs = NULL, *j, *last_job = NULL, *done;
+    struct process **procs = NULL, *last_proc = NULL;
+    struct process_node *node;
+    size_t n = 0, capacity = 0;
+    int any = 0, first = 1, status = 0, i;
+
+    if(args[1] && strcmp(args[1], "-n") == 0) {
+        any = 1;
+        first = 2;
+    }
+
+    /* Without operands every known job is waited for */
+    if(args[first]) {
+        for(j = sh->first_job; j; j = j->next)
+            capacity += j->size;
+
+        jobs = (struct job **) malloc((capacity ? capacity : 1) * sizeof(struct job *));
+        procs = (struct process **) malloc((capacity ? capacity : 1) * sizeof(struct process *));
+    }
+
+    for(i = first; args[i]; ++i) {
+        pid_t pid = args[i][0] == '%' ? 0 : atoi(args[i]);
+        int id = args[i][0] == '%' ? atoi(&args[i][1]) : 0;
+
+        last_job = NULL;
+        last_proc = NULL;
+
+        for(j = sh->first_job; j && !last_job; j = j->next) {
+            for(node = j->first_process; node; node = node->next) {
+                if(!(id && j->id == id) && !(pid && node->p->pid == pid))
+                    continue;
+
+                jobs[n] = j;
+                procs[n++] = node->p;
+
+                last_job = j;
+                if(pid)
+                    last_proc = node->p;
+            }
+        }
+
+        if(!last_job) {
+            fprintf(stderr, "almishell: %s: %s: no such job\n", args[0], args[i]);
+            status = 127;
+        }
+    }
+
+    done = wait_processes(sh, jobs, procs, n, any);
+
+    /* wait -n takes a single job */
+    if(any) {
+        if(done)
+            done->notify = 0;
+    } else if(procs) {
+        for(i = 0; (size_t) i < n; ++i)
+            if(job_is_completed(jobs[i]))
+                jobs[i]->notify = 0;
+    } else {
+        for(j = sh->first_job; j; j = j->next)
+            if(job_is_completed(j))
+                j->notify = 0;
+    }
+
+    if(any)
+        status = done ? job_exit_status(done) : 127;
+    else if(last_proc)
+        status = process_exit_status(last_proc);
+    else if(last_job)
+        status = job_exit_status(last_job);
+
+    free(jobs);
+    free(procs);
+
+    return status;
+}
+
+int run_builtin_command(struct shell_info *sh, int in, FILE *out, char **args, int id)
 {
+    int i, status = 0;
+
     switch(id) {
     case SHELL_EXIT:
     case SHELL_QUIT:
@@ -253,17 +567,19 @@ void run_builtin_command(struct shell_info *sh, FILE *out, char **args, int id)
 
     case SHELL_CD:
         if(args[1]) {
-            if(chdir(args[1]) < 0)
+            if(chdir(args[1]) < 0) {
                 perror("almishell: cd");
+                status = 1;
+            }
 
             free(sh->current_path);
             sh->current_path = getcwd(NULL, 0);
-            setenv("PWD", sh->current_path, 1);
+            set_var(sh->vars, "PWD", sh->current_path);
         }
         break;
 
     case SHELL_JOBS:
-        run_jobs(sh);
+        status = run_jobs(sh, out, args);
         break;
 
     case SHELL_FG:
@@ -272,13 +588,84 @@ void run_builtin_command(struct shell_info *sh, FILE *out, char **args, int id)
         break;
 
     case SHELL_ALMISHELL:
+        if(args[1] && !strcmp(args[1], STATS_COMMAND)) {
+            status = stats_builtin(out, args + 1);
+            break;
+        }
+
         fprintf(out, "\"Os alunos tão latindo Michel, traz a antirábica.\"\n");
         fflush(out);
         break;
 
+    case SHELL_EXPORT:
+        if(!args[1])
+            print_exported_vars(sh->vars, out);
+
+        for(i = 1; args[i]; ++i) {
+            if(is_assignment(args[i])) {
+                assign_var(sh->vars, args[i]);
+                *strchr(args[i], '=') = '\0';
+            } else if(!var_name_len(args[i]) || args[i][var_name_len(args[i])]) {
+                fprintf(stderr, "almishell: export: %s: not a valid identifier\n", args[i]);
+                status = 1;
+                continue;
+            }
+
+            export_var(sh->vars, args[i]);
+        }
+        break;
+
+    case SHELL_UNSET:
+        /* unset -f removes functions */
+        if(args[1] && !strcmp(args[1], "-f")) {
+            for(i = 2; args[i]; ++i)
+                undefine_function(sh->functions, args[i]);
+            break;
+        }
+
+        for(i = 1; args[i]; ++i)
+            unset_var(sh->vars, args[i]);
+        break;
+
+    case SHELL_WAIT:
+        status = wait_jobs(sh, args);
+        break;
+
+    case SHELL_ULIMIT:
+        status = ulimit_builtin(out, args);
+        break;
+
+    case SHELL_EXEC:
+        /* Only reached without a command, launch_job runs the command or
+           keeps the redirections */
+        break;
+
+    case SHELL_RETURN:
+        if(!sh->function_depth) {
+            fprintf(stderr, "almishell: return: can only return from a function\n");
+            status = 1;
+            break;
+        }
+
+        status = args[1] ? atoi(args[1]) & 0xFF : sh->last_status;
+        sh->returning = 1;
+        break;
+
+    case SHELL_READ:
+        status = read_builtin(sh, in, args);
+        break;
+
+    case SHELL_MAPFILE:
+    case SHELL_READARRAY:
+        status = mapfile_builtin(sh, in, args);
+        break;
+
     default:
         fprintf(out, "almishell: invalid command\n");
         fflush(out);
+        status = 1;
         break;
     }
+
+    return status;
 }
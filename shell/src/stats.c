@@ -0,0 +1,177 @@
+/*
+ALMiSHELL - A POSIX conformant shell prototype.
+Copyright (C) 2017  Henrique C. S. M. Aranha; Lucas E. C. Mello; Lucas H. F. Leal
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define _GNU_SOURCE /* mallinfo2 */
+
+#include <stats.h>
+
+#include <sys/wait.h>
+#include <malloc.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+struct shell_stats shell_stats;
+
+static const char *counter_names[STATS_COUNTER_NUM][2] = {
+    {"lines read", "lines_read"},
+    {"forks", "forks"},
+    {"exec failures", "exec_failures"},
+    {"pipes", "pipes"},
+    {"reaps", "reaps"},
+    {"jobs", "jobs"},
+    {"peak jobs", "peak_jobs"},
+    {"peak heap bytes", "peak_heap_bytes"},
+    {"memo hits", "memo_hits"},
+    {"memo misses", "memo_misses"}
+};
+
+static const char *timing_names[STATS_TIMING_NUM] = {
+    "parse",
+    "launch"
+};
+
+void stats_time(enum stats_timing timing, const struct timespec *start)
+{
+    struct timespec now;
+    double elapsed;
+    unsigned long us;
+    int bucket = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    elapsed = (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+
+    for(us = (unsigned long) (elapsed * 1e6); us && bucket < STATS_BUCKETS - 1; us >>= 1)
+        ++bucket;
+
+    ++shell_stats.histograms[timing][bucket];
+    ++shell_stats.timing_num[timing];
+    shell_stats.timing_total[timing] += elapsed;
+}
+
+void stats_reap(int status)
+{
+    ++shell_stats.counters[STATS_REAPS];
+
+    /* The child cannot tell the shell, its status is the only trace */
+    if(WIFEXITED(status) && (WEXITSTATUS(status) == 126 || WEXITSTATUS(status) == 127))
+        ++shell_stats.counters[STATS_EXEC_FAILURES];
+}
+
+void stats_job_table(long delta)
+{
+    unsigned long *c = shell_stats.counters;
+    struct mallinfo2 heap;
+
+    c[STATS_JOBS] += delta;
+    if(c[STATS_JOBS] > c[STATS_PEAK_JOBS])
+        c[STATS_PEAK_JOBS] = c[STATS_JOBS];
+
+    if(delta > 0) {
+        heap = mallinfo2();
+        if(heap.uordblks + heap.hblkhd > c[STATS_PEAK_HEAP])
+            c[STATS_PEAK_HEAP] = heap.uordblks + heap.hblkhd;
+    }
+}
+
+void reset_stats(void)
+{
+    unsigned long jobs = shell_stats.counters[STATS_JOBS];
+
+    memset(&shell_stats, 0, sizeof(shell_stats));
+
+    /* The jobs still in the table are not forgotten */
+    shell_stats.counters[STATS_JOBS] = shell_stats.counters[STATS_PEAK_JOBS] = jobs;
+}
+
+void print_stats(FILE *out, int key_value)
+{
+    int i, b;
+    double average;
+
+    for(i = 0; i < STATS_COUNTER_NUM; ++i) {
+        if(key_value)
+            fprintf(out, "%s=%lu\n", counter_names[i][1], shell_stats.counters[i]);
+        else
+            fprintf(out, "%-20s %lu\n", counter_names[i][0], shell_stats.counters[i]);
+    }
+
+    for(i = 0; i < STATS_TIMING_NUM; ++i) {
+        average = shell_stats.timing_num[i] ?
+            shell_stats.timing_total[i] / shell_stats.timing_num[i] * 1e6 : 0;
+
+        if(key_value)
+            fprintf(out, "%s_count=%lu\n%s_total_us=%.0f\n", timing_names[i],
+                    shell_stats.timing_num[i], timing_names[i], shell_stats.timing_total[i] * 1e6);
+        else
+            fprintf(out, "%-20s %lu, %.1f us on average\n", timing_names[i],
+                    shell_stats.timing_num[i], average);
+
+        /* Only the buckets in use */
+        for(b = 0; b < STATS_BUCKETS; ++b) {
+            if(!shell_stats.histograms[i][b])
+                continue;
+
+            if(key_value)
+                fprintf(out, "%s_under_%lu_us=%lu\n", timing_names[i], 1UL << b,
+                        shell_stats.histograms[i][b]);
+            else
+                fprintf(out, "  < %8lu us %10lu\n", 1UL << b, shell_stats.histograms[i][b]);
+        }
+    }
+
+    fflush(out);
+}
+
+int stats_builtin(FILE *out, char **args)
+{
+    int i, key_value = 0, reset = 0;
+
+    for(i = 1; args[i]; ++i) {
+        if(!strcmp(args[i], "-k"))
+            key_value = 1;
+        else if(!strcmp(args[i], "-r"))
+            reset = 1;
+        else {
+            fprintf(stderr, "usage: %s [-k] [-r]\n", STATS_COMMAND);
+            return 2;
+        }
+    }
+
+    print_stats(out, key_value);
+
+    if(reset)
+        reset_stats();
+
+    return 0;
+}
+
+void dump_stats(const char *value)
+{
+    FILE *out = stderr;
+
+    if(value[0] && strcmp(value, "-") && !(out = fopen(value, "a"))) {
+        perror("almishell: stats");
+        return;
+    }
+
+    print_stats(out, 1);
+
+    if(out != stderr)
+        fclose(out);
+}
@@ -0,0 +1,87 @@
+/*
+ALMiSHELL - A POSIX conformant shell prototype.
+Copyright (C) 2017  Henrique C. S. M. Aranha; Lucas E. C. Mello; Lucas H. F. Leal
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define _GNU_SOURCE /* pipe2 */
+
+#include <substitution.h>
+#include <shell.h>
+#include <parser.h>
+#include <job.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int is_process_substitution(const char *word)
+{
+    size_t len = strlen(word);
+
+    return (word[0] == '<' || word[0] == '>') && word[1] == '(' && len > 2
+           && word[len - 1] == ')';
+}
+
+int substitute_process(struct shell_info *s, const char *word)
+{
+    size_t len = strlen(word);
+    char *commands = (char *) malloc(len);
+    const char *body;
+    struct program *prog;
+    struct job *j;
+    uint32_t job;
+    int fds[2], to_shell = word[0] == '<';
+
+    memcpy(commands, word + 2, len - 3);
+    commands[len - 3] = '\0';
+    prog = compile_nested_program(commands);
+    free(commands);
+
+    job = program_first_job(prog);
+
+    if(!job || program_next_job(prog, job) || program_job_function(prog, job, &body)) {
+        fprintf(stderr, "almishell: %s: a single pipeline is expected\n", word);
+        delete_program(prog);
+        return -1;
+    }
+
+    if(pipe2(fds, O_CLOEXEC) < 0) {
+        perror("almishell: pipe");
+        delete_program(prog);
+        return -1;
+    }
+
+    if(!(j = instantiate_job(s, prog, job))) {
+        close(fds[0]);
+        close(fds[1]);
+        delete_program(prog);
+        return -1;
+    }
+
+    /* <(...) writes to the shell end, >(...) reads from it */
+    j->background = 'b';
+    j->io[to_shell ? 1 : 0] = fds[to_shell ? 1 : 0];
+
+    launch_job(s, j);
+
+    close(fds[to_shell ? 1 : 0]);
+    delete_program(prog);
+
+    return fds[to_shell ? 0 : 1];
+}
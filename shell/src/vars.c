@@ -0,0 +1,301 @@
+/*
+ALMiSHELL - A POSIX conformant shell prototype.
+Copyright (C) 2017  Henrique C. S. M. Aranha; Lucas E. C. Mello; Lucas H. F. Leal
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <vars.h>
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define VARS_INITIAL_BUCKETS 64
+
+/* FNV-1a over the first len characters of name */
+static unsigned long hash_name(const char *name, size_t len)
+{
+    unsigned long h = 2166136261UL;
+    size_t i;
+
+    for(i = 0; i < len; ++i) {
+        h ^= (unsigned char) name[i];
+        h *= 16777619UL;
+    }
+
+    return h;
+}
+
+size_t var_name_len(const char *str)
+{
+    size_t len = 0;
+
+    if(!(isalpha((unsigned char) str[0]) || str[0] == '_'))
+        return 0;
+
+    while(isalnum((unsigned char) str[len]) || str[len] == '_')
+        ++len;
+
+    return len;
+}
+
+int is_assignment(const char *word)
+{
+    size_t len = var_name_len(word);
+
+    return len && word[len] == '=';
+}
+
+static struct variable *find_var(struct var_table *t, const char *name, size_t len,
+                                 unsigned long hash)
+{
+    struct variable *v = t->buckets[hash % t->bucket_num];
+
+    for(; v; v = v->next)
+        if(v->hash == hash && v->name_len == len && !strncmp(v->entry, name, len))
+            return v;
+
+    return NULL;
+}
+
+static void grow_table(struct var_table *t)
+{
+    size_t i, bucket_num = t->bucket_num * 2;
+    struct variable **buckets = (struct variable **) calloc(bucket_num, sizeof(struct variable *));
+
+    for(i = 0; i < t->bucket_num; ++i) {
+        struct variable *v = t->buckets[i], *next;
+
+        for(; v; v = next) {
+            next = v->next;
+            v->next = buckets[v->hash % bucket_num];
+            buckets[v->hash % bucket_num] = v;
+        }
+    }
+
+    free(t->buckets);
+    t->buckets = buckets;
+    t->bucket_num = bucket_num;
+}
+
+/* Stores name=value, len is the length of name */
+static struct variable *store_var(struct var_table *t, const char *name, size_t len,
+                                  const char *value)
+{
+    unsigned long hash = hash_name(name, len);
+    struct variable *v = find_var(t, name, len, hash);
+    size_t value_len = strlen(value);
+
+    if(!v) {
+        if(t->size >= t->bucket_num)
+            grow_table(t);
+
+        v = (struct variable *) malloc(sizeof(struct variable));
+        v->name_len = len;
+        v->hash = hash;
+        v->exported = 0;
+        v->entry = NULL;
+        v->next = t->buckets[hash % t->bucket_num];
+        t->buckets[hash % t->bucket_num] = v;
+        ++t->size;
+    } else if(v->exported) {
+        t->envp_dirty = 1;
+    }
+
+    free(v->entry);
+    v->entry = (char *) malloc(len + value_len + 2);
+    memcpy(v->entry, name, len);
+    v->entry[len] = '=';
+    memcpy(v->entry + len + 1, value, value_len + 1);
+
+    return v;
+}
+
+struct var_table *init_vars(char **env)
+{
+    struct var_table *t = (struct var_table *) malloc(sizeof(struct var_table));
+
+    t->bucket_num = VARS_INITIAL_BUCKETS;
+    t->buckets = (struct variable **) calloc(t->bucket_num, sizeof(struct variable *));
+    t->size = 0;
+    t->exported_num = 0;
+    t->envp = NULL;
+    t->envp_dirty = 1;
+
+    for(; env && *env; ++env) {
+        const char *eq = strchr(*env, '=');
+        struct variable *v;
+
+        if(!eq || eq == *env)
+            continue;
+
+        v = store_var(t, *env, eq - *env, eq + 1);
+        if(!v->exported) {
+            v->exported = 1;
+            ++t->exported_num;
+        }
+    }
+
+    return t;
+}
+
+void delete_vars(struct var_table *t)
+{
+    size_t i;
+
+    if(!t)
+        return;
+
+    for(i = 0; i < t->bucket_num; ++i) {
+        struct variable *v = t->buckets[i], *next;
+
+        for(; v; v = next) {
+            next = v->next;
+            free(v->entry);
+            free(v);
+        }
+    }
+
+    free(t->buckets);
+    free(t->envp);
+    free(t);
+}
+
+const char *get_var(struct var_table *t, const char *name)
+{
+    return get_var_len(t, name, strlen(name));
+}
+
+const char *get_var_len(struct var_table *t, const char *name, size_t len)
+{
+    struct variable *v = find_var(t, name, len, hash_name(name, len));
+
+    return v ? v->entry + len + 1 : NULL;
+}
+
+void set_var(struct var_table *t, const char *name, const char *value)
+{
+    store_var(t, name, strlen(name), value);
+}
+
+void set_var_len(struct var_table *t, const char *name, size_t len, const char *value)
+{
+    store_var(t, name, len, value);
+}
+
+void assign_var(struct var_table *t, const char *assignment)
+{
+    const char *eq = strchr(assignment, '=');
+
+    if(eq)
+        store_var(t, assignment, eq - assignment, eq + 1);
+}
+
+void export_var(struct var_table *t, const char *name)
+{
+    size_t len = strlen(name);
+    struct variable *v = find_var(t, name, len, hash_name(name, len));
+
+    if(v && !v->exported) {
+        v->exported = 1;
+        ++t->exported_num;
+        t->envp_dirty = 1;
+    }
+}
+
+void unset_var(struct var_table *t, const char *name)
+{
+    size_t len = strlen(name);
+    unsigned long hash = hash_name(name, len);
+    struct variable **link = &t->buckets[hash % t->bucket_num], *v;
+
+    for(; (v = *link); link = &v->next) {
+        if(v->hash == hash && v->name_len == len && !strncmp(v->entry, name, len)) {
+            *link = v->next;
+
+            if(v->exported) {
+                --t->exported_num;
+                t->envp_dirty = 1;
+            }
+
+            free(v->entry);
+            free(v);
+            --t->size;
+            return;
+        }
+    }
+}
+
+char **get_envp(struct var_table *t)
+{
+    size_t i, k = 0;
+
+    if(!t->envp_dirty)
+        return t->envp;
+
+    t->envp = (char **) realloc(t->envp, (t->exported_num + 1) * sizeof(char *));
+
+    for(i = 0; i < t->bucket_num; ++i) {
+        struct variable *v;
+
+        for(v = t->buckets[i]; v; v = v->next)
+            if(v->exported)
+                t->envp[k++] = v->entry;
+    }
+
+    t->envp[k] = NULL;
+    t->envp_dirty = 0;
+
+    return t->envp;
+}
+
+char **overlay_envp(struct var_table *t, char **assignments)
+{
+    char **base = get_envp(t), **envp, **a;
+    size_t k = 0, assignment_num = 0;
+
+    for(a = assignments; *a; ++a)
+        ++assignment_num;
+
+    envp = (char **) malloc((t->exported_num + assignment_num + 1) * sizeof(char *));
+
+    for(a = assignments; *a; ++a)
+        envp[k++] = *a;
+
+    for(; *base; ++base) {
+        size_t len = strchr(*base, '=') - *base + 1;
+
+        for(a = assignments; *a; ++a)
+            if(!strncmp(*a, *base, len))
+                break;
+
+        if(!*a)
+            envp[k++] = *base;
+    }
+
+    envp[k] = NULL;
+
+    return envp;
+}
+
+void print_exported_vars(struct var_table *t, FILE *out)
+{
+    char **envp;
+
+    for(envp = get_envp(t); *envp; ++envp)
+        fprintf(out, "export %s\n", *envp);
+
+    fflush(out);
+}
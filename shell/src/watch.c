@@ -0,0 +1,623 @@
+/*
+ALMiSHELL - A POSIX conformant shell prototype.
+Copyright (C) 2017  Henrique C. S. M. Aranha; Lucas E. C. Mello; Lucas H. F. Leal
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define _GNU_SOURCE /* wait4, pidfd_open, pipe2, W_STOPCODE */
+
+#include <watch.h>
+#include <job.h>
+
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define WATCH_EVENTS 64         /* events taken by one epoll_wait */
+
+/* A pidfd, or the deadline timer of j if p is NULL */
+struct watch_entry {
+    struct job *j;
+    struct process *p;
+};
+
+struct process_watch {
+    pid_t owner;                /* a forked shell starts a set of its own */
+    int epfd;
+    struct watch_entry *entries; /* by descriptor */
+    int entry_num;
+    struct watch_entry *polled; /* processes and deadlines left without a descriptor */
+    size_t polled_num, polled_capacity;
+    char out_of_fds;            /* the lack of descriptors was reported */
+    char children;              /* the SIGCHLD pipe is in the set */
+    struct job *first_completed, *last_completed; /* not taken yet */
+};
+
+/* SIGCHLD writes a byte to this pipe, which is in the set of every watch
+   of the process, so a wait also wakes up when a process stops */
+static int child_pipe[2] = {-1, -1};
+static pid_t child_pipe_owner;
+static int child_pipe_users;
+static struct sigaction saved_child_action;
+
+static void notify_child(int sig)
+{
+    int saved = errno;
+    char c = (char) sig;
+    ssize_t n;
+
+    /* A full pipe already has a wakeup pending */
+    n = write(child_pipe[1], &c, 1);
+    (void) n;
+
+    errno = saved;
+}
+
+/* The set is kept out of the descriptors used by redirections, as are
+   the other descriptors of the shell */
+static int shell_fd(int fd)
+{
+    int high;
+
+    if(fd < 0 || fd >= SHELL_FD_MAX || (high = fcntl(fd, F_DUPFD_CLOEXEC, SHELL_FD_MAX)) < 0)
+        return fd;
+
+    close(fd);
+
+    return high;
+}
+
+static int open_child_pipe(void)
+{
+    int fds[2];
+
+    child_pipe_owner = getpid();
+
+    if(pipe2(fds, O_CLOEXEC | O_NONBLOCK) < 0) {
+        child_pipe[0] = child_pipe[1] = -1;
+        return -1;
+    }
+
+    child_pipe[0] = shell_fd(fds[0]);
+    child_pipe[1] = shell_fd(fds[1]);
+
+    return 0;
+}
+
+static void watch_children(struct process_watch *w)
+{
+    struct epoll_event event;
+    struct sigaction sact;
+
+    if(!child_pipe_users) {
+        /* A program embedding the shell may handle SIGCHLD itself */
+        sigaction(SIGCHLD, NULL, &saved_child_action);
+        if((saved_child_action.sa_flags & SA_SIGINFO)
+           || saved_child_action.sa_handler != SIG_DFL || open_child_pipe() < 0)
+            return;
+
+        sact.sa_handler = notify_child;
+        sigemptyset(&sact.sa_mask);
+        sact.sa_flags = SA_RESTART;
+        sigaction(SIGCHLD, &sact, NULL);
+    } else if(child_pipe_owner != getpid()) {
+        /* The pipe of the parent shell is left to it */
+        close(child_pipe[0]);
+        close(child_pipe[1]);
+        open_child_pipe();
+    }
+
+    event.events = EPOLLIN;
+    event.data.fd = child_pipe[0];
+    if(child_pipe[0] < 0 || epoll_ctl(w->epfd, EPOLL_CTL_ADD, child_pipe[0], &event) < 0)
+        return;
+
+    w->children = 1;
+    ++child_pipe_users;
+}
+
+static void unwatch_children(struct process_watch *w)
+{
+    if(!w->children)
+        return;
+
+    w->children = 0;
+    if(--child_pipe_users)
+        return;
+
+    sigaction(SIGCHLD, &saved_child_action, NULL);
+    close(child_pipe[0]);
+    close(child_pipe[1]);
+    child_pipe[0] = child_pipe[1] = -1;
+}
+
+static void open_watch(struct process_watch *w)
+{
+    w->owner = getpid();
+    w->epfd = shell_fd(epoll_create1(EPOLL_CLOEXEC));
+    w->entries = NULL;
+    w->entry_num = 0;
+    w->polled = NULL;
+    w->polled_num = w->polled_capacity = 0;
+    w->out_of_fds = 0;
+    w->children = 0;
+    w->first_completed = w->last_completed = NULL;
+
+    if(w->epfd >= 0)
+        watch_children(w);
+}
+
+/* The epoll set of a forked shell is the one of its parent, a change to
+   it would be seen by both */
+static void own_watch(struct process_watch *w)
+{
+    if(w->owner == getpid())
+        return;
+
+    unwatch_children(w);
+    if(w->epfd >= 0)
+        close(w->epfd);
+    free(w->entries);
+    free(w->polled);
+
+    open_watch(w);
+}
+
+struct process_watch *init_process_watch(void)
+{
+    struct process_watch *w;
+    int pidfd = syscall(SYS_pidfd_open, getpid(), 0);
+
+    if(pidfd < 0)
+        return NULL;
+    close(pidfd);
+
+    w = (struct process_watch *) malloc(sizeof(struct process_watch));
+    open_watch(w);
+
+    if(w->epfd < 0) {
+        free(w);
+        return NULL;
+    }
+
+    return w;
+}
+
+void delete_process_watch(struct process_watch *w)
+{
+    if(!w)
+        return;
+
+    if(w->owner == getpid()) {
+        unwatch_children(w);
+        if(w->epfd >= 0)
+            close(w->epfd);
+    }
+    free(w->entries);
+    free(w->polled);
+    free(w);
+}
+
+int process_watch_fd(struct process_watch *w, int *timeout)
+{
+    if(!w)
+        return -1;
+
+    own_watch(w);
+    *timeout = w->polled_num ? WATCH_POLL_MS : -1;
+
+    return w->epfd;
+}
+
+static void poll_entry(struct process_watch *w, struct job *j, struct process *p)
+{
+    if(w->polled_num == w->polled_capacity) {
+        w->polled_capacity = w->polled_capacity ? 2 * w->polled_capacity : 16;
+        w->polled = (struct watch_entry *) realloc(w->polled, w->polled_capacity
+                                                   * sizeof(struct watch_entry));
+    }
+
+    w->polled[w->polled_num].j = j;
+    w->polled[w->polled_num++].p = p;
+}
+
+/* Adds fd to the set, closing it if it can't be. Returns -1 then, with
+   errno set. */
+static int add_entry(struct process_watch *w, int fd, struct job *j, struct process *p)
+{
+    struct epoll_event event;
+    int error;
+
+    if(fd >= w->entry_num) {
+        int n = w->entry_num ? w->entry_num : 64;
+
+        while(n <= fd)
+            n *= 2;
+        w->entries = (struct watch_entry *) realloc(w->entries, n * sizeof(struct watch_entry));
+        memset(&w->entries[w->entry_num], 0, (n - w->entry_num) * sizeof(struct watch_entry));
+        w->entry_num = n;
+    }
+
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    if(epoll_ctl(w->epfd, EPOLL_CTL_ADD, fd, &event) < 0) {
+        error = errno;
+        close(fd);
+        errno = error;
+        return -1;
+    }
+
+    w->entries[fd].j = j;
+    w->entries[fd].p = p;
+
+    return 0;
+}
+
+static void remove_entry(struct process_watch *w, int fd)
+{
+    epoll_ctl(w->epfd, EPOLL_CTL_DEL, fd, NULL);
+    close(fd);
+
+    w->entries[fd].j = NULL;
+    w->entries[fd].p = NULL;
+}
+
+/* Opens a pidfd for p, or the deadline timer of j, into the set. Returns
+   -1 with errno set if it could not be. */
+static int add_descriptor(struct process_watch *w, struct job *j, struct process *p)
+{
+    int fd;
+
+    if(w->epfd < 0) {
+        errno = EBADF;
+        return -1;
+    }
+
+    fd = p ? syscall(SYS_pidfd_open, p->pid, 0) : deadline_timer(j->deadline);
+    if(fd < 0 || add_entry(w, fd, j, p) < 0)
+        return -1;
+
+    if(p)
+        p->pidfd = fd;
+    else
+        j->deadline->timer = fd;
+
+    return 0;
+}
+
+/* Keeps the entry polled, after add_descriptor failed for it in the
+   function named call */
+static void report_polling(struct process_watch *w, const char *call, struct job *j,
+                           struct process *p)
+{
+    if(!w->out_of_fds) {
+        if(errno == EMFILE || errno == ENFILE)
+            fprintf(stderr, "almishell: %s: %s, the processes and deadlines without a "
+                    "descriptor are polled\n", call, strerror(errno));
+        else
+            fprintf(stderr, "almishell: %s: %s\n", call, strerror(errno));
+        w->out_of_fds = 1;
+    }
+
+    poll_entry(w, j, p);
+}
+
+void watch_process(struct process_watch *w, struct job *j, struct process *p)
+{
+    if(!w)
+        return;
+
+    own_watch(w);
+
+    if(add_descriptor(w, j, p) < 0)
+        report_polling(w, "pidfd_open", j, p);
+}
+
+void watch_deadline(struct process_watch *w, struct job *j)
+{
+    if(!w || !j->deadline)
+        return;
+
+    own_watch(w);
+
+    if(add_descriptor(w, j, NULL) < 0)
+        report_polling(w, "timerfd_create", j, NULL);
+}
+
+/* Removes the deadline of j, once it has no process left to signal */
+static void unwatch_deadline(struct process_watch *w, struct job *j)
+{
+    size_t i;
+
+    if(!j->deadline)
+        return;
+
+    if(j->deadline->timer >= 0 && j->deadline->timer < w->entry_num
+       && w->entries[j->deadline->timer].j == j && !w->entries[j->deadline->timer].p)
+        remove_entry(w, j->deadline->timer);
+    j->deadline->timer = -1;
+
+    for(i = 0; i < w->polled_num; ) {
+        if(w->polled[i].j == j && !w->polled[i].p)
+            w->polled[i] = w->polled[--w->polled_num];
+        else
+            ++i;
+    }
+}
+
+/* Called once the last process of j was reaped */
+static void queue_completed(struct process_watch *w, struct job *j)
+{
+    /* Nothing is left to signal */
+    unwatch_deadline(w, j);
+
+    if(j->next_completed || w->last_completed == j)
+        return;
+
+    if(w->last_completed)
+        w->last_completed->next_completed = j;
+    else
+        w->first_completed = j;
+    w->last_completed = j;
+}
+
+static void dequeue_completed(struct process_watch *w, struct job *j)
+{
+    struct job *previous = NULL, *it;
+
+    for(it = w->first_completed; it != j; it = it->next_completed) {
+        if(!it)
+            return;
+        previous = it;
+    }
+
+    if(previous)
+        previous->next_completed = j->next_completed;
+    else
+        w->first_completed = j->next_completed;
+
+    if(w->last_completed == j)
+        w->last_completed = previous;
+    j->next_completed = NULL;
+}
+
+struct job *take_completed_job(struct process_watch *w, int waited)
+{
+    struct job *j;
+
+    own_watch(w);
+
+    for(j = w->first_completed; j && waited && !j->waited; j = j->next_completed);
+
+    if(j)
+        dequeue_completed(w, j);
+
+    return j;
+}
+
+void unwatch_job(struct process_watch *w, struct job *j)
+{
+    struct process_node *node;
+    size_t i;
+
+    if(!w)
+        return;
+
+    own_watch(w);
+
+    for(node = j->first_process; node; node = node->next) {
+        if(node->p->pidfd >= 0 && node->p->pidfd < w->entry_num
+           && w->entries[node->p->pidfd].p == node->p)
+            remove_entry(w, node->p->pidfd);
+        node->p->pidfd = -1;
+    }
+
+    unwatch_deadline(w, j);
+
+    for(i = 0; i < w->polled_num; ) {
+        if(w->polled[i].j == j)
+            w->polled[i] = w->polled[--w->polled_num];
+        else
+            ++i;
+    }
+
+    if(j->next_completed || w->last_completed == j)
+        dequeue_completed(w, j);
+}
+
+/* Records the status of p if it exited. Returns 1 if it did. */
+static int reap_process(struct process *p)
+{
+    struct rusage usage;
+    int status;
+    pid_t pid;
+
+    while((pid = wait4(p->pid, &status, WNOHANG, &usage)) < 0 && errno == EINTR);
+
+    if(pid == 0)
+        return 0;
+
+    if(pid < 0)
+        /* Nothing more will be known of it */
+        p->completed = 1;
+    else
+        set_process_status(p, status, &usage);
+
+    return 1;
+}
+
+static struct process *find_process(struct process_watch *w, pid_t pid)
+{
+    size_t i;
+    int fd;
+
+    for(fd = 0; fd < w->entry_num; ++fd)
+        if(w->entries[fd].p && w->entries[fd].p->pid == pid)
+            return w->entries[fd].p;
+
+    for(i = 0; i < w->polled_num; ++i)
+        if(w->polled[i].p && w->polled[i].p->pid == pid)
+            return w->polled[i].p;
+
+    return NULL;
+}
+
+/* A stopped process never makes its pidfd readable, the stops are taken
+   from waitid on each wakeup */
+static int mark_stopped(struct process_watch *w)
+{
+    struct process *p;
+    siginfo_t info;
+    int stopped = 0;
+
+    for(;;) {
+        info.si_pid = 0;
+        if(waitid(P_ALL, 0, &info, WSTOPPED | WNOHANG) < 0 || !info.si_pid)
+            return stopped;
+
+        if( (p = find_process(w, info.si_pid)) ) {
+            set_process_status(p, W_STOPCODE(info.si_status), NULL);
+            ++stopped;
+        }
+    }
+}
+
+static void expire_deadline(struct process_watch *w, struct job *j)
+{
+    int sig;
+
+    if(job_is_completed(j))
+        unwatch_deadline(w, j);
+    else if( (sig = expire_job_deadline(j->deadline, j->deadline->timer)) )
+        signal_job(j, sig);
+}
+
+/* Looks at the processes and deadlines without a descriptor, moving those
+   that can get one now to the set */
+static int run_polled(struct process_watch *w)
+{
+    struct watch_entry *e;
+    struct job *j;
+    size_t i;
+    int changed = 0, sig;
+
+    for(i = 0; i < w->polled_num; ) {
+        e = &w->polled[i];
+
+        if(e->p ? e->p->completed : job_is_completed(e->j)) {
+            *e = w->polled[--w->polled_num];
+            continue;
+        }
+
+        if(add_descriptor(w, e->j, e->p) == 0) {
+            *e = w->polled[--w->polled_num];
+            continue;
+        }
+
+        if(!e->p) {
+            if( (sig = check_job_deadline(e->j->deadline)) )
+                signal_job(e->j, sig);
+        } else if(reap_process(e->p)) {
+            j = e->j;
+            *e = w->polled[--w->polled_num];
+            ++changed;
+
+            if(job_is_completed(j))
+                queue_completed(w, j);
+            continue;
+        }
+
+        ++i;
+    }
+
+    if(!w->polled_num)
+        w->out_of_fds = 0;
+
+    return changed;
+}
+
+int run_process_watch(struct process_watch *w, int timeout)
+{
+    struct epoll_event ready[WATCH_EVENTS];
+    struct watch_entry *e;
+    struct process *p;
+    struct job *j;
+    char drain[64];
+    int n, k, changed = 0;
+
+    own_watch(w);
+
+    /* Without SIGCHLD, the stops are looked for as often as the polled entries */
+    if((w->polled_num || !w->children) && (timeout < 0 || timeout > WATCH_POLL_MS))
+        timeout = WATCH_POLL_MS;
+
+    if(w->epfd >= 0)
+        n = epoll_wait(w->epfd, ready, WATCH_EVENTS, timeout);
+    else
+        n = poll(NULL, 0, timeout);
+
+    if(n < 0) {
+        if(errno != EINTR) {
+            perror("almishell: epoll_wait");
+            return -1;
+        }
+        n = 0;
+    }
+
+    for(k = 0; k < n; ++k) {
+        if(ready[k].data.fd == child_pipe[0]) {
+            while(read(child_pipe[0], drain, sizeof(drain)) > 0);
+            continue;
+        }
+
+        e = &w->entries[ready[k].data.fd];
+        j = e->j;
+        p = e->p;
+
+        /* Removed by an earlier event */
+        if(!j)
+            continue;
+
+        if(!p) {
+            expire_deadline(w, j);
+            continue;
+        }
+
+        if(!p->completed) {
+            if(!reap_process(p))
+                continue;
+            ++changed;
+        }
+
+        remove_entry(w, p->pidfd);
+        p->pidfd = -1;
+
+        if(job_is_completed(j))
+            queue_completed(w, j);
+    }
+
+    changed += mark_stopped(w);
+
+    return changed + run_polled(w);
+}
@@ -0,0 +1,535 @@
+/*
+ALMiSHELL - A POSIX conformant shell prototype.
+Copyright (C) 2017  Henrique C. S. M. Aranha; Lucas E. C. Mello; Lucas H. F. Leal
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define _GNU_SOURCE /* syscall and the d_type constants */
+
+#include <wildcard.h>
+#include <vars.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdint.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+/* Size of the buffer handed to getdents64, large enough to read big
+   directories in few system calls */
+#define GETDENTS_BUFFER_SIZE (256 * 1024)
+
+enum token_type {
+    TOKEN_CHAR,
+    TOKEN_ANY,
+    TOKEN_STAR,
+    TOKEN_CLASS
+};
+
+struct pattern_token {
+    enum token_type type;
+    unsigned char c;
+    unsigned char class[32];    /* bitmap of the accepted characters */
+};
+
+struct pattern {
+    struct pattern_token *tokens;
+    size_t size;
+    int leading_dot;
+
+    /* Patterns like *.log are matched by comparing the suffix only */
+    char *suffix;
+    size_t suffix_len;
+};
+
+/* Entries of a directory, the names are kept in a single pool */
+struct dir_listing {
+    char *path;
+    char *pool;
+    size_t *names;              /* offsets into pool */
+    unsigned char *types;       /* d_type of each entry */
+    size_t size;
+    struct dir_listing *next;
+};
+
+struct dir_cache {
+    struct dir_listing *listings;
+};
+
+struct path_list {
+    char **v;
+    size_t size;
+    size_t capacity;
+};
+
+/* Parses the bracket expression starting at pattern[*i] == '['. Returns 0
+   if it is not terminated, in which case the '[' is an ordinary char. */
+static int compile_class(struct pattern_token *tok, const char *pattern, size_t len, size_t *i)
+{
+    size_t k = *i + 1, c;
+    int negate = 0, first = 1;
+
+    memset(tok->class, 0, sizeof(tok->class));
+
+    if(k < len && (pattern[k] == '!' || pattern[k] == '^')) {
+        negate = 1;
+        ++k;
+    }
+
+    for(; k < len && (first || pattern[k] != ']'); ++k, first = 0) {
+        unsigned char lo = pattern[k], hi = lo;
+
+        if(k + 2 < len && pattern[k + 1] == '-' && pattern[k + 2] != ']') {
+            hi = pattern[k + 2];
+            k += 2;
+        }
+
+        for(c = lo; c <= hi; ++c)
+            tok->class[c / 8] |= 1 << (c % 8);
+    }
+
+    if(k >= len)
+        return 0;
+
+    if(negate)
+        for(c = 0; c < sizeof(tok->class); ++c)
+            tok->class[c] = ~tok->class[c];
+
+    tok->type = TOKEN_CLASS;
+    *i = k;
+
+    return 1;
+}
+
+struct pattern *compile_pattern(const char *pattern, size_t len)
+{
+    struct pattern *p = (struct pattern *) malloc(sizeof(struct pattern));
+    size_t i, k;
+
+    p->tokens = (struct pattern_token *) malloc((len + 1) * sizeof(struct pattern_token));
+    p->size = 0;
+    p->leading_dot = len > 0 && pattern[0] == '.';
+    p->suffix = NULL;
+    p->suffix_len = 0;
+
+    for(i = 0; i < len; ++i) {
+        struct pattern_token *tok = &p->tokens[p->size];
+
+        switch(pattern[i]) {
+        case '*':
+            /* Consecutive stars are the same as one */
+            if(p->size && tok[-1].type == TOKEN_STAR)
+                continue;
+            tok->type = TOKEN_STAR;
+            break;
+
+        case '?':
+            tok->type = TOKEN_ANY;
+            break;
+
+        case '[':
+            if(compile_class(tok, pattern, len, &i))
+                break;
+            tok->type = TOKEN_CHAR;
+            tok->c = '[';
+            break;
+
+        case '\\':
+            if(i + 1 < len)
+                ++i;
+            /* FALLTHROUGH */
+        default:
+            tok->type = TOKEN_CHAR;
+            tok->c = pattern[i];
+            break;
+        }
+
+        ++p->size;
+    }
+
+    /* A star followed only by plain characters */
+    if(p->size && p->tokens[0].type == TOKEN_STAR) {
+        for(k = 1; k < p->size && p->tokens[k].type == TOKEN_CHAR; ++k);
+
+        if(k == p->size) {
+            p->suffix_len = p->size - 1;
+            p->suffix = (char *) malloc(p->suffix_len + 1);
+            for(k = 1; k < p->size; ++k)
+                p->suffix[k - 1] = p->tokens[k].c;
+            p->suffix[p->suffix_len] = '\0';
+        }
+    }
+
+    return p;
+}
+
+void delete_pattern(struct pattern *p)
+{
+    if(!p)
+        return;
+
+    free(p->tokens);
+    free(p->suffix);
+    free(p);
+}
+
+static int token_matches(const struct pattern_token *tok, unsigned char c)
+{
+    switch(tok->type) {
+    case TOKEN_CHAR:
+        return tok->c == c;
+    case TOKEN_ANY:
+        return 1;
+    case TOKEN_CLASS:
+        return (tok->class[c / 8] >> (c % 8)) & 1;
+    default:
+        return 0;
+    }
+}
+
+int match_pattern(const struct pattern *p, const char *name)
+{
+    const char *n = name, *star_n = NULL;
+    size_t t = 0, star_t = 0;
+
+    if(name[0] == '.' && !p->leading_dot)
+        return 0;
+
+    if(p->suffix) {
+        size_t len = strlen(name);
+
+        return len >= p->suffix_len
+               && !memcmp(name + len - p->suffix_len, p->suffix, p->suffix_len);
+    }
+
+    /* Backtracking only to the last star is enough for shell patterns */
+    while(*n) {
+        if(t < p->size) {
+            if(p->tokens[t].type == TOKEN_STAR) {
+                star_t = t++;
+                star_n = n;
+                continue;
+            }
+
+            if(token_matches(&p->tokens[t], *n)) {
+                ++t;
+                ++n;
+                continue;
+            }
+        }
+
+        if(!star_n)
+            return 0;
+
+        t = star_t + 1;
+        n = ++star_n;
+    }
+
+    while(t < p->size && p->tokens[t].type == TOKEN_STAR)
+        ++t;
+
+    return t == p->size;
+}
+
+int has_wildcards(const char *word)
+{
+    for(; *word; ++word) {
+        if(*word == '\\' && word[1])
+            ++word;
+        else if(*word == '*' || *word == '?' || (*word == '[' && strchr(word, ']')))
+            return 1;
+    }
+
+    return 0;
+}
+
+static void add_entry(struct dir_listing *l, size_t *pool_size, size_t *pool_capacity,
+                      size_t *capacity, const char *name, unsigned char type)
+{
+    size_t len = strlen(name) + 1;
+
+    if(name[0] == '.' && (!name[1] || (name[1] == '.' && !name[2])))
+        return;
+
+    if(l->size == *capacity) {
+        *capacity = *capacity ? *capacity * 2 : 256;
+        l->names = (size_t *) realloc(l->names, *capacity * sizeof(size_t));
+        l->types = (unsigned char *) realloc(l->types, *capacity);
+    }
+
+    if(*pool_size + len > *pool_capacity) {
+        while(*pool_size + len > *pool_capacity)
+            *pool_capacity = *pool_capacity ? *pool_capacity * 2 : 4096;
+        l->pool = (char *) realloc(l->pool, *pool_capacity);
+    }
+
+    memcpy(l->pool + *pool_size, name, len);
+    l->names[l->size] = *pool_size;
+    l->types[l->size++] = type;
+    *pool_size += len;
+}
+
+static struct dir_listing *read_listing(const char *path)
+{
+    struct dir_listing *l;
+    size_t pool_size = 0, pool_capacity = 0, capacity = 0;
+    int fd = open(*path ? path : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+#ifdef SYS_getdents64
+    char *buffer;
+    long n, offset;
+#else
+    DIR *dir;
+    struct dirent *entry;
+#endif
+
+    if(fd < 0)
+        return NULL;
+
+    l = (struct dir_listing *) calloc(1, sizeof(struct dir_listing));
+    l->path = (char *) malloc(strlen(path) + 1);
+    strcpy(l->path, path);
+
+#ifdef SYS_getdents64
+    /* Read the raw kernel records in large batches */
+    buffer = (char *) malloc(GETDENTS_BUFFER_SIZE);
+
+    while((n = syscall(SYS_getdents64, fd, buffer, GETDENTS_BUFFER_SIZE)) > 0) {
+        for(offset = 0; offset < n; ) {
+            /* struct linux_dirent64: ino, off, reclen, type, name */
+            const char *record = buffer + offset;
+            unsigned short reclen;
+
+            memcpy(&reclen, record + 2 * sizeof(uint64_t), sizeof(reclen));
+            add_entry(l, &pool_size, &pool_capacity, &capacity,
+                      record + 2 * sizeof(uint64_t) + sizeof(reclen) + 1,
+                      (unsigned char) record[2 * sizeof(uint64_t) + sizeof(reclen)]);
+            offset += reclen;
+        }
+    }
+
+    free(buffer);
+    close(fd);
+#else
+    dir = fdopendir(fd);
+    while( (entry = readdir(dir)) )
+        add_entry(l, &pool_size, &pool_capacity, &capacity, entry->d_name, DT_UNKNOWN);
+    closedir(dir);
+#endif
+
+    return l;
+}
+
+static void delete_listing(struct dir_listing *l)
+{
+    free(l->path);
+    free(l->pool);
+    free(l->names);
+    free(l->types);
+    free(l);
+}
+
+struct dir_cache *init_dir_cache(void)
+{
+    return (struct dir_cache *) calloc(1, sizeof(struct dir_cache));
+}
+
+void clear_dir_cache(struct dir_cache *c)
+{
+    struct dir_listing *l;
+
+    while( (l = c->listings) ) {
+        c->listings = l->next;
+        delete_listing(l);
+    }
+}
+
+void delete_dir_cache(struct dir_cache *c)
+{
+    if(!c)
+        return;
+
+    clear_dir_cache(c);
+    free(c);
+}
+
+static struct dir_listing *get_listing(struct dir_cache *c, const char *path)
+{
+    struct dir_listing *l;
+
+    if(!c)
+        return read_listing(path);
+
+    for(l = c->listings; l; l = l->next)
+        if(!strcmp(l->path, path))
+            return l;
+
+    if( (l = read_listing(path)) ) {
+        l->next = c->listings;
+        c->listings = l;
+    }
+
+    return l;
+}
+
+static void add_path(struct path_list *list, const char *path)
+{
+    if(list->size + 1 >= list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2 : 64;
+        list->v = (char **) realloc(list->v, list->capacity * sizeof(char *));
+    }
+
+    list->v[list->size] = (char *) malloc(strlen(path) + 1);
+    strcpy(list->v[list->size++], path);
+    list->v[list->size] = NULL;
+}
+
+/* Appends component to the path buffer, returns the previous length */
+static size_t push_component(char **path, size_t *capacity, const char *component)
+{
+    size_t len = strlen(*path), add = strlen(component) + 2;
+
+    if(len + add > *capacity) {
+        while(len + add > *capacity)
+            *capacity *= 2;
+        *path = (char *) realloc(*path, *capacity);
+    }
+
+    if(len && (*path)[len - 1] != '/')
+        strcat(*path, "/");
+    strcat(*path, component);
+
+    return len;
+}
+
+static int is_directory(const char *path, unsigned char type)
+{
+    struct stat st;
+
+    if(type == DT_DIR)
+        return 1;
+    if(type != DT_UNKNOWN && type != DT_LNK)
+        return 0;
+
+    return stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+struct glob_state {
+    char **components;
+    struct pattern **patterns;  /* NULL for components without wildcards */
+    size_t size;
+    int trailing_slash;
+    struct dir_cache *cache;
+    struct path_list results;
+};
+
+static void glob_component(struct glob_state *g, char **path, size_t *capacity, size_t idx,
+                           int must_exist)
+{
+    struct dir_listing *l;
+    size_t i, previous;
+    struct stat st;
+
+    if(idx == g->size) {
+        if(!must_exist || lstat(*path, &st) == 0) {
+            if(g->trailing_slash)
+                strcat(*path, "/");
+            add_path(&g->results, *path);
+        }
+        return;
+    }
+
+    if(!g->patterns[idx]) {
+        previous = push_component(path, capacity, g->components[idx]);
+        glob_component(g, path, capacity, idx + 1, 1);
+        (*path)[previous] = '\0';
+        return;
+    }
+
+    if(!(l = get_listing(g->cache, *path)))
+        return;
+
+    for(i = 0; i < l->size; ++i) {
+        const char *name = l->pool + l->names[i];
+
+        if(!match_pattern(g->patterns[idx], name))
+            continue;
+
+        previous = push_component(path, capacity, name);
+
+        if((idx + 1 == g->size && !g->trailing_slash) || is_directory(*path, l->types[i]))
+            glob_component(g, path, capacity, idx + 1, 0);
+
+        (*path)[previous] = '\0';
+    }
+
+    if(!g->cache)
+        delete_listing(l);
+}
+
+static int compare_paths(const void *a, const void *b)
+{
+    return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+char **expand_wildcards(struct shell_info *s, const char *word)
+{
+    struct glob_state g;
+    const char *cache_var = get_var(s->vars, "GLOBCACHE");
+    char *copy, *component, *saveptr = NULL, *path;
+    size_t i, len = strlen(word), capacity = len + 256;
+
+    copy = (char *) malloc(len + 1);
+    strcpy(copy, word);
+
+    g.components = (char **) malloc((len / 2 + 2) * sizeof(char *));
+    g.patterns = (struct pattern **) malloc((len / 2 + 2) * sizeof(struct pattern *));
+    g.size = 0;
+    g.trailing_slash = len > 1 && word[len - 1] == '/';
+    g.cache = cache_var && cache_var[0] ? s->dir_cache : NULL;
+    g.results.v = NULL;
+    g.results.size = g.results.capacity = 0;
+
+    /* Each component pattern is compiled once for the whole expansion */
+    for(component = strtok_r(copy, "/", &saveptr); component;
+        component = strtok_r(NULL, "/", &saveptr)) {
+        g.components[g.size] = component;
+        g.patterns[g.size++] = has_wildcards(component)
+                               ? compile_pattern(component, strlen(component)) : NULL;
+    }
+
+    path = (char *) malloc(capacity);
+    strcpy(path, word[0] == '/' ? "/" : "");
+
+    glob_component(&g, &path, &capacity, 0, 0);
+
+    if(g.results.size > 1)
+        qsort(g.results.v, g.results.size, sizeof(char *), compare_paths);
+
+    for(i = 0; i < g.size; ++i)
+        delete_pattern(g.patterns[i]);
+
+    free(path);
+    free(g.patterns);
+    free(g.components);
+    free(copy);
+
+    return g.results.v;
+}